@@ -0,0 +1,145 @@
+﻿/*
+* Licensed to the Apache Software Foundation (ASF) under one
+* or more contributor license agreements.  See the NOTICE file
+* distributed with this work for additional information
+* regarding copyright ownership.  The ASF licenses this file
+* to you under the Apache License, Version 2.0 (the
+* "License"); you may not use this file except in compliance
+* with the License.  You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing,
+* software distributed under the License is distributed on an
+* "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+* KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations
+* under the License.
+*/
+
+//Throughput of the value compression against the bytes it saves on
+//the wire. Usage: lz4bench [seconds per case]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <string>
+#include <vector>
+
+#include "util/lz4.h"
+#include "compressor.h"
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+//Records like the ones usually cached: repeated field names, numbers
+//and short strings
+static std::string makeJson(int size)
+{
+    static const char* names[] = {"alice", "bob", "carol", "dave", "eve", "mallory"};
+    std::string s = "[";
+    char buf[256];
+    for (int i = 0; (int)s.size() < size; ++i) {
+        int n = sprintf(buf, "%s{\"id\":%d,\"name\":\"%s\",\"score\":%d,\"active\":%s,"
+                        "\"tags\":[\"t%d\",\"t%d\"],\"updated_at\":\"2016-04-%02d %02d:%02d:%02d\"}",
+                        (i == 0 ? "" : ","), rand(), names[rand() % 6], rand() % 100000,
+                        (rand() % 2 ? "true" : "false"), rand() % 50, rand() % 50,
+                        rand() % 28 + 1, rand() % 24, rand() % 60, rand() % 60);
+        s.append(buf, n);
+    }
+    s.resize(size);
+    return s;
+}
+
+static std::string makeRandom(int size)
+{
+    std::string s(size, '\0');
+    for (int i = 0; i < size; ++i) {
+        s[i] = (char)rand();
+    }
+    return s;
+}
+
+static void run(const char* name, const std::string& value, double seconds)
+{
+    int len = value.size();
+    std::vector<char> packed(lz4_compress_bound(len));
+    std::vector<char> unpacked(len);
+
+    int packedSize = 0;
+    long long rounds = 0;
+    double begin = now();
+    double elapsed;
+    do {
+        for (int i = 0; i < 16; ++i) {
+            packedSize = lz4_compress(value.data(), len, &packed[0], packed.size());
+        }
+        rounds += 16;
+        elapsed = now() - begin;
+    } while (elapsed < seconds);
+    double compressSpeed = (double)len * rounds / elapsed / (1024 * 1024);
+    double compressCost = elapsed / rounds;
+
+    rounds = 0;
+    begin = now();
+    do {
+        for (int i = 0; i < 16; ++i) {
+            if (lz4_decompress(&packed[0], packedSize, &unpacked[0], len) != len) {
+                printf("%s: decompression failed\n", name);
+                return;
+            }
+        }
+        rounds += 16;
+        elapsed = now() - begin;
+    } while (elapsed < seconds);
+    double decompressSpeed = (double)len * rounds / elapsed / (1024 * 1024);
+    double decompressCost = elapsed / rounds;
+
+    if (memcmp(&unpacked[0], value.data(), len) != 0) {
+        printf("%s: round trip mismatch\n", name);
+        return;
+    }
+
+    //The proxy sends the raw value when the compressed one is not smaller
+    int wire = ValueCompressor::HeaderSize + packedSize;
+    if (wire >= len) {
+        wire = len;
+    }
+    int saved = len - wire;
+    //Time to send the saved bytes on a 1Gbit/s link against the CPU time
+    //spent to compress once and decompress once
+    double savedUs = saved * 8.0 / 1e9 * 1e6;
+    double costUs = (compressCost + decompressCost) * 1e6;
+    printf("%-8s %9d %9d %6.1f%% %10.1f %11.1f %9.1f %9.1f\n",
+           name, len, wire, 100.0 * saved / len,
+           compressSpeed, decompressSpeed, costUs, savedUs);
+}
+
+int main(int argc, char** argv)
+{
+    double seconds = (argc > 1) ? atof(argv[1]) : 0.5;
+    if (seconds <= 0) {
+        seconds = 0.5;
+    }
+    srand(1);
+
+    printf("%-8s %9s %9s %7s %10s %11s %9s %9s\n",
+           "VALUE", "RAW", "WIRE", "SAVED", "COMP_MB/S", "DECOMP_MB/S", "CPU_US", "1GBIT_US");
+    int sizes[] = {1024, 10 * 1024, 100 * 1024, 500 * 1024};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        char name[32];
+        sprintf(name, "json%dk", sizes[i] / 1024);
+        run(name, makeJson(sizes[i]), seconds);
+    }
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        char name[32];
+        sprintf(name, "rand%dk", sizes[i] / 1024);
+        run(name, makeRandom(sizes[i]), seconds);
+    }
+    return 0;
+}
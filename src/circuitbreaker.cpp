@@ -0,0 +1,180 @@
+﻿/*
+* Licensed to the Apache Software Foundation (ASF) under one
+* or more contributor license agreements.  See the NOTICE file
+* distributed with this work for additional information
+* regarding copyright ownership.  The ASF licenses this file
+* to you under the Apache License, Version 2.0 (the
+* "License"); you may not use this file except in compliance
+* with the License.  You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing,
+* software distributed under the License is distributed on an
+* "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+* KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations
+* under the License.
+*/
+
+#include "util/clock.h"
+#include "circuitbreaker.h"
+
+
+CircuitBreaker::CircuitBreaker(void)
+{
+    m_state = Closed;
+    m_stateTime = 0;
+    m_consecutive = 0;
+    m_windowRequests = 0;
+    m_windowErrors = 0;
+    m_windowStart = 0;
+    m_probes = 0;
+    m_probeSuccesses = 0;
+    m_opens = 0;
+    m_rejected = 0;
+}
+
+CircuitBreaker::~CircuitBreaker(void)
+{
+}
+
+const char* CircuitBreaker::stateName(State state)
+{
+    switch (state) {
+    case Open:
+        return "open";
+    case HalfOpen:
+        return "half-open";
+    default:
+        return "closed";
+    }
+}
+
+//Read without the lock, a stale answer only sends one more request to
+//allowRequest()
+bool CircuitBreaker::isAvailable(void) const
+{
+    switch (m_state) {
+    case Open:
+        return (currentMsec() - m_stateTime >= m_option.openTime);
+    case HalfOpen:
+        return (m_probes < m_option.probes);
+    default:
+        return true;
+    }
+}
+
+bool CircuitBreaker::allowRequest(void)
+{
+    if (m_state == Closed) {
+        return true;
+    }
+
+    long long now = currentMsec();
+    bool allowed = false;
+    m_locker.lock();
+    if (m_state == Open && now - m_stateTime >= m_option.openTime) {
+        m_state = HalfOpen;
+        m_stateTime = now;
+        m_probes = 0;
+        m_probeSuccesses = 0;
+    }
+    if (m_state == HalfOpen) {
+        //A probe which never returned doesn't hold the circuit for ever
+        if (m_probes >= m_option.probes && now - m_stateTime >= m_option.openTime) {
+            m_stateTime = now;
+            m_probes = 0;
+        }
+        if (m_probes < m_option.probes) {
+            ++m_probes;
+            allowed = true;
+        }
+    } else if (m_state == Closed) {
+        allowed = true;
+    }
+    m_locker.unlock();
+
+    if (!allowed) {
+        __sync_add_and_fetch(&m_rejected, 1);
+    }
+    return allowed;
+}
+
+bool CircuitBreaker::onSuccess(void)
+{
+    bool changed = false;
+    long long now = currentMsec();
+    m_locker.lock();
+    switch (m_state) {
+    case Closed:
+        m_consecutive = 0;
+        if (now - m_windowStart >= Window) {
+            resetWindow(now);
+        }
+        ++m_windowRequests;
+        break;
+    case HalfOpen:
+        if (m_probes > 0) {
+            --m_probes;
+        }
+        if (++m_probeSuccesses >= m_option.probes) {
+            m_state = Closed;
+            m_stateTime = now;
+            m_consecutive = 0;
+            resetWindow(now);
+            changed = true;
+        }
+        break;
+    default:
+        break;
+    }
+    m_locker.unlock();
+    return changed;
+}
+
+bool CircuitBreaker::onFailure(void)
+{
+    bool changed = false;
+    long long now = currentMsec();
+    m_locker.lock();
+    switch (m_state) {
+    case Closed:
+        ++m_consecutive;
+        if (now - m_windowStart >= Window) {
+            resetWindow(now);
+        }
+        ++m_windowRequests;
+        ++m_windowErrors;
+        if ((m_option.errors > 0 && m_consecutive >= m_option.errors) ||
+            (m_option.errorRate > 0 && m_windowRequests >= MinRequests &&
+             m_windowErrors * 100 >= m_option.errorRate * m_windowRequests)) {
+            open(now);
+            changed = true;
+        }
+        break;
+    case HalfOpen:
+        open(now);
+        changed = true;
+        break;
+    default:
+        break;
+    }
+    m_locker.unlock();
+    return changed;
+}
+
+void CircuitBreaker::open(long long now)
+{
+    m_state = Open;
+    m_stateTime = now;
+    m_probes = 0;
+    ++m_opens;
+}
+
+void CircuitBreaker::resetWindow(long long now)
+{
+    m_windowStart = now;
+    m_windowRequests = 0;
+    m_windowErrors = 0;
+}
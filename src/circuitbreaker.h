@@ -0,0 +1,100 @@
+﻿/*
+* Licensed to the Apache Software Foundation (ASF) under one
+* or more contributor license agreements.  See the NOTICE file
+* distributed with this work for additional information
+* regarding copyright ownership.  The ASF licenses this file
+* to you under the Apache License, Version 2.0 (the
+* "License"); you may not use this file except in compliance
+* with the License.  You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing,
+* software distributed under the License is distributed on an
+* "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+* KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations
+* under the License.
+*/
+
+#ifndef CIRCUITBREAKER_H
+#define CIRCUITBREAKER_H
+
+#include "util/locker.h"
+
+//Keeps the requests away from a failing backend. The circuit opens after
+//a number of errors in a row or when the errors pass a share of the
+//recent requests. Once open, no request goes through for a while, then
+//a few probes are let through and their replies close or reopen it
+class CircuitBreaker
+{
+public:
+    struct Option {
+        Option(void) {
+            errors = 0;
+            errorRate = 0;
+            openTime = 1000;
+            probes = 1;
+        }
+
+        int errors;         //Errors in a row which open the circuit, 0 to disable
+        int errorRate;      //Percent of errors in the window which open it, 0 to disable
+        int openTime;       //Msec before the probes
+        int probes;         //Probes in flight, and good replies which close it
+    };
+
+    enum State {
+        Closed = 0,
+        Open = 1,
+        HalfOpen = 2
+    };
+
+    enum {
+        Window = 1000,      //Msec of requests the error rate is taken over
+        MinRequests = 20    //Requests of the window below which the rate isn't used
+    };
+
+    CircuitBreaker(void);
+    ~CircuitBreaker(void);
+
+    void setOption(const Option& opt) { m_option = opt; }
+    Option option(void) const { return m_option; }
+    bool isEnabled(void) const { return (m_option.errors > 0 || m_option.errorRate > 0); }
+
+    //Whether a request could go through now, read by the policies
+    bool isAvailable(void) const;
+    //Take the right to send a request, a probe when half open
+    bool allowRequest(void);
+    //True when the reply changed the state
+    bool onSuccess(void);
+    bool onFailure(void);
+
+    State state(void) const { return (State)m_state; }
+    static const char* stateName(State state);
+    long long opens(void) const { return m_opens; }
+    long long rejected(void) const { return m_rejected; }
+
+private:
+    void open(long long now);
+    void resetWindow(long long now);
+
+private:
+    Option m_option;
+    SpinLocker m_locker;
+    volatile int m_state;
+    long long m_stateTime;      //Msec of the last change of the state
+    int m_consecutive;
+    int m_windowRequests;
+    int m_windowErrors;
+    long long m_windowStart;
+    volatile int m_probes;      //Probes in flight
+    int m_probeSuccesses;
+    long long m_opens;
+    volatile long long m_rejected;
+
+private:
+    CircuitBreaker(const CircuitBreaker&);
+    CircuitBreaker& operator =(const CircuitBreaker&);
+};
+
+#endif
@@ -21,6 +21,7 @@
 #include "redisproxy.h"
 #include "redisservant.h"
 #include "redis-proxy-config.h"
+#include "compressor.h"
 
 struct MGetCommandContext
 {
@@ -46,6 +47,34 @@ struct DelCommandContext
     ClientPacket* packet;
 };
 
+struct KeyspaceCommandContext
+{
+    int subCount;
+    int returnCount;
+    ClientPacket** subs;
+    ClientPacket* packet;
+};
+
+struct ScanCommandContext
+{
+    int groupIndex;
+    int groupCount;
+    ClientPacket* packet;
+};
+
+struct TransactionContext
+{
+    bool multi;
+    bool aborted;
+    int commandCount;
+    IOBuffer commands;
+    std::vector<int> commandTypes;
+    std::vector<std::string> writtenKeys;
+    RedisServantGroup* group;
+    RedisServant* servant;
+    RedisConnection* redisSocket;
+};
+
 void onGetPacketFinished(ClientPacket*, void* arg)
 {
     MGetCommandContext* mgetcontext = (MGetCommandContext*)arg;
@@ -119,6 +148,7 @@ void onMGetCommand(ClientPacket* packet, void*)
 
             ClientPacket* get = new ClientPacket;
             get->eventLoop = packet->eventLoop;
+            get->session = packet->session;
             get->commandType = RedisCommand::GET;
             get->finished_func = onGetPacketFinished;
             get->finished_arg = mgetcontext;
@@ -162,6 +192,7 @@ void onMSetCommand(ClientPacket* packet, void*)
             set->finished_func = onSetPacketFinished;
             set->finished_arg = msetcontext;
             set->eventLoop = packet->eventLoop;
+            set->session = packet->session;
             set->commandType = RedisCommand::SET;
             set->recvBuff.appendFormatString("*3\r\n$3\r\nSET\r\n$%d\r\n", len);
             set->recvBuff.append(key, len);
@@ -203,6 +234,7 @@ void onDelCommand(ClientPacket* packet, void*)
             del->finished_arg = delcontext;
             del->commandType = RedisCommand::DEL;
             del->eventLoop = packet->eventLoop;
+            del->session = packet->session;
             del->recvBuff.appendFormatString("*2\r\n$3\r\nDEL\r\n$%d\r\n", len);
             del->recvBuff.append(key, len);
             del->recvBuff.append("\r\n");
@@ -212,6 +244,981 @@ void onDelCommand(ClientPacket* packet, void*)
     }
 }
 
+//BLPOP/BRPOP key [key ...] timeout, BRPOPLPUSH source destination timeout
+void onBlockingCommand(ClientPacket* packet, void*)
+{
+    RedisProtoParseResult& r = packet->recvParseResult;
+    int keyCount = r.tokenCount - 2;
+    if (keyCount < 1 || r.integer != r.tokenCount ||
+        (packet->commandType == RedisCommand::BRPOPLPUSH && keyCount != 2)) {
+        packet->setFinishedState(ClientPacket::WrongNumberOfArguments);
+        return;
+    }
+
+    Token& arg = r.tokens[r.tokenCount - 1];
+    char buf[32] = {0};
+    char* end = NULL;
+    strncpy(buf, arg.s, arg.len < 31 ? arg.len : 31);
+    double timeout = strtod(buf, &end);
+    if (arg.len == 0 || arg.len > 31 || *end != 0 || timeout < 0 || timeout > 86400 * 365) {
+        packet->sendBuff.append("-ERR timeout is not a float or out of range\r\n");
+        packet->setFinishedState(ClientPacket::RequestFinished);
+        return;
+    }
+
+    RedisProxy* proxy = packet->proxy();
+    RedisServantGroup* group = NULL;
+    for (int i = 1; i <= keyCount; ++i) {
+        RedisServantGroup* keyGroup = proxy->mapToGroup(r.tokens[i].s, r.tokens[i].len);
+        if (!keyGroup || (group && keyGroup != group)) {
+            packet->sendBuff.append("-ERR keys in request must map to the same group\r\n");
+            packet->setFinishedState(ClientPacket::RequestFinished);
+            return;
+        }
+        group = keyGroup;
+    }
+
+    RedisServant* servant = group->findUsableServant(packet);
+    if (!servant) {
+        packet->sendBuff.append("-ERR backend is not available\r\n");
+        packet->setFinishedState(ClientPacket::RequestFinished);
+        return;
+    }
+    servant->handleBlocking(packet, (int)(timeout * 1000));
+}
+
+static bool isErrorReply(ClientPacket* packet)
+{
+    return (!packet->sendBuff.isEmpty() && packet->sendBuff.data()[0] == '-');
+}
+
+//Copies of the request, one for each backend. The context is released
+//by the finished function of the last returned packet
+static KeyspaceCommandContext* createKeyspaceContext(ClientPacket* packet, int count,
+                                                     void (*func)(ClientPacket*, void*))
+{
+    RedisProtoParseResult& r = packet->recvParseResult;
+    KeyspaceCommandContext* context = new KeyspaceCommandContext;
+    context->subCount = count;
+    context->returnCount = 0;
+    context->subs = new ClientPacket*[count];
+    context->packet = packet;
+    for (int i = 0; i < count; ++i) {
+        ClientPacket* sub = new ClientPacket;
+        sub->eventLoop = packet->eventLoop;
+        sub->session = packet->session;
+        sub->commandType = packet->commandType;
+        sub->finished_func = func;
+        sub->finished_arg = context;
+        sub->recvBuff.append(r.protoBuff, r.protoBuffLen);
+        sub->continueToParseRecvBuffer();
+        context->subs[i] = sub;
+    }
+    return context;
+}
+
+//Send the request to every group
+static void broadcastToGroups(ClientPacket* packet, void (*func)(ClientPacket*, void*))
+{
+    RedisProxy* proxy = packet->proxy();
+    int groupCount = proxy->groupCount();
+    if (groupCount <= 0) {
+        packet->sendBuff.append("-ERR group is not available\r\n");
+        packet->setFinishedState(ClientPacket::RequestFinished);
+        return;
+    }
+
+    KeyspaceCommandContext* context = createKeyspaceContext(packet, groupCount, func);
+    ClientPacket** subs = context->subs;
+    for (int i = 0; i < groupCount; ++i) {
+        proxy->handleGroupPacket(proxy->group(i), subs[i]);
+    }
+}
+
+//Send the request to every master of every group
+static void broadcastToMasters(ClientPacket* packet, void (*func)(ClientPacket*, void*))
+{
+    RedisProxy* proxy = packet->proxy();
+    Vector<RedisServant*> masters;
+    for (int i = 0; i < proxy->groupCount(); ++i) {
+        RedisServantGroup* group = proxy->group(i);
+        for (int j = 0; j < group->masterCount(); ++j) {
+            masters.append(group->master(j));
+        }
+    }
+    int masterCount = masters.size();
+    if (masterCount <= 0) {
+        packet->sendBuff.append("-ERR backend is not available\r\n");
+        packet->setFinishedState(ClientPacket::RequestFinished);
+        return;
+    }
+
+    KeyspaceCommandContext* context = createKeyspaceContext(packet, masterCount, func);
+    ClientPacket** subs = context->subs;
+    for (int i = 0; i < masterCount; ++i) {
+        masters.at(i)->handle(subs[i]);
+    }
+}
+
+//Returns true if one of the groups failed, the first error is replied
+static bool replyFirstError(KeyspaceCommandContext* context)
+{
+    for (int i = 0; i < context->subCount; ++i) {
+        if (isErrorReply(context->subs[i])) {
+            context->packet->sendBuff.append(context->subs[i]->sendBuff);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void releaseKeyspaceContext(KeyspaceCommandContext* context)
+{
+    for (int i = 0; i < context->subCount; ++i) {
+        delete context->subs[i];
+    }
+    delete []context->subs;
+    delete context;
+}
+
+void onScriptLoadPacketFinished(ClientPacket*, void* arg)
+{
+    KeyspaceCommandContext* context = (KeyspaceCommandContext*)arg;
+    ++context->returnCount;
+    if (context->returnCount != context->subCount) {
+        return;
+    }
+
+    ClientPacket* client = context->packet;
+    if (!replyFirstError(context)) {
+        RedisProtoParseResult& reply = context->subs[0]->sendParseResult;
+        Token& body = client->recvParseResult.tokens[2];
+        if (reply.type == RedisProtoParseResult::Bulk && reply.tokens[0].len > 0) {
+            client->proxy()->addScript(reply.tokens[0].s, reply.tokens[0].len, body.s, body.len);
+        }
+        client->sendBuff.append(context->subs[0]->sendBuff);
+    }
+    client->setFinishedState(ClientPacket::RequestFinished);
+    releaseKeyspaceContext(context);
+}
+
+void onScriptFlushPacketFinished(ClientPacket*, void* arg)
+{
+    KeyspaceCommandContext* context = (KeyspaceCommandContext*)arg;
+    ++context->returnCount;
+    if (context->returnCount != context->subCount) {
+        return;
+    }
+
+    ClientPacket* client = context->packet;
+    client->proxy()->clearScripts();
+    if (!replyFirstError(context)) {
+        client->sendBuff.append("+OK\r\n");
+    }
+    client->setFinishedState(ClientPacket::RequestFinished);
+    releaseKeyspaceContext(context);
+}
+
+//A script exists only if every master has it
+void onScriptExistsPacketFinished(ClientPacket*, void* arg)
+{
+    KeyspaceCommandContext* context = (KeyspaceCommandContext*)arg;
+    ++context->returnCount;
+    if (context->returnCount != context->subCount) {
+        return;
+    }
+
+    ClientPacket* client = context->packet;
+    if (!replyFirstError(context)) {
+        int count = client->recvParseResult.tokenCount - 2;
+        client->sendBuff.appendFormatString("*%d\r\n", count);
+        for (int i = 0; i < count; ++i) {
+            int exists = 1;
+            for (int j = 0; j < context->subCount; ++j) {
+                RedisProtoParseResult& reply = context->subs[j]->sendParseResult;
+                if (reply.tokenCount <= i || reply.tokens[i].len != 1 || reply.tokens[i].s[0] != '1') {
+                    exists = 0;
+                    break;
+                }
+            }
+            client->sendBuff.appendFormatString(":%d\r\n", exists);
+        }
+    }
+    client->setFinishedState(ClientPacket::RequestFinished);
+    releaseKeyspaceContext(context);
+}
+
+void onScanPacketFinished(ClientPacket* packet, void* arg)
+{
+    ScanCommandContext* scancontext = (ScanCommandContext*)arg;
+    ClientPacket* client = scancontext->packet;
+    RedisProtoParseResult& r = packet->sendParseResult;
+    if (isErrorReply(packet)) {
+        client->sendBuff.append(packet->sendBuff);
+    } else if (r.type != RedisProtoParseResult::MultiBulk || r.tokenCount != 2 ||
+               r.tokens[0].len <= 0 || r.tokens[0].len > 20) {
+        client->sendBuff.append("-ERR backend protocol error\r\n");
+    } else {
+        char buf[32];
+        memcpy(buf, r.tokens[0].s, r.tokens[0].len);
+        buf[r.tokens[0].len] = 0;
+        unsigned long long next = strtoull(buf, NULL, 10);
+        if (next != 0) {
+            next = next * scancontext->groupCount + scancontext->groupIndex;
+        } else if (scancontext->groupIndex + 1 < scancontext->groupCount) {
+            next = scancontext->groupIndex + 1;
+        }
+        int len = sprintf(buf, "%llu", next);
+        client->sendBuff.appendFormatString("*2\r\n$%d\r\n%s\r\n", len, buf);
+        client->sendBuff.append(r.tokens[1].s, r.tokens[1].len);
+    }
+    client->setFinishedState(ClientPacket::RequestFinished);
+    delete scancontext;
+    delete packet;
+}
+
+void onKeysPacketFinished(ClientPacket*, void* arg)
+{
+    KeyspaceCommandContext* context = (KeyspaceCommandContext*)arg;
+    ++context->returnCount;
+    if (context->returnCount != context->subCount) {
+        return;
+    }
+
+    ClientPacket* client = context->packet;
+    if (!replyFirstError(context)) {
+        //The element count comes first, so the group replies are spliced
+        //behind a merged header instead of being decoded again
+        int total = 0;
+        for (int i = 0; i < context->subCount; ++i) {
+            if (context->subs[i]->sendParseResult.integer > 0) {
+                total += context->subs[i]->sendParseResult.integer;
+            }
+        }
+        client->sendBuff.appendFormatString("*%d\r\n", total);
+        for (int i = 0; i < context->subCount; ++i) {
+            IOBuffer& reply = context->subs[i]->sendBuff;
+            char* body = (char*)memchr(reply.data(), '\n', reply.size());
+            if (body != NULL && context->subs[i]->sendParseResult.integer > 0) {
+                ++body;
+                client->sendBuff.append(body, reply.size() - (body - reply.data()));
+            }
+        }
+    }
+    client->setFinishedState(ClientPacket::RequestFinished);
+    releaseKeyspaceContext(context);
+}
+
+void onDbSizePacketFinished(ClientPacket*, void* arg)
+{
+    KeyspaceCommandContext* context = (KeyspaceCommandContext*)arg;
+    ++context->returnCount;
+    if (context->returnCount != context->subCount) {
+        return;
+    }
+
+    ClientPacket* client = context->packet;
+    if (!replyFirstError(context)) {
+        //The parsed integer is an int, the count of a group may not fit
+        long long total = 0;
+        for (int i = 0; i < context->subCount; ++i) {
+            total += strtoll(context->subs[i]->sendBuff.data() + 1, NULL, 10);
+        }
+        client->sendBuff.appendFormatString(":%lld\r\n", total);
+    }
+    client->setFinishedState(ClientPacket::RequestFinished);
+    releaseKeyspaceContext(context);
+}
+
+void onRandomKeyPacketFinished(ClientPacket*, void* arg)
+{
+    KeyspaceCommandContext* context = (KeyspaceCommandContext*)arg;
+    ++context->returnCount;
+    if (context->returnCount != context->subCount) {
+        return;
+    }
+
+    ClientPacket* client = context->packet;
+    if (!replyFirstError(context)) {
+        int candidates = 0;
+        ClientPacket* choice = NULL;
+        for (int i = 0; i < context->subCount; ++i) {
+            RedisProtoParseResult& r = context->subs[i]->sendParseResult;
+            if (r.type == RedisProtoParseResult::Bulk && r.tokens[0].len >= 0) {
+                ++candidates;
+                if (rand() % candidates == 0) {
+                    choice = context->subs[i];
+                }
+            }
+        }
+        if (choice) {
+            client->sendBuff.append(choice->sendBuff);
+        } else {
+            client->sendBuff.append("$-1\r\n");
+        }
+    }
+    client->setFinishedState(ClientPacket::RequestFinished);
+    releaseKeyspaceContext(context);
+}
+
+//The cursor given to the client is backendCursor * groupCount + groupIndex,
+//groups are scanned one after another
+void onScanCommand(ClientPacket* packet, void*)
+{
+    RedisProtoParseResult& r = packet->recvParseResult;
+    if (r.tokenCount < 2) {
+        packet->setFinishedState(ClientPacket::WrongNumberOfArguments);
+        return;
+    }
+
+    RedisProxy* proxy = packet->proxy();
+    int groupCount = proxy->groupCount();
+    char buf[32];
+    Token& cursorToken = r.tokens[1];
+    bool validCursor = (groupCount > 0 && cursorToken.len > 0 && cursorToken.len <= 20);
+    for (int i = 0; validCursor && i < cursorToken.len; ++i) {
+        validCursor = (cursorToken.s[i] >= '0' && cursorToken.s[i] <= '9');
+    }
+    if (!validCursor) {
+        packet->sendBuff.append("-ERR invalid cursor\r\n");
+        packet->setFinishedState(ClientPacket::RequestFinished);
+        return;
+    }
+    memcpy(buf, cursorToken.s, cursorToken.len);
+    buf[cursorToken.len] = 0;
+    unsigned long long cursor = strtoull(buf, NULL, 10);
+
+    ScanCommandContext* scancontext = new ScanCommandContext;
+    scancontext->groupIndex = cursor % groupCount;
+    scancontext->groupCount = groupCount;
+    scancontext->packet = packet;
+
+    int len = sprintf(buf, "%llu", cursor / groupCount);
+    ClientPacket* scan = new ClientPacket;
+    scan->eventLoop = packet->eventLoop;
+    scan->commandType = RedisCommand::SCAN;
+    scan->finished_func = onScanPacketFinished;
+    scan->finished_arg = scancontext;
+    scan->recvBuff.appendFormatString("*%d\r\n$4\r\nSCAN\r\n$%d\r\n%s\r\n", r.tokenCount, len, buf);
+    for (int i = 2; i < r.tokenCount; ++i) {
+        scan->recvBuff.appendFormatString("$%d\r\n", r.tokens[i].len);
+        scan->recvBuff.append(r.tokens[i].s, r.tokens[i].len);
+        scan->recvBuff.append("\r\n");
+    }
+    scan->continueToParseRecvBuffer();
+    proxy->handleGroupPacket(proxy->group(scancontext->groupIndex), scan);
+}
+
+void onKeysCommand(ClientPacket* packet, void*)
+{
+    if (packet->recvParseResult.tokenCount != 2) {
+        packet->setFinishedState(ClientPacket::WrongNumberOfArguments);
+        return;
+    }
+    broadcastToGroups(packet, onKeysPacketFinished);
+}
+
+void onDbSizeCommand(ClientPacket* packet, void*)
+{
+    broadcastToGroups(packet, onDbSizePacketFinished);
+}
+
+void onRandomKeyCommand(ClientPacket* packet, void*)
+{
+    broadcastToGroups(packet, onRandomKeyPacketFinished);
+}
+
+static TransactionContext* transactionOf(ClientPacket* packet)
+{
+    if (!packet->transaction) {
+        TransactionContext* t = new TransactionContext;
+        t->multi = false;
+        t->aborted = false;
+        t->commandCount = 0;
+        t->group = NULL;
+        t->servant = NULL;
+        t->redisSocket = NULL;
+        packet->transaction = t;
+    }
+    return packet->transaction;
+}
+
+//Release the pinned connection. It is closed when it may still hold
+//WATCH or MULTI state
+static void releaseTransaction(ClientPacket* packet, bool dirty)
+{
+    TransactionContext* t = packet->transaction;
+    if (t) {
+        if (t->redisSocket) {
+            t->servant->unpinConnection(t->redisSocket, dirty);
+        }
+        delete t;
+        packet->transaction = NULL;
+    }
+}
+
+void discardTransaction(ClientPacket* packet)
+{
+    releaseTransaction(packet, true);
+}
+
+//Transactions always run on one connection of one servant
+static bool selectTransactionServant(ClientPacket* packet, TransactionContext* t)
+{
+    if (!t->servant && t->group) {
+        t->servant = t->group->findUsableServant(packet);
+    }
+    return (t->servant != NULL);
+}
+
+//The first request of the transaction takes a connection like any other
+//request, it waits in the queue of the servant when the pool is
+//exhausted. The connection is kept by the transaction afterwards
+static void sendTransactionPacket(TransactionContext* t, ClientPacket* request)
+{
+    request->keepRedisSocket = true;
+    if (t->redisSocket) {
+        t->servant->handle(request, t->redisSocket);
+    } else {
+        t->servant->handle(request);
+    }
+}
+
+//Keys of the request, false if the command has no usable key
+static bool transactionKeys(RedisCommand* command, RedisProtoParseResult& r, int* first, int* step)
+{
+    if (command->proc == onStandardKeyCommand) {
+        *first = 1;
+        *step = r.tokenCount;
+    } else if (command->proc == onMGetCommand || command->proc == onDelCommand) {
+        *first = 1;
+        *step = 1;
+    } else if (command->proc == onMSetCommand) {
+        *first = 1;
+        *step = 2;
+    } else {
+        return false;
+    }
+    return (r.tokenCount > 1);
+}
+
+bool isTransactionQueuing(ClientPacket* packet, RedisCommand* command)
+{
+    if (!packet->transaction || !packet->transaction->multi) {
+        return false;
+    }
+    switch (command->type) {
+    case RedisCommand::MULTI:
+    case RedisCommand::EXEC:
+    case RedisCommand::DISCARD:
+    case RedisCommand::WATCH:
+        return false;
+    default:
+        return true;
+    }
+}
+
+void onQueueTransactionCommand(ClientPacket* packet, RedisCommand* command)
+{
+    TransactionContext* t = packet->transaction;
+    RedisProtoParseResult& r = packet->recvParseResult;
+    RedisProxy* proxy = packet->proxy();
+
+    if (command->type != RedisCommand::UNWATCH) {
+        int first = 0;
+        int step = 0;
+        if (!transactionKeys(command, r, &first, &step)) {
+            t->aborted = true;
+            packet->sendBuff.appendFormatString("-ERR '%s' is not allowed in transaction\r\n", command->name);
+            packet->setFinishedState(ClientPacket::RequestFinished);
+            return;
+        }
+        for (int i = first; i < r.tokenCount; i += step) {
+            RedisServantGroup* group = proxy->mapToGroup(r.tokens[i].s, r.tokens[i].len);
+            if (!group || (t->group && group != t->group)) {
+                t->aborted = true;
+                packet->sendBuff.append("-ERR keys in transaction must map to the same group\r\n");
+                packet->setFinishedState(ClientPacket::RequestFinished);
+                return;
+            }
+            t->group = group;
+            if (!HotKeyCache::isReadOnly(command->type)) {
+                t->writtenKeys.push_back(std::string(r.tokens[i].s, r.tokens[i].len));
+            }
+        }
+    }
+
+    t->commands.append(r.protoBuff, r.protoBuffLen);
+    t->commandTypes.push_back(command->type);
+    ++t->commandCount;
+    packet->sendBuff.append("+QUEUED\r\n");
+    packet->setFinishedState(ClientPacket::RequestFinished);
+}
+
+void onMultiCommand(ClientPacket* packet, void*)
+{
+    TransactionContext* t = transactionOf(packet);
+    if (t->multi) {
+        packet->sendBuff.append("-ERR MULTI calls can not be nested\r\n");
+    } else {
+        t->multi = true;
+        packet->sendBuff.append("+OK\r\n");
+    }
+    packet->setFinishedState(ClientPacket::RequestFinished);
+}
+
+static void invalidateWrittenKeys(ClientPacket* packet, TransactionContext* t)
+{
+    HotKeyCache* cache = packet->proxy()->hotKeyCache();
+    if (cache->isEnabled()) {
+        for (size_t i = 0; i < t->writtenKeys.size(); ++i) {
+            cache->invalidate(t->writtenKeys[i].data(), t->writtenKeys[i].size());
+        }
+    }
+}
+
+//The values of a compressed group are read compressed inside a
+//transaction too. The replies of the reading commands are copied one by
+//one and decompressed like the reply of a single request
+static void appendExecReply(ClientPacket* packet, TransactionContext* t, char* data, int size)
+{
+    IOBuffer& sendbuf = packet->sendBuff;
+    bool decompress = false;
+    if (t->group->compressThreshold() > 0 && data[0] == '*') {
+        for (size_t i = 0; i < t->commandTypes.size(); ++i) {
+            if (ValueCompressor::isDecompressible(t->commandTypes[i])) {
+                decompress = true;
+                break;
+            }
+        }
+    }
+    if (!decompress) {
+        sendbuf.append(data, size);
+        return;
+    }
+
+    int begin = sendbuf.size();
+    char* p = data;
+    while (*p != '\n') {
+        ++p;
+    }
+    ++p;
+    sendbuf.append(data, p - data);
+    RedisProtoParseResult elem;
+    for (size_t i = 0; i < t->commandTypes.size() && p < data + size; ++i) {
+        elem.reset();
+        if (RedisProto::parse(p, data + size - p, &elem) != RedisProto::ProtoOK) {
+            break;
+        }
+        int offset = sendbuf.size();
+        sendbuf.append(p, elem.protoBuffLen);
+        if (ValueCompressor::isDecompressible(t->commandTypes[i])) {
+            ValueCompressor::decompressReply(packet, offset);
+        }
+        p += elem.protoBuffLen;
+    }
+
+    //A reply which doesn't match the queued commands goes out unchanged
+    if (p != data + size) {
+        sendbuf.truncate(begin);
+        sendbuf.append(data, size);
+    }
+}
+
+void onExecPacketFinished(ClientPacket* exec, void* arg)
+{
+    ClientPacket* packet = (ClientPacket*)arg;
+    TransactionContext* t = packet->transaction;
+    t->redisSocket = exec->redisSocket;
+    invalidateWrittenKeys(packet, t);
+
+    //Only the EXEC reply goes to the client. The burst completed when
+    //every reply was parsed and nothing was appended behind them
+    bool completed = (exec->redisReplyCount == 1 && exec->redisSocket &&
+                      exec->sendBufferParsedOffset == exec->sendBuff.size());
+    if (completed) {
+        RedisProtoParseResult& r = exec->sendParseResult;
+        appendExecReply(packet, t, exec->sendBuff.data() + exec->sendBufferParsedOffset - r.protoBuffLen,
+                        r.protoBuffLen);
+    } else {
+        packet->sendBuff.append("-ERR transaction aborted by backend error\r\n");
+    }
+    releaseTransaction(packet, !completed);
+    packet->setFinishedState(ClientPacket::RequestFinished);
+    delete exec;
+}
+
+void onExecCommand(ClientPacket* packet, void*)
+{
+    TransactionContext* t = packet->transaction;
+    if (!t || !t->multi) {
+        packet->sendBuff.append("-ERR EXEC without MULTI\r\n");
+        packet->setFinishedState(ClientPacket::RequestFinished);
+        return;
+    }
+    if (t->aborted) {
+        releaseTransaction(packet, true);
+        packet->sendBuff.append("-EXECABORT Transaction discarded because of previous errors.\r\n");
+        packet->setFinishedState(ClientPacket::RequestFinished);
+        return;
+    }
+    if (t->commandCount == 0 && !t->redisSocket) {
+        releaseTransaction(packet, false);
+        packet->sendBuff.append("*0\r\n");
+        packet->setFinishedState(ClientPacket::RequestFinished);
+        return;
+    }
+    if (!selectTransactionServant(packet, t)) {
+        releaseTransaction(packet, true);
+        packet->sendBuff.append("-ERR backend is not available\r\n");
+        packet->setFinishedState(ClientPacket::RequestFinished);
+        return;
+    }
+
+    //MULTI, the queued commands and EXEC go out as one burst
+    ClientPacket* exec = new ClientPacket;
+    exec->eventLoop = packet->eventLoop;
+    exec->commandType = RedisCommand::EXEC;
+    exec->finished_func = onExecPacketFinished;
+    exec->finished_arg = packet;
+    exec->redisReplyCount = t->commandCount + 2;
+    exec->recvBuff.append("*1\r\n$5\r\nMULTI\r\n");
+    exec->recvBuff.append(t->commands);
+    exec->recvBuff.append("*1\r\n$4\r\nEXEC\r\n");
+    exec->recvParseResult.protoBuff = exec->recvBuff.data();
+    exec->recvParseResult.protoBuffLen = exec->recvBuff.size();
+    invalidateWrittenKeys(packet, t);
+    sendTransactionPacket(t, exec);
+}
+
+void onDiscardCommand(ClientPacket* packet, void*)
+{
+    TransactionContext* t = packet->transaction;
+    if (!t || !t->multi) {
+        packet->sendBuff.append("-ERR DISCARD without MULTI\r\n");
+    } else {
+        releaseTransaction(packet, true);
+        packet->sendBuff.append("+OK\r\n");
+    }
+    packet->setFinishedState(ClientPacket::RequestFinished);
+}
+
+void onWatchPacketFinished(ClientPacket* watch, void* arg)
+{
+    ClientPacket* packet = (ClientPacket*)arg;
+    packet->transaction->redisSocket = watch->redisSocket;
+    if (watch->redisSocket) {
+        packet->sendBuff.append(watch->sendBuff);
+    } else {
+        releaseTransaction(packet, true);
+        packet->sendBuff.append("-ERR backend connection invalid\r\n");
+    }
+    packet->setFinishedState(ClientPacket::RequestFinished);
+    delete watch;
+}
+
+void onWatchCommand(ClientPacket* packet, void*)
+{
+    RedisProtoParseResult& r = packet->recvParseResult;
+    if (r.tokenCount < 2) {
+        packet->setFinishedState(ClientPacket::WrongNumberOfArguments);
+        return;
+    }
+
+    TransactionContext* t = transactionOf(packet);
+    if (t->multi) {
+        packet->sendBuff.append("-ERR WATCH inside MULTI is not allowed\r\n");
+        packet->setFinishedState(ClientPacket::RequestFinished);
+        return;
+    }
+
+    RedisProxy* proxy = packet->proxy();
+    RedisServantGroup* group = t->group;
+    for (int i = 1; i < r.tokenCount; ++i) {
+        RedisServantGroup* keyGroup = proxy->mapToGroup(r.tokens[i].s, r.tokens[i].len);
+        if (!keyGroup || (group && keyGroup != group)) {
+            packet->sendBuff.append("-ERR keys in transaction must map to the same group\r\n");
+            packet->setFinishedState(ClientPacket::RequestFinished);
+            return;
+        }
+        group = keyGroup;
+    }
+    t->group = group;
+
+    if (!selectTransactionServant(packet, t)) {
+        releaseTransaction(packet, false);
+        packet->sendBuff.append("-ERR backend is not available\r\n");
+        packet->setFinishedState(ClientPacket::RequestFinished);
+        return;
+    }
+
+    ClientPacket* watch = new ClientPacket;
+    watch->eventLoop = packet->eventLoop;
+    watch->commandType = RedisCommand::WATCH;
+    watch->finished_func = onWatchPacketFinished;
+    watch->finished_arg = packet;
+    watch->recvBuff.append(r.protoBuff, r.protoBuffLen);
+    watch->continueToParseRecvBuffer();
+    sendTransactionPacket(t, watch);
+}
+
+void onUnwatchCommand(ClientPacket* packet, void*)
+{
+    //Closing the pinned connection drops every watched key
+    releaseTransaction(packet, true);
+    packet->sendBuff.append("+OK\r\n");
+    packet->setFinishedState(ClientPacket::RequestFinished);
+}
+
+void onEvalRetryFinished(ClientPacket* eval, void* arg)
+{
+    ClientPacket* packet = (ClientPacket*)arg;
+    packet->sendBuff.append(eval->sendBuff);
+    packet->setFinishedState(ClientPacket::RequestFinished);
+    delete eval;
+}
+
+//A backend without the script replies NOSCRIPT. If the proxy knows the
+//script, the request is sent again to the same backend as EVAL
+void onEvalShaFinished(ClientPacket* packet, void* arg)
+{
+    packet->finished_func = ClientPacket::defaultFinishedHandler;
+
+    RedisProtoParseResult& r = packet->recvParseResult;
+    RedisProtoParseResult& reply = packet->sendParseResult;
+    std::string body;
+    if (packet->finishedState == ClientPacket::RequestFinished &&
+        packet->requestServant != NULL &&
+        reply.type == RedisProtoParseResult::Error &&
+        packet->sendBufferParsedOffset == packet->sendBuff.size() &&
+        reply.tokens[0].len >= 8 && strncmp(reply.tokens[0].s, "NOSCRIPT", 8) == 0 &&
+        packet->proxy()->findScript(r.tokens[1].s, r.tokens[1].len, body))
+    {
+        packet->sendBufferParsedOffset -= reply.protoBuffLen;
+        packet->sendBuff.truncate(packet->sendBufferParsedOffset);
+
+        ClientPacket* eval = new ClientPacket;
+        eval->eventLoop = packet->eventLoop;
+        eval->commandType = RedisCommand::EVAL;
+        eval->finished_func = onEvalRetryFinished;
+        eval->finished_arg = packet;
+        eval->recvBuff.appendFormatString("*%d\r\n$4\r\nEVAL\r\n$%d\r\n", r.tokenCount, (int)body.size());
+        eval->recvBuff.append(body.data(), body.size());
+        eval->recvBuff.append("\r\n");
+        for (int i = 2; i < r.tokenCount; ++i) {
+            eval->recvBuff.appendFormatString("$%d\r\n", r.tokens[i].len);
+            eval->recvBuff.append(r.tokens[i].s, r.tokens[i].len);
+            eval->recvBuff.append("\r\n");
+        }
+        eval->continueToParseRecvBuffer();
+        packet->requestServant->handle(eval);
+        return;
+    }
+    if (packet->finishedState == ClientPacket::RequestFinished &&
+        reply.type != RedisProtoParseResult::Error)
+    {
+        packet->proxy()->touchScript(r.tokens[1].s, r.tokens[1].len);
+    }
+    ClientPacket::defaultFinishedHandler(packet, arg);
+}
+
+//A script which ran is registered like SCRIPT LOAD does, under the SHA1
+//of its body, so a later EVALSHA can be replayed on another backend
+void onEvalFinished(ClientPacket* packet, void* arg)
+{
+    packet->finished_func = ClientPacket::defaultFinishedHandler;
+
+    RedisProtoParseResult& r = packet->recvParseResult;
+    if (packet->finishedState == ClientPacket::RequestFinished &&
+        packet->requestServant != NULL &&
+        packet->sendParseResult.type != RedisProtoParseResult::Error)
+    {
+        static const char hex[] = "0123456789abcdef";
+        unsigned char digest[20];
+        char sha[40];
+        sha1_signature((const unsigned char*)r.tokens[1].s, r.tokens[1].len, digest);
+        for (int i = 0; i < 20; ++i) {
+            sha[i * 2] = hex[digest[i] >> 4];
+            sha[i * 2 + 1] = hex[digest[i] & 0xf];
+        }
+        packet->proxy()->addScript(sha, sizeof(sha), r.tokens[1].s, r.tokens[1].len);
+    }
+    ClientPacket::defaultFinishedHandler(packet, arg);
+}
+
+//EVAL script numkeys key [key ...] arg [arg ...]
+//The keys are used for routing, all of them must map to the same group
+void onEvalCommand(ClientPacket* packet, void*)
+{
+    RedisProtoParseResult& r = packet->recvParseResult;
+    if (r.tokenCount < 3) {
+        packet->setFinishedState(ClientPacket::WrongNumberOfArguments);
+        return;
+    }
+
+    char buf[32] = {0};
+    strncpy(buf, r.tokens[2].s, r.tokens[2].len < 31 ? r.tokens[2].len : 31);
+    int numkeys = atoi(buf);
+    if (numkeys <= 0) {
+        packet->sendBuff.append("-ERR scripts without keys can not be routed\r\n");
+        packet->setFinishedState(ClientPacket::RequestFinished);
+        return;
+    }
+    if (numkeys > r.tokenCount - 3) {
+        packet->sendBuff.append("-ERR Number of keys can't be greater than number of args\r\n");
+        packet->setFinishedState(ClientPacket::RequestFinished);
+        return;
+    }
+
+    RedisProxy* proxy = packet->proxy();
+    RedisServantGroup* group = NULL;
+    for (int i = 3; i < 3 + numkeys; ++i) {
+        RedisServantGroup* keyGroup = proxy->mapToGroup(r.tokens[i].s, r.tokens[i].len);
+        if (!keyGroup || (group && keyGroup != group)) {
+            packet->sendBuff.append("-ERR keys in script must map to the same group\r\n");
+            packet->setFinishedState(ClientPacket::RequestFinished);
+            return;
+        }
+        group = keyGroup;
+    }
+
+    //Scripts may write any of their keys
+    HotKeyCache* cache = proxy->hotKeyCache();
+    if (cache->isEnabled()) {
+        for (int i = 3; i < 3 + numkeys; ++i) {
+            cache->invalidate(r.tokens[i].s, r.tokens[i].len);
+        }
+    }
+
+    if (packet->commandType == RedisCommand::EVALSHA) {
+        packet->finished_func = onEvalShaFinished;
+    } else {
+        packet->finished_func = onEvalFinished;
+    }
+    proxy->handleGroupPacket(group, packet);
+}
+
+//SCRIPT LOAD/FLUSH/EXISTS are sent to every master
+void onScriptCommand(ClientPacket* packet, void*)
+{
+    RedisProtoParseResult& r = packet->recvParseResult;
+    if (r.tokenCount < 2) {
+        packet->setFinishedState(ClientPacket::WrongNumberOfArguments);
+        return;
+    }
+
+    Token& sub = r.tokens[1];
+    if (sub.len == 4 && strncasecmp(sub.s, "LOAD", 4) == 0) {
+        if (r.tokenCount != 3) {
+            packet->setFinishedState(ClientPacket::WrongNumberOfArguments);
+            return;
+        }
+        broadcastToMasters(packet, onScriptLoadPacketFinished);
+    } else if (sub.len == 5 && strncasecmp(sub.s, "FLUSH", 5) == 0) {
+        broadcastToMasters(packet, onScriptFlushPacketFinished);
+    } else if (sub.len == 6 && strncasecmp(sub.s, "EXISTS", 6) == 0) {
+        if (r.tokenCount < 3) {
+            packet->setFinishedState(ClientPacket::WrongNumberOfArguments);
+            return;
+        }
+        broadcastToMasters(packet, onScriptExistsPacketFinished);
+    } else {
+        packet->sendBuff.append("-ERR only SCRIPT LOAD, FLUSH and EXISTS are supported\r\n");
+        packet->setFinishedState(ClientPacket::RequestFinished);
+    }
+}
+
+static void appendSubscribeReply(IOBuffer& reply, const char* kind, const char* channel, int len, int count)
+{
+    reply.appendFormatString("*3\r\n$%d\r\n%s\r\n", (int)strlen(kind), kind);
+    if (channel) {
+        reply.appendFormatString("$%d\r\n", len);
+        reply.append(channel, len);
+        reply.append("\r\n", 2);
+    } else {
+        reply.append("$-1\r\n");
+    }
+    reply.appendFormatString(":%d\r\n", count);
+}
+
+//The channel is mapped to a group like a key, so PUBLISH and SUBSCRIBE
+//of a channel meet on the same redis
+void onSubscribeCommand(ClientPacket* packet, void*)
+{
+    RedisProtoParseResult& r = packet->recvParseResult;
+    if (r.tokenCount < 2) {
+        packet->setFinishedState(ClientPacket::WrongNumberOfArguments);
+        return;
+    }
+
+    RedisProxy* proxy = packet->proxy();
+    for (int i = 1; i < r.tokenCount; ++i) {
+        Token& channel = r.tokens[i];
+        RedisServantGroup* group = proxy->mapToGroup(channel.s, channel.len);
+        int count = -1;
+        if (group) {
+            count = proxy->pubsub()->subscribe(packet, group, channel.s, channel.len);
+        }
+        if (count < 0) {
+            packet->sendBuff.append("-ERR backend is not available\r\n");
+        } else {
+            appendSubscribeReply(packet->sendBuff, "subscribe", channel.s, channel.len, count);
+        }
+    }
+    packet->setFinishedState(ClientPacket::RequestFinished);
+}
+
+void onUnsubscribeCommand(ClientPacket* packet, void*)
+{
+    RedisProtoParseResult& r = packet->recvParseResult;
+    PubSub* pubsub = packet->proxy()->pubsub();
+    if (r.tokenCount > 1) {
+        for (int i = 1; i < r.tokenCount; ++i) {
+            Token& channel = r.tokens[i];
+            int count = pubsub->unsubscribe(packet, channel.s, channel.len);
+            appendSubscribeReply(packet->sendBuff, "unsubscribe", channel.s, channel.len, count);
+        }
+    } else if (packet->subscriber && !packet->subscriber->channels.empty()) {
+        std::vector<std::string> channels;
+        std::map<std::string, PubSubUpstream*>::iterator it = packet->subscriber->channels.begin();
+        for (; it != packet->subscriber->channels.end(); ++it) {
+            channels.push_back(it->first);
+        }
+        for (size_t i = 0; i < channels.size(); ++i) {
+            const std::string& channel = channels[i];
+            int count = pubsub->unsubscribe(packet, channel.data(), channel.size());
+            appendSubscribeReply(packet->sendBuff, "unsubscribe", channel.data(), channel.size(), count);
+        }
+    } else {
+        appendSubscribeReply(packet->sendBuff, "unsubscribe", NULL, 0, 0);
+    }
+    packet->setFinishedState(ClientPacket::RequestFinished);
+}
+
+bool isSubscribedModeRejected(ClientPacket* packet, RedisCommand* command)
+{
+    if (!packet->subscriber || packet->subscriber->channels.empty()) {
+        return false;
+    }
+    switch (command->type) {
+    case RedisCommand::SUBSCRIBE:
+    case RedisCommand::UNSUBSCRIBE:
+        return false;
+    default:
+        return true;
+    }
+}
+
+void onSubscribedModeCommand(ClientPacket* packet, RedisCommand* command)
+{
+    if (command->type == RedisCommand::PING) {
+        packet->sendBuff.append("*2\r\n$4\r\npong\r\n$0\r\n\r\n");
+    } else {
+        packet->sendBuff.append("-ERR only SUBSCRIBE, UNSUBSCRIBE and PING are allowed in this context\r\n");
+    }
+    packet->setFinishedState(ClientPacket::RequestFinished);
+}
+
 void onPingCommand(ClientPacket* packet, void*)
 {
     packet->sendBuff.append("+PONG\r\n");
@@ -291,6 +1298,34 @@ void onAddKeyMapping(ClientPacket* packet, void*)
 
     char groupName[1024] = {0};
     strncpy(groupName, request.tokens[1].s, request.tokens[1].len);
+
+    //A list of groups, the keys are copied to each of them
+    if (strchr(groupName, ',') != NULL) {
+        std::vector<RedisServantGroup*> groups;
+        char* saveptr = NULL;
+        for (char* name = strtok_r(groupName, ",", &saveptr); name != NULL;
+             name = strtok_r(NULL, ",", &saveptr)) {
+            RedisServantGroup* g = proxy->group(name);
+            if (!g) {
+                packet->sendBuff.append("-Group is not exists\r\n");
+                packet->setFinishedState(ClientPacket::RequestFinished);
+                return;
+            }
+            groups.push_back(g);
+        }
+        for (int i = 2; i < request.tokenCount; ++i) {
+            if (!proxy->hotKeyReplicas()->add(request.tokens[i].s, request.tokens[i].len,
+                                              groups, false, packet->eventLoop)) {
+                packet->sendBuff.append("-Key needs two groups at least\r\n");
+                packet->setFinishedState(ClientPacket::RequestFinished);
+                return;
+            }
+        }
+        packet->sendBuff.append("+OK\r\n");
+        packet->setFinishedState(ClientPacket::RequestFinished);
+        return;
+    }
+
     RedisServantGroup* group = proxy->group(groupName);
     if (!group) {
         packet->sendBuff.append("-Group is not exists\r\n");
@@ -323,6 +1358,7 @@ void onDelKeyMapping(ClientPacket* packet, void*)
         const char* key = request.tokens[i].s;
         int keyLen = request.tokens[i].len;
         proxy->removeGroupKeyMapping(key, keyLen);
+        proxy->hotKeyReplicas()->remove(key, keyLen, packet->eventLoop);
     }
 
     packet->sendBuff.append("+OK\r\n");
@@ -361,43 +1397,317 @@ void onShowMapping(ClientPacket* packet, void*)
         packet->sendBuff.append("\n");
     }
 
+    std::vector<HotKeyReplicas::KeyInfo> replicas = proxy->hotKeyReplicas()->keys();
+    if (!replicas.empty()) {
+        packet->sendBuff.append("\n");
+        packet->sendBuff.append("[HOT KEY REPLICAS]\n");
+        packet->sendBuff.appendFormatString("%-20s %-30s %-8s %-7s %-12s %-12s\n",
+                                            "KEY", "GROUPS", "STATE", "MODE", "READS", "WRITES");
+        for (size_t i = 0; i < replicas.size(); ++i) {
+            HotKeyReplicas::KeyInfo& info = replicas[i];
+            std::string groups;
+            for (size_t j = 0; j < info.groups.size(); ++j) {
+                if (j > 0) {
+                    groups += ",";
+                }
+                groups += info.groups[j]->groupName();
+            }
+            packet->sendBuff.appendFormatString("%-20s %-30s %-8s %-7s %-12lld %-12lld\n",
+                                                info.key.c_str(), groups.c_str(),
+                                                info.ready ? "ready" : "copying",
+                                                info.automatic ? "auto" : "manual",
+                                                info.reads, info.writes);
+        }
+    }
+
     packet->sendBuff.append("\n\r\n");
     packet->setFinishedState(ClientPacket::RequestFinished);
 }
 
+//A unix socket backend is shown by its path, which does not fit the
+//buffers sized for ip:port
+static void formatServantAddress(char* buf, int size, const HostAddress& addr)
+{
+    if (addr.isUnix()) {
+        snprintf(buf, size, "%s", addr.path());
+    } else {
+        snprintf(buf, size, "%s:%d", addr.ip(), addr.port());
+    }
+}
+
 void onPoolInfo(ClientPacket* packet, void*)
 {
     RedisProxy* proxy = packet->proxy();
     IOBuffer& sendbuf = packet->sendBuff;
     sendbuf.append("+", 1);
-    sendbuf.appendFormatString("%-10s %-20s %-8s %-10s %-12s\n",
-                               "GROUP", "HOST", "ACTIVE", "UNACTIVE", "POOLSIZE");
+    sendbuf.appendFormatString("%-10s %-20s %-8s %-10s %-12s %-10s %-10s %-10s %-12s %-10s %-10s %-10s\n",
+                               "GROUP", "HOST", "ACTIVE", "UNACTIVE", "POOLSIZE", "BOUNDS", "RESIZED",
+                               "BLOCKING", "LATENCY(us)", "INFLIGHT", "BUSY", "CIRCUIT");
     for (int i = 0; i < proxy->groupCount(); ++i) {
         RedisServantGroup* group = proxy->group(i);
         for (int m = 0; m < group->masterCount(); ++m) {
             RedisServant* servant = group->master(m);
             RedisConnectionPool* pool = servant->connectionPool();
-            char buf[64];
-            sprintf(buf, "%s:%d", servant->redisAddress().ip(), servant->redisAddress().port());
-            sendbuf.appendFormatString("%-10s %-20s %-8d %-10d %-12d\n",
+            RedisConnectionPool* blocking = servant->blockingConnectionPool();
+            char buf[HostAddress::MaxPathLength + 16];
+            char lane[32];
+            char bounds[32];
+            char resized[32];
+            formatServantAddress(buf, sizeof(buf), servant->redisAddress());
+            sprintf(lane, "%d/%d", blocking->activeConnectionNums(), blocking->capacity());
+            sprintf(bounds, "%d-%d", pool->minCapacity(), pool->maxCapacity());
+            sprintf(resized, "+%d/-%d", servant->poolGrows(), servant->poolShrinks());
+            sendbuf.appendFormatString("%-10s %-20s %-8d %-10d %-12d %-10s %-10s %-10s %-12d %-10d %-10lld %-10s\n",
                                        group->groupName(),
                                        buf,
                                        pool->activeConnectionNums(),
                                        pool->unActiveConnectionNums(),
-                                       pool->capacity());
+                                       pool->capacity(),
+                                       bounds,
+                                       resized,
+                                       lane,
+                                       (int)servant->latency(),
+                                       servant->inFlight(),
+                                       servant->rejectedRequests(),
+                                       CircuitBreaker::stateName(servant->circuitBreaker()->state()));
         }
         for (int s = 0; s < group->slaveCount(); ++s) {
             RedisServant* servant = group->slave(s);
             RedisConnectionPool* pool = servant->connectionPool();
-            char buf[64];
-            sprintf(buf, "%s:%d", servant->redisAddress().ip(), servant->redisAddress().port());
-            sendbuf.appendFormatString("%-10s %-20s %-8d %-10d %-12d\n",
+            RedisConnectionPool* blocking = servant->blockingConnectionPool();
+            char buf[HostAddress::MaxPathLength + 16];
+            char lane[32];
+            char bounds[32];
+            char resized[32];
+            formatServantAddress(buf, sizeof(buf), servant->redisAddress());
+            sprintf(lane, "%d/%d", blocking->activeConnectionNums(), blocking->capacity());
+            sprintf(bounds, "%d-%d", pool->minCapacity(), pool->maxCapacity());
+            sprintf(resized, "+%d/-%d", servant->poolGrows(), servant->poolShrinks());
+            sendbuf.appendFormatString("%-10s %-20s %-8d %-10d %-12d %-10s %-10s %-10s %-12d %-10d %-10lld %-10s\n",
                                        group->groupName(),
                                        buf,
                                        pool->activeConnectionNums(),
                                        pool->unActiveConnectionNums(),
-                                       pool->capacity());
+                                       pool->capacity(),
+                                       bounds,
+                                       resized,
+                                       lane,
+                                       (int)servant->latency(),
+                                       servant->inFlight(),
+                                       servant->rejectedRequests(),
+                                       CircuitBreaker::stateName(servant->circuitBreaker()->state()));
+        }
+    }
+    sendbuf.append("\r\n", 2);
+    packet->setFinishedState(ClientPacket::RequestFinished);
+}
+
+//HOTKEYCACHE [CLEAR]
+void onHotKeyCache(ClientPacket* packet, void*)
+{
+    RedisProtoParseResult& r = packet->recvParseResult;
+    HotKeyCache* cache = packet->proxy()->hotKeyCache();
+    if (r.tokenCount == 2 && r.tokens[1].len == 5 && strncasecmp(r.tokens[1].s, "CLEAR", 5) == 0) {
+        cache->clear();
+        packet->sendBuff.append("+OK\r\n");
+        packet->setFinishedState(ClientPacket::RequestFinished);
+        return;
+    }
+    if (r.tokenCount != 1) {
+        packet->setFinishedState(ClientPacket::WrongNumberOfArguments);
+        return;
+    }
+
+    HotKeyCache::Option opt = cache->option();
+    HotKeyCache::Stats stats = cache->stats();
+    HotKeyCache::Stats negative = cache->negativeStats();
+    long long reads = stats.hits + stats.misses;
+    long long negativeReads = negative.hits + negative.misses;
+    IOBuffer& sendbuf = packet->sendBuff;
+    sendbuf.append("+", 1);
+    sendbuf.appendFormatString("enabled:%d\n", cache->isEnabled() ? 1 : 0);
+    sendbuf.appendFormatString("ttl:%d\n", opt.ttl);
+    sendbuf.appendFormatString("max_memory:%lld\n", opt.maxMemory);
+    sendbuf.appendFormatString("admit_hits:%d\n", opt.admitHits);
+    sendbuf.appendFormatString("tracking:%d\n", opt.tracking ? 1 : 0);
+    sendbuf.appendFormatString("tracking_connections:%d\n", cache->trackingCount());
+    sendbuf.appendFormatString("tracking_down:%d\n", cache->trackingDownCount());
+    sendbuf.appendFormatString("entries:%d\n", stats.entries);
+    sendbuf.appendFormatString("memory:%lld\n", stats.memory);
+    sendbuf.appendFormatString("hits:%lld\n", stats.hits);
+    sendbuf.appendFormatString("misses:%lld\n", stats.misses);
+    sendbuf.appendFormatString("hit_ratio:%.2f%%\n", reads ? stats.hits * 100.0 / reads : 0.0);
+    sendbuf.appendFormatString("admitted:%lld\n", stats.admitted);
+    sendbuf.appendFormatString("rejected:%lld\n", stats.rejected);
+    sendbuf.appendFormatString("evicted:%lld\n", stats.evicted);
+    sendbuf.appendFormatString("expired:%lld\n", stats.expired);
+    sendbuf.appendFormatString("invalidated:%lld\n", stats.invalidated);
+    sendbuf.appendFormatString("negative_ttl:%d\n", opt.negativeTtl);
+    sendbuf.appendFormatString("negative_max_memory:%lld\n", opt.negativeMaxMemory);
+    sendbuf.appendFormatString("negative_entries:%d\n", negative.entries);
+    sendbuf.appendFormatString("negative_memory:%lld\n", negative.memory);
+    sendbuf.appendFormatString("negative_hits:%lld\n", negative.hits);
+    sendbuf.appendFormatString("negative_misses:%lld\n", negative.misses);
+    sendbuf.appendFormatString("negative_hit_ratio:%.2f%%\n",
+                               negativeReads ? negative.hits * 100.0 / negativeReads : 0.0);
+    sendbuf.appendFormatString("negative_admitted:%lld\n", negative.admitted);
+    sendbuf.appendFormatString("negative_rejected:%lld\n", negative.rejected);
+    sendbuf.appendFormatString("negative_evicted:%lld\n", negative.evicted);
+    sendbuf.appendFormatString("negative_expired:%lld\n", negative.expired);
+    sendbuf.appendFormatString("negative_invalidated:%lld\n", negative.invalidated);
+    sendbuf.append("\r\n", 2);
+    packet->setFinishedState(ClientPacket::RequestFinished);
+}
+
+static void appendSingleFlightRow(IOBuffer& sendbuf, RedisServantGroup* group, RedisServant* servant)
+{
+    char buf[HostAddress::MaxPathLength + 16];
+    long long requests = servant->flightRequests();
+    long long coalesced = servant->flightCoalesced();
+    long long total = requests + coalesced;
+    formatServantAddress(buf, sizeof(buf), servant->redisAddress());
+    sendbuf.appendFormatString("%-10s %-20s %-10d %-12lld %-12lld %.2f%%\n",
+                               group->groupName(),
+                               buf,
+                               servant->flightCount(),
+                               requests,
+                               coalesced,
+                               total ? coalesced * 100.0 / total : 0.0);
+}
+
+//SINGLEFLIGHT
+void onSingleFlight(ClientPacket* packet, void*)
+{
+    RedisProtoParseResult& r = packet->recvParseResult;
+    if (r.tokenCount != 1) {
+        packet->setFinishedState(ClientPacket::WrongNumberOfArguments);
+        return;
+    }
+
+    RedisProxy* proxy = packet->proxy();
+    IOBuffer& sendbuf = packet->sendBuff;
+    sendbuf.append("+", 1);
+    sendbuf.appendFormatString("%-10s %-20s %-10s %-12s %-12s %s\n",
+                               "GROUP", "HOST", "INFLIGHT", "REQUESTS", "COALESCED", "RATIO");
+    for (int i = 0; i < proxy->groupCount(); ++i) {
+        RedisServantGroup* group = proxy->group(i);
+        for (int m = 0; m < group->masterCount(); ++m) {
+            appendSingleFlightRow(sendbuf, group, group->master(m));
+        }
+        for (int s = 0; s < group->slaveCount(); ++s) {
+            appendSingleFlightRow(sendbuf, group, group->slave(s));
+        }
+    }
+    sendbuf.append("\r\n", 2);
+    packet->setFinishedState(ClientPacket::RequestFinished);
+}
+
+//COUNTERCOALESCE
+void onCounterCoalesce(ClientPacket* packet, void*)
+{
+    RedisProtoParseResult& r = packet->recvParseResult;
+    if (r.tokenCount != 1) {
+        packet->setFinishedState(ClientPacket::WrongNumberOfArguments);
+        return;
+    }
+
+    CounterCoalescer* coalescer = packet->proxy()->counterCoalescer();
+    CounterCoalescer::Option opt = coalescer->option();
+    CounterCoalescer::Stats stats = coalescer->stats();
+    std::string prefixes;
+    for (size_t i = 0; i < opt.prefixes.size(); ++i) {
+        if (i > 0) {
+            prefixes += ",";
+        }
+        prefixes += opt.prefixes[i];
+    }
+    IOBuffer& sendbuf = packet->sendBuff;
+    sendbuf.append("+", 1);
+    sendbuf.appendFormatString("enabled:%d\n", coalescer->isEnabled() ? 1 : 0);
+    sendbuf.appendFormatString("window:%d\n", opt.window);
+    sendbuf.appendFormatString("max_ops:%d\n", opt.maxOps);
+    sendbuf.appendFormatString("prefixes:%s\n", prefixes.c_str());
+    sendbuf.appendFormatString("increments:%lld\n", stats.increments);
+    sendbuf.appendFormatString("flushes:%lld\n", stats.flushes);
+    sendbuf.appendFormatString("ops_per_flush:%.2f\n",
+                               stats.flushes ? (double)stats.increments / stats.flushes : 0.0);
+    sendbuf.appendFormatString("pending:%d\n", stats.pending);
+    sendbuf.append("\r\n", 2);
+    packet->setFinishedState(ClientPacket::RequestFinished);
+}
+
+//WARMSTART [SAVE]
+void onWarmStart(ClientPacket* packet, void*)
+{
+    RedisProtoParseResult& r = packet->recvParseResult;
+    WarmStart* warmStart = packet->proxy()->warmStart();
+    if (r.tokenCount == 2 && r.tokens[1].len == 4 && strncasecmp(r.tokens[1].s, "SAVE", 4) == 0) {
+        if (!warmStart->isEnabled()) {
+            packet->sendBuff.append("-ERR warm_start is not enabled\r\n");
+        } else {
+            int count = warmStart->snapshot();
+            if (count < 0) {
+                packet->sendBuff.append("-ERR failed to write the snapshot\r\n");
+            } else {
+                packet->sendBuff.appendFormatString(":%d\r\n", count);
+            }
+        }
+        packet->setFinishedState(ClientPacket::RequestFinished);
+        return;
+    }
+    if (r.tokenCount != 1) {
+        packet->setFinishedState(ClientPacket::WrongNumberOfArguments);
+        return;
+    }
+
+    WarmStart::Option opt = warmStart->option();
+    WarmStart::Stats stats = warmStart->stats();
+    IOBuffer& sendbuf = packet->sendBuff;
+    sendbuf.append("+", 1);
+    sendbuf.appendFormatString("enabled:%d\n", warmStart->isEnabled() ? 1 : 0);
+    sendbuf.appendFormatString("file:%s\n", opt.file.c_str());
+    sendbuf.appendFormatString("interval:%d\n", opt.interval);
+    sendbuf.appendFormatString("max_keys:%d\n", opt.maxKeys);
+    sendbuf.appendFormatString("batch_size:%d\n", opt.batchSize);
+    sendbuf.appendFormatString("snapshots:%lld\n", stats.snapshots);
+    sendbuf.appendFormatString("saved_keys:%d\n", stats.savedKeys);
+    sendbuf.appendFormatString("loaded_keys:%d\n", stats.loadedKeys);
+    sendbuf.appendFormatString("prefetched:%d\n", stats.prefetched);
+    sendbuf.appendFormatString("missing:%d\n", stats.missing);
+    sendbuf.appendFormatString("failed_batches:%d\n", stats.failedBatches);
+    sendbuf.appendFormatString("pending_batches:%d\n", stats.pendingBatches);
+    sendbuf.append("\r\n", 2);
+    packet->setFinishedState(ClientPacket::RequestFinished);
+}
+
+//HEDGE
+void onHedge(ClientPacket* packet, void*)
+{
+    RedisProtoParseResult& r = packet->recvParseResult;
+    if (r.tokenCount != 1) {
+        packet->setFinishedState(ClientPacket::WrongNumberOfArguments);
+        return;
+    }
+
+    RedisProxy* proxy = packet->proxy();
+    IOBuffer& sendbuf = packet->sendBuff;
+    sendbuf.append("+", 1);
+    sendbuf.appendFormatString("%-10s %-10s %-12s %-12s %-10s %-10s\n",
+                               "GROUP", "DELAY(ms)", "REQUESTS", "HEDGED", "WON", "BUDGET(%)");
+    for (int i = 0; i < proxy->groupCount(); ++i) {
+        RedisServantGroup* group = proxy->group(i);
+        RequestHedger* hedger = group->hedger();
+        if (!hedger->isEnabled()) {
+            continue;
         }
+        RequestHedger::Stats stats = hedger->stats();
+        sendbuf.appendFormatString("%-10s %-10d %-12lld %-12lld %-10lld %-10d\n",
+                                   group->groupName(),
+                                   stats.delay,
+                                   stats.requests,
+                                   stats.hedged,
+                                   stats.won,
+                                   hedger->option().budget);
     }
     sendbuf.append("\r\n", 2);
     packet->setFinishedState(ClientPacket::RequestFinished);
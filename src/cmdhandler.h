@@ -28,6 +28,8 @@ void onStandardKeyCommand(ClientPacket*, void*);
 
 void onDelCommand(ClientPacket*, void*);
 
+void onBlockingCommand(ClientPacket*, void*);
+
 void onPingCommand(ClientPacket*, void*);
 
 void onShowCommand(ClientPacket*, void*);
@@ -36,6 +38,42 @@ void onMGetCommand(ClientPacket*, void*);
 
 void onMSetCommand(ClientPacket*, void*);
 
+void onScanCommand(ClientPacket*, void*);
+
+void onKeysCommand(ClientPacket*, void*);
+
+void onDbSizeCommand(ClientPacket*, void*);
+
+void onRandomKeyCommand(ClientPacket*, void*);
+
+void onMultiCommand(ClientPacket*, void*);
+
+void onExecCommand(ClientPacket*, void*);
+
+void onDiscardCommand(ClientPacket*, void*);
+
+void onWatchCommand(ClientPacket*, void*);
+
+void onUnwatchCommand(ClientPacket*, void*);
+
+void onEvalCommand(ClientPacket*, void*);
+
+void onScriptCommand(ClientPacket*, void*);
+
+void onSubscribeCommand(ClientPacket*, void*);
+
+void onUnsubscribeCommand(ClientPacket*, void*);
+
+bool isTransactionQueuing(ClientPacket* packet, RedisCommand* command);
+
+void onQueueTransactionCommand(ClientPacket* packet, RedisCommand* command);
+
+void discardTransaction(ClientPacket* packet);
+
+bool isSubscribedModeRejected(ClientPacket* packet, RedisCommand* command);
+
+void onSubscribedModeCommand(ClientPacket* packet, RedisCommand* command);
+
 void onHashMapping(ClientPacket* packet, void*);
 
 void onAddKeyMapping(ClientPacket* packet, void*);
@@ -46,6 +84,13 @@ void onShowMapping(ClientPacket* packet, void*);
 
 void onPoolInfo(ClientPacket* packet, void*);
 
+void onHotKeyCache(ClientPacket* packet, void*);
+
+void onSingleFlight(ClientPacket* packet, void*);
+void onCounterCoalesce(ClientPacket* packet, void*);
+void onWarmStart(ClientPacket* packet, void*);
+void onHedge(ClientPacket* packet, void*);
+
 void onShutDown(ClientPacket* packet, void*);
 
 #endif
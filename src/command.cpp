@@ -27,13 +27,21 @@ static RedisCommand _redisCommand[] = {
     {"APPEND", 6, RedisCommand::APPEND, onStandardKeyCommand, NULL},
     {"BITCOUNT", 8, RedisCommand::BITCOUNT, onStandardKeyCommand, NULL},
     {"BITPOS", 6, RedisCommand::BITPOS, onStandardKeyCommand, NULL},
+    {"BLPOP", 5, RedisCommand::BLPOP, onBlockingCommand, NULL},
+    {"BRPOP", 5, RedisCommand::BRPOP, onBlockingCommand, NULL},
+    {"BRPOPLPUSH", 10, RedisCommand::BRPOPLPUSH, onBlockingCommand, NULL},
     {"DUMP", 4, RedisCommand::DUMP, onStandardKeyCommand, NULL},
     {"DEL", 3, RedisCommand::DEL, onDelCommand, NULL},
     {"DECR", 4, RedisCommand::DECR, onStandardKeyCommand, NULL},
     {"DECRBY", 6, RedisCommand::DECRBY, onStandardKeyCommand, NULL},
+    {"DBSIZE", 6, RedisCommand::DBSIZE, onDbSizeCommand, NULL},
+    {"DISCARD", 7, RedisCommand::DISCARD, onDiscardCommand, NULL},
     {"EXPIREAT", 8, RedisCommand::EXPIREAT, onStandardKeyCommand, NULL},
     {"EXISTS", 6, RedisCommand::EXISTS, onStandardKeyCommand, NULL},
     {"EXPIRE", 6, RedisCommand::EXPIRE, onStandardKeyCommand, NULL},
+    {"EXEC", 4, RedisCommand::EXEC, onExecCommand, NULL},
+    {"EVAL", 4, RedisCommand::EVAL, onEvalCommand, NULL},
+    {"EVALSHA", 7, RedisCommand::EVALSHA, onEvalCommand, NULL},
     {"GET", 3, RedisCommand::GET, onStandardKeyCommand, NULL},
     {"GETBIT", 6, RedisCommand::GETBIT, onStandardKeyCommand, NULL},
     {"GETRANGE", 8, RedisCommand::GETRANGE, onStandardKeyCommand, NULL},
@@ -55,6 +63,8 @@ static RedisCommand _redisCommand[] = {
     {"INCRBY", 6, RedisCommand::INCRBY, onStandardKeyCommand, NULL},
     {"INCRBYFLOAT", 11, RedisCommand::INCRBYFLOAT, onStandardKeyCommand,  NULL},
 
+    {"KEYS", 4, RedisCommand::KEYS, onKeysCommand, NULL},
+
     {"LPUSH", 5, RedisCommand::LPUSH, onStandardKeyCommand, NULL},
     {"LPUSHX", 6, RedisCommand::LPUSHX, onStandardKeyCommand, NULL},
     {"LPOP", 4, RedisCommand::LPOP, onStandardKeyCommand, NULL},
@@ -68,6 +78,7 @@ static RedisCommand _redisCommand[] = {
 
     {"MGET", 4, RedisCommand::MGET, onMGetCommand, NULL},
     {"MSET", 4, RedisCommand::MSET, onMSetCommand, NULL},
+    {"MULTI", 5, RedisCommand::MULTI, onMultiCommand, NULL},
 
     {"PSETEX", 6, RedisCommand::PSETEX, onStandardKeyCommand, NULL},
     {"PERSIST", 7, RedisCommand::PERSIST, onStandardKeyCommand, NULL},
@@ -75,6 +86,7 @@ static RedisCommand _redisCommand[] = {
     {"PEXPIREAT", 9, RedisCommand::PEXPIREAT, onStandardKeyCommand, NULL},
     {"PTTL", 4, RedisCommand::PTTL, onStandardKeyCommand, NULL},
     {"PING", 4, RedisCommand::PING, onPingCommand, NULL},
+    {"PUBLISH", 7, RedisCommand::PUBLISH, onStandardKeyCommand, NULL},
 
     {"PFADD", 5, RedisCommand::PFADD, onStandardKeyCommand, NULL},
     {"PFCOUNT", 7, RedisCommand::PFCOUNT, onStandardKeyCommand, NULL},
@@ -84,6 +96,7 @@ static RedisCommand _redisCommand[] = {
     {"RPOP", 4, RedisCommand::RPOP, onStandardKeyCommand, NULL},
     {"RPUSH", 5, RedisCommand::RPUSH, onStandardKeyCommand, NULL},
     {"RPUSHX", 6, RedisCommand::RPUSHX, onStandardKeyCommand, NULL},
+    {"RANDOMKEY", 9, RedisCommand::RANDOMKEY, onRandomKeyCommand, NULL},
 
     {"SADD", 4, RedisCommand::SADD, onStandardKeyCommand, NULL},
     {"SMEMBERS", 8, RedisCommand::SMEMBERS, onStandardKeyCommand, NULL},
@@ -92,6 +105,9 @@ static RedisCommand _redisCommand[] = {
     {"SCARD", 5, RedisCommand::SCARD, onStandardKeyCommand, NULL},
     {"SISMEMBER", 9, RedisCommand::SISMEMBER, onStandardKeyCommand, NULL},
     {"SRANDMEMBER", 11, RedisCommand::SRANDMEMBER, onStandardKeyCommand, NULL},
+    {"SCAN", 4, RedisCommand::SCAN, onScanCommand, NULL},
+    {"SCRIPT", 6, RedisCommand::SCRIPT, onScriptCommand, NULL},
+    {"SUBSCRIBE", 9, RedisCommand::SUBSCRIBE, onSubscribeCommand, NULL},
 
     {"SETBIT", 6, RedisCommand::SETBIT, onStandardKeyCommand, NULL},
     {"SETRANGE", 8, RedisCommand::SETRANGE, onStandardKeyCommand, NULL},
@@ -103,6 +119,10 @@ static RedisCommand _redisCommand[] = {
     {"TTL", 3, RedisCommand::TTL, onStandardKeyCommand, NULL},
     {"TYPE", 4, RedisCommand::TYPE, onStandardKeyCommand, NULL},
 
+    {"UNWATCH", 7, RedisCommand::UNWATCH, onUnwatchCommand, NULL},
+    {"UNSUBSCRIBE", 11, RedisCommand::UNSUBSCRIBE, onUnsubscribeCommand, NULL},
+    {"WATCH", 5, RedisCommand::WATCH, onWatchCommand, NULL},
+
     {"ZADD", 4, RedisCommand::ZADD, onStandardKeyCommand, NULL},
     {"ZRANGE", 6, RedisCommand::ZRANGE, onStandardKeyCommand, NULL},
     {"ZREM", 4, RedisCommand::ZREM, onStandardKeyCommand, NULL},
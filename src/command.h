@@ -31,21 +31,24 @@ public:
     enum Type {
         AUTH,
         APPEND,
-        BITCOUNT, BITPOS,
-        DUMP,DEL, DECR, DECRBY,
-        EXPIREAT, EXISTS, EXPIRE,
+        BITCOUNT, BITPOS, BLPOP, BRPOP, BRPOPLPUSH,
+        DUMP,DEL, DECR, DECRBY, DBSIZE, DISCARD,
+        EXPIREAT, EXISTS, EXPIRE, EXEC, EVAL, EVALSHA,
         GET, GETBIT, GETRANGE, GETSET,
         HSET, HSETNX, HMSET, HGET, HMGET, HINCRBY,
         HEXISTS, HLEN, HDEL, HKEYS, HVALS, HGETALL, HINCRBYFLOAT,
         INCR, INCRBY, INCRBYFLOAT,
+        KEYS,
         LPUSH, LPUSHX, LPOP, LRANGE, LREM, LINDEX, LINSERT, LLEN, LSET, LTRIM,
-        MGET, MSET,
-        PSETEX, PERSIST, PEXPIRE, PEXPIREAT, PTTL, PING,
+        MGET, MSET, MULTI,
+        PSETEX, PERSIST, PEXPIRE, PEXPIREAT, PTTL, PING, PUBLISH,
         PFADD, PFCOUNT, PFMERGE,
-        RESTORE, RPOP, RPUSH, RPUSHX,
-        SADD, SMEMBERS, SREM, SPOP, SCARD, SISMEMBER, SRANDMEMBER,
+        RESTORE, RPOP, RPUSH, RPUSHX, RANDOMKEY,
+        SADD, SMEMBERS, SREM, SPOP, SCARD, SISMEMBER, SRANDMEMBER, SCAN, SCRIPT, SUBSCRIBE,
         SETBIT, SETRANGE, STRLEN, SET, SETEX, SETNX,
         TTL, TYPE,
+        UNWATCH, UNSUBSCRIBE,
+        WATCH,
         ZADD, ZRANGE, ZREM, ZINCRBY, ZRANK, ZREVRANK, ZREVRANGE,
         ZRANGEBYSCORE, ZCOUNT, ZCARD, ZREMRANGEBYRANK, ZREMRANGEBYSCORE
     };
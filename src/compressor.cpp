@@ -0,0 +1,236 @@
+﻿/*
+* Licensed to the Apache Software Foundation (ASF) under one
+* or more contributor license agreements.  See the NOTICE file
+* distributed with this work for additional information
+* regarding copyright ownership.  The ASF licenses this file
+* to you under the Apache License, Version 2.0 (the
+* "License"); you may not use this file except in compliance
+* with the License.  You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing,
+* software distributed under the License is distributed on an
+* "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+* KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations
+* under the License.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "util/lz4.h"
+#include "command.h"
+#include "redisproto.h"
+#include "redisproxy.h"
+#include "compressor.h"
+
+static const char CompressMagic[4] = {'\0', 'L', 'Z', '4'};
+
+static void appendBulk(std::string& out, const char* data, int len)
+{
+    char buf[32];
+    int n = sprintf(buf, "$%d\r\n", len);
+    out.append(buf, n);
+    out.append(data, len);
+    out.append("\r\n", 2);
+}
+
+//The value, decompressed when it has the header
+static void appendValue(std::string& out, const char* data, int len, std::string& tmp)
+{
+    if (len < 0) {
+        out.append("$-1\r\n", 5);
+    } else if (ValueCompressor::decompress(data, len, tmp)) {
+        appendBulk(out, tmp.data(), tmp.size());
+    } else {
+        appendBulk(out, data, len);
+    }
+}
+
+
+bool ValueCompressor::compress(const char *data, int len, std::string &out)
+{
+    out.resize(HeaderSize + lz4_compress_bound(len));
+    char* p = &out[0];
+    memcpy(p, CompressMagic, sizeof(CompressMagic));
+    p[4] = (char)(len & 0xff);
+    p[5] = (char)((len >> 8) & 0xff);
+    p[6] = (char)((len >> 16) & 0xff);
+    p[7] = (char)((len >> 24) & 0xff);
+
+    int size = lz4_compress(data, len, p + HeaderSize, out.size() - HeaderSize);
+    if (size <= 0 || HeaderSize + size >= len) {
+        return false;
+    }
+    out.resize(HeaderSize + size);
+    return true;
+}
+
+bool ValueCompressor::isCompressed(const char *data, int len)
+{
+    return (len > HeaderSize && memcmp(data, CompressMagic, sizeof(CompressMagic)) == 0);
+}
+
+bool ValueCompressor::decompress(const char *data, int len, std::string &out)
+{
+    if (!isCompressed(data, len)) {
+        return false;
+    }
+    const unsigned char* p = (const unsigned char*)data;
+    unsigned int raw = p[4] | (p[5] << 8) | (p[6] << 16) | ((unsigned int)p[7] << 24);
+    if (raw > MaxValueSize) {
+        return false;
+    }
+    out.resize(raw);
+    if (raw == 0) {
+        return false;
+    }
+    int size = lz4_decompress(data + HeaderSize, len - HeaderSize, &out[0], raw);
+    return (size == (int)raw);
+}
+
+bool ValueCompressor::compressRequest(ClientPacket *packet, int threshold)
+{
+    RedisProtoParseResult& r = packet->recvParseResult;
+    int first;
+    int step;
+    switch (packet->commandType) {
+    case RedisCommand::SET:
+        if (r.tokenCount < 3) {
+            return false;
+        }
+        first = 2;
+        step = r.tokenCount;
+        break;
+    case RedisCommand::SETEX:
+        if (r.tokenCount != 4) {
+            return false;
+        }
+        first = 3;
+        step = r.tokenCount;
+        break;
+    case RedisCommand::HSET:
+    case RedisCommand::HMSET:
+        if (r.tokenCount < 4 || r.tokenCount % 2 != 0) {
+            return false;
+        }
+        first = 3;
+        step = 2;
+        break;
+    default:
+        return false;
+    }
+
+    bool large = false;
+    for (int i = first; i < r.tokenCount; i += step) {
+        if (r.tokens[i].len >= threshold) {
+            large = true;
+            break;
+        }
+    }
+    if (!large) {
+        return false;
+    }
+
+    std::string& req = packet->compressedRequest;
+    std::string value;
+    bool compressed = false;
+    char buf[32];
+    req.clear();
+    req.append(buf, sprintf(buf, "*%d\r\n", r.tokenCount));
+    for (int i = 0; i < r.tokenCount; ++i) {
+        Token& tok = r.tokens[i];
+        if (i >= first && (i - first) % step == 0 && tok.len >= threshold &&
+            compress(tok.s, tok.len, value)) {
+            appendBulk(req, value.data(), value.size());
+            compressed = true;
+        } else {
+            appendBulk(req, tok.s, tok.len);
+        }
+    }
+    if (!compressed) {
+        req.clear();
+        return false;
+    }
+    r.protoBuff = &req[0];
+    r.protoBuffLen = req.size();
+    return true;
+}
+
+//Script replies are left alone: EVAL may return any value it built,
+//so the scripts of a compressed group read and return the stored bytes
+bool ValueCompressor::isDecompressible(int commandType)
+{
+    switch (commandType) {
+    case RedisCommand::GET:
+    case RedisCommand::GETSET:
+    case RedisCommand::MGET:
+    case RedisCommand::HGET:
+    case RedisCommand::HMGET:
+    case RedisCommand::HVALS:
+    case RedisCommand::HGETALL:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void ValueCompressor::decompressReply(ClientPacket *packet, int offset)
+{
+    char* data = packet->sendBuff.data() + offset;
+    int size = packet->sendBuff.size() - offset;
+    RedisProtoParseResult r;
+    if (RedisProto::parse(data, size, &r) != RedisProto::ProtoOK || r.protoBuffLen != size) {
+        return;
+    }
+
+    std::string out;
+    std::string tmp;
+    if (r.type == RedisProtoParseResult::Bulk) {
+        if (!isCompressed(r.tokens[0].s, r.tokens[0].len)) {
+            return;
+        }
+        appendValue(out, r.tokens[0].s, r.tokens[0].len, tmp);
+    } else if (r.type == RedisProtoParseResult::MultiBulk && r.integer > 0) {
+        //The elements are walked one by one, a reply may have more than
+        //MaxToken of them
+        char* p = data;
+        while (*p != '\n') {
+            ++p;
+        }
+        ++p;
+        out.append(data, p - data);
+        bool found = false;
+        RedisProtoParseResult elem;
+        for (int i = 0; i < r.integer; ++i) {
+            elem.reset();
+            if (RedisProto::parse(p, data + size - p, &elem) != RedisProto::ProtoOK) {
+                return;
+            }
+            if (elem.type == RedisProtoParseResult::Bulk && elem.tokens[0].len >= 0) {
+                if (isCompressed(elem.tokens[0].s, elem.tokens[0].len)) {
+                    found = true;
+                }
+                appendValue(out, elem.tokens[0].s, elem.tokens[0].len, tmp);
+            } else {
+                out.append(p, elem.protoBuffLen);
+            }
+            p += elem.protoBuffLen;
+        }
+        if (!found) {
+            return;
+        }
+    } else {
+        return;
+    }
+
+    //The next request of a pipeline parses its reply after this one
+    bool parsed = (packet->sendBufferParsedOffset == packet->sendBuff.size());
+    packet->sendBuff.truncate(offset);
+    packet->sendBuff.append(out.data(), out.size());
+    if (parsed) {
+        packet->sendBufferParsedOffset = packet->sendBuff.size();
+    }
+}
@@ -0,0 +1,54 @@
+﻿/*
+* Licensed to the Apache Software Foundation (ASF) under one
+* or more contributor license agreements.  See the NOTICE file
+* distributed with this work for additional information
+* regarding copyright ownership.  The ASF licenses this file
+* to you under the Apache License, Version 2.0 (the
+* "License"); you may not use this file except in compliance
+* with the License.  You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing,
+* software distributed under the License is distributed on an
+* "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+* KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations
+* under the License.
+*/
+
+#ifndef COMPRESSOR_H
+#define COMPRESSOR_H
+
+#include <string>
+
+class ClientPacket;
+
+//Compression of the values of a group. A compressed value starts with
+//a header: a magic which never begins a text value, and the size of the
+//raw value. Values without the header are passed through unchanged
+class ValueCompressor
+{
+public:
+    enum {
+        HeaderSize = 8,
+        MaxValueSize = 512 * 1024 * 1024
+    };
+
+    //Rewrite the request when SET, SETEX, HSET or HMSET has a value of at least
+    //threshold bytes which gets smaller compressed. The packet sends the
+    //rewritten request, its tokens still refer to the original one
+    static bool compressRequest(ClientPacket* packet, int threshold);
+
+    //Commands whose reply may hold compressed values
+    static bool isDecompressible(int commandType);
+
+    //Decompress the values of the reply at offset of the send buffer
+    static void decompressReply(ClientPacket* packet, int offset);
+
+    static bool compress(const char* data, int len, std::string& out);
+    static bool isCompressed(const char* data, int len);
+    static bool decompress(const char* data, int len, std::string& out);
+};
+
+#endif
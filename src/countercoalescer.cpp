@@ -0,0 +1,275 @@
+﻿/*
+* Licensed to the Apache Software Foundation (ASF) under one
+* or more contributor license agreements.  See the NOTICE file
+* distributed with this work for additional information
+* regarding copyright ownership.  The ASF licenses this file
+* to you under the Apache License, Version 2.0 (the
+* "License"); you may not use this file except in compliance
+* with the License.  You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing,
+* software distributed under the License is distributed on an
+* "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+* KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations
+* under the License.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+
+#include "util/logger.h"
+#include "command.h"
+#include "redisproxy.h"
+#include "countercoalescer.h"
+
+CounterCoalescer::CounterCoalescer(void)
+{
+    m_enabled = false;
+    m_increments = 0;
+    m_flushes = 0;
+}
+
+CounterCoalescer::~CounterCoalescer(void)
+{
+}
+
+void CounterCoalescer::setOption(const Option &opt)
+{
+    m_option = opt;
+    if (m_option.window < 1) {
+        m_option.window = 1;
+    }
+    if (m_option.maxOps < 1) {
+        m_option.maxOps = 1;
+    }
+}
+
+bool CounterCoalescer::isCounter(int commandType)
+{
+    switch (commandType) {
+    case RedisCommand::INCR:
+    case RedisCommand::DECR:
+    case RedisCommand::INCRBY:
+    case RedisCommand::DECRBY:
+    case RedisCommand::HINCRBY:
+        return true;
+    default:
+        return false;
+    }
+}
+
+//Only the integers redis accepts, anything else goes to the backend
+//which replies the error
+static bool parseInteger(const char* s, int len, long long* value)
+{
+    if (len <= 0 || len > 20) {
+        return false;
+    }
+    char buf[32];
+    memcpy(buf, s, len);
+    buf[len] = '\0';
+    if (!(buf[0] == '-' || (buf[0] >= '0' && buf[0] <= '9'))) {
+        return false;
+    }
+    char* end = NULL;
+    errno = 0;
+    *value = strtoll(buf, &end, 10);
+    return (errno == 0 && *end == '\0');
+}
+
+bool CounterCoalescer::parseDelta(ClientPacket *packet, long long *delta)
+{
+    RedisProtoParseResult& r = packet->recvParseResult;
+    switch (packet->commandType) {
+    case RedisCommand::INCR:
+        *delta = 1;
+        return (r.tokenCount == 2);
+    case RedisCommand::DECR:
+        *delta = -1;
+        return (r.tokenCount == 2);
+    case RedisCommand::INCRBY:
+        return (r.tokenCount == 3 && parseInteger(r.tokens[2].s, r.tokens[2].len, delta));
+    case RedisCommand::DECRBY:
+        if (r.tokenCount != 3 || !parseInteger(r.tokens[2].s, r.tokens[2].len, delta) ||
+            *delta == LLONG_MIN) {
+            return false;
+        }
+        *delta = -*delta;
+        return true;
+    case RedisCommand::HINCRBY:
+        return (r.tokenCount == 4 && parseInteger(r.tokens[3].s, r.tokens[3].len, delta));
+    default:
+        return false;
+    }
+}
+
+bool CounterCoalescer::hasPrefix(const char *key, int len) const
+{
+    for (size_t i = 0; i < m_option.prefixes.size(); ++i) {
+        const std::string& prefix = m_option.prefixes[i];
+        if ((int)prefix.size() <= len && memcmp(key, prefix.data(), prefix.size()) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CounterCoalescer::coalesce(ClientPacket *packet, const char *key, int len)
+{
+    //The request of a batch goes to the backend
+    if (!isCounter(packet->commandType) || packet->finished_func == onFlushFinished) {
+        return false;
+    }
+    long long delta;
+    if (!hasPrefix(key, len) || !parseDelta(packet, &delta)) {
+        return false;
+    }
+
+    RedisProtoParseResult& r = packet->recvParseResult;
+    bool hash = (packet->commandType == RedisCommand::HINCRBY);
+    EventLoop* loop = packet->eventLoop;
+    std::string id((const char*)&loop, sizeof(loop));
+    id.append(hash ? "H" : "S", 1);
+    id.append(key, len);
+    if (hash) {
+        id.append("\0", 1);
+        id.append(r.tokens[2].s, r.tokens[2].len);
+    }
+
+    m_lock.lock();
+    Batch* batch;
+    BatchMap::iterator it = m_batches.find(id);
+    if (it != m_batches.end()) {
+        batch = it->second;
+        long long sum = batch->sum;
+        if ((delta > 0 && sum > LLONG_MAX - delta) || (delta < 0 && sum < LLONG_MIN - delta)) {
+            m_lock.unlock();
+            return false;
+        }
+    } else {
+        batch = new Batch;
+        batch->owner = this;
+        batch->id = id;
+        batch->key.assign(key, len);
+        batch->hash = hash;
+        if (hash) {
+            batch->field.assign(r.tokens[2].s, r.tokens[2].len);
+        }
+        batch->sum = 0;
+        batch->request = new ClientPacket;
+        batch->request->server = packet->server;
+        batch->request->eventLoop = loop;
+        batch->request->_event.setTimer(loop, onWindowEnd, batch);
+        batch->request->_event.active(m_option.window);
+        m_batches[id] = batch;
+    }
+
+    Waiter waiter;
+    waiter.packet = packet;
+    waiter.delta = delta;
+    batch->waiters.push_back(waiter);
+    batch->sum += delta;
+    ++m_increments;
+
+    bool full = ((int)batch->waiters.size() >= m_option.maxOps);
+    if (full) {
+        m_batches.erase(id);
+    }
+    m_lock.unlock();
+
+    //The timer is in the loop of this packet
+    if (full) {
+        batch->request->_event.remove();
+        flush(batch);
+    }
+    return true;
+}
+
+void CounterCoalescer::onWindowEnd(socket_t, short, void *arg)
+{
+    Batch* batch = (Batch*)arg;
+    CounterCoalescer* owner = batch->owner;
+    owner->m_lock.lock();
+    owner->m_batches.erase(batch->id);
+    owner->m_lock.unlock();
+    owner->flush(batch);
+}
+
+void CounterCoalescer::flush(Batch *batch)
+{
+    ClientPacket* request = batch->request;
+    char buf[32];
+    int n = sprintf(buf, "%lld", batch->sum);
+    if (batch->hash) {
+        request->recvBuff.appendFormatString("*4\r\n$7\r\nHINCRBY\r\n$%d\r\n", (int)batch->key.size());
+        request->recvBuff.append(batch->key.data(), batch->key.size());
+        request->recvBuff.appendFormatString("\r\n$%d\r\n", (int)batch->field.size());
+        request->recvBuff.append(batch->field.data(), batch->field.size());
+        request->commandType = RedisCommand::HINCRBY;
+    } else {
+        request->recvBuff.appendFormatString("*3\r\n$6\r\nINCRBY\r\n$%d\r\n", (int)batch->key.size());
+        request->recvBuff.append(batch->key.data(), batch->key.size());
+        request->commandType = RedisCommand::INCRBY;
+    }
+    request->recvBuff.appendFormatString("\r\n$%d\r\n%s\r\n", n, buf);
+    request->continueToParseRecvBuffer();
+    request->finished_func = onFlushFinished;
+    request->finished_arg = batch;
+
+    m_lock.lock();
+    ++m_flushes;
+    m_lock.unlock();
+
+    Token& key = request->recvParseResult.tokens[1];
+    request->proxy()->handleClientPacket(key.s, key.len, request);
+}
+
+void CounterCoalescer::onFlushFinished(ClientPacket *request, void *arg)
+{
+    Batch* batch = (Batch*)arg;
+    const char* reply = request->sendBuff.data();
+    int size = request->sendBuff.size();
+
+    //The value after the last increment, the ones before are computed back
+    long long value = 0;
+    bool integer = false;
+    if (request->finishedState == ClientPacket::RequestFinished && size > 3 && reply[0] == ':') {
+        integer = parseInteger(reply + 1, size - 3, &value);
+    }
+    std::vector<long long> values(batch->waiters.size());
+    for (int i = batch->waiters.size() - 1; i >= 0; --i) {
+        values[i] = value;
+        value -= batch->waiters[i].delta;
+    }
+
+    for (size_t i = 0; i < batch->waiters.size(); ++i) {
+        ClientPacket* packet = batch->waiters[i].packet;
+        if (integer) {
+            packet->sendBuff.appendFormatString(":%lld\r\n", values[i]);
+        } else if (request->finishedState == ClientPacket::RequestFinished) {
+            packet->sendBuff.append(reply, size);
+        } else {
+            packet->sendBuff.append("-ERR counter request failed\r\n");
+        }
+        packet->setFinishedState(ClientPacket::RequestFinished);
+    }
+
+    delete request;
+    delete batch;
+}
+
+CounterCoalescer::Stats CounterCoalescer::stats(void)
+{
+    Stats s;
+    m_lock.lock();
+    s.increments = m_increments;
+    s.flushes = m_flushes;
+    s.pending = m_batches.size();
+    m_lock.unlock();
+    return s;
+}
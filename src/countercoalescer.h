@@ -0,0 +1,113 @@
+﻿/*
+* Licensed to the Apache Software Foundation (ASF) under one
+* or more contributor license agreements.  See the NOTICE file
+* distributed with this work for additional information
+* regarding copyright ownership.  The ASF licenses this file
+* to you under the Apache License, Version 2.0 (the
+* "License"); you may not use this file except in compliance
+* with the License.  You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing,
+* software distributed under the License is distributed on an
+* "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+* KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations
+* under the License.
+*/
+
+#ifndef COUNTERCOALESCER_H
+#define COUNTERCOALESCER_H
+
+#include <string.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "util/locker.h"
+
+#include "eventloop.h"
+
+class ClientPacket;
+
+//Increments of the counters whose key has one of the prefixes are held
+//for a short window and sent as one INCRBY or HINCRBY with the sum.
+//A batch belongs to the event loop of its first increment, so it only
+//holds packets of that loop. Each client gets the value its increment
+//would have returned if the batch had run in order, other writers of
+//the key may have run in between: the replies are approximate
+class CounterCoalescer
+{
+public:
+    struct Option {
+        Option(void) {
+            window = 5;
+            maxOps = 1000;
+        }
+
+        int window;             //Milliseconds the first increment of a batch waits
+        int maxOps;             //Increments which flush the batch before the window
+        std::vector<std::string> prefixes;
+    };
+
+    struct Stats {
+        Stats(void) { memset(this, 0, sizeof(Stats)); }
+
+        long long increments;   //Increments held by the batches
+        long long flushes;      //Requests sent to the backends
+        int pending;            //Batches waiting for their window
+    };
+
+    CounterCoalescer(void);
+    ~CounterCoalescer(void);
+
+    void setOption(const Option& opt);
+    Option option(void) const { return m_option; }
+
+    void setEnabled(bool b) { m_enabled = b; }
+    bool isEnabled(void) const { return m_enabled; }
+
+    static bool isCounter(int commandType);
+
+    //Hold the increment in the batch of its key. False when the request
+    //has to go to the backend by itself
+    bool coalesce(ClientPacket* packet, const char* key, int len);
+
+    Stats stats(void);
+
+private:
+    struct Waiter {
+        ClientPacket* packet;
+        long long delta;
+    };
+
+    struct Batch {
+        CounterCoalescer* owner;
+        std::string id;
+        std::string key;
+        std::string field;      //Field of HINCRBY
+        bool hash;
+        long long sum;
+        std::vector<Waiter> waiters;
+        ClientPacket* request;  //Request of the batch to the backend
+    };
+
+    typedef std::unordered_map<std::string, Batch*> BatchMap;
+
+    bool hasPrefix(const char* key, int len) const;
+    void flush(Batch* batch);
+    static bool parseDelta(ClientPacket* packet, long long* delta);
+    static void onWindowEnd(socket_t, short, void* arg);
+    static void onFlushFinished(ClientPacket* request, void* arg);
+
+private:
+    Option m_option;
+    bool m_enabled;
+    SpinLocker m_lock;
+    BatchMap m_batches;
+    long long m_increments;
+    long long m_flushes;
+};
+
+#endif
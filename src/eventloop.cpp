@@ -19,6 +19,7 @@
 
 #include "util/logger.h"
 #include "eventloop.h"
+#include "timerwheel.h"
 
 Event::Event(void)
 {
@@ -69,10 +70,12 @@ EventLoop::EventLoop(void)
         b = true;
     }
     m_event_loop = event_base_new();
+    m_timerWheel = new TimerWheel(this);
 }
 
 EventLoop::~EventLoop(void)
 {
+    delete m_timerWheel;
     if (m_event_loop) {
         event_base_free(m_event_loop);
     }
@@ -28,6 +28,7 @@
 #include "util/thread.h"
 
 class EventLoop;
+class TimerWheel;
 class Event
 {
 public:
@@ -61,8 +62,12 @@ public:
     void exec(void);
     void exit(int timeout = -1);
 
+    //Timers of the requests run by the loop
+    TimerWheel* timerWheel(void) const { return m_timerWheel; }
+
 private:
     event_base* m_event_loop;
+    TimerWheel* m_timerWheel;
     friend class Event;
     EventLoop(const EventLoop&);
     EventLoop& operator=(const EventLoop&);
@@ -0,0 +1,909 @@
+﻿/*
+* Licensed to the Apache Software Foundation (ASF) under one
+* or more contributor license agreements.  See the NOTICE file
+* distributed with this work for additional information
+* regarding copyright ownership.  The ASF licenses this file
+* to you under the Apache License, Version 2.0 (the
+* "License"); you may not use this file except in compliance
+* with the License.  You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing,
+* software distributed under the License is distributed on an
+* "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+* KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations
+* under the License.
+*/
+
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+
+#include "util/clock.h"
+#include "util/hash.h"
+#include "util/logger.h"
+#include "command.h"
+#include "redisproto.h"
+#include "redisproxy.h"
+#include "hotkeycache.h"
+
+//The replies of a key are told apart by the command, and the field for HGET
+static bool requestSub(ClientPacket* packet, std::string& sub)
+{
+    RedisProtoParseResult& r = packet->recvParseResult;
+    switch (packet->commandType) {
+    case RedisCommand::GET:
+        if (r.tokenCount != 2) {
+            return false;
+        }
+        sub.assign("g");
+        return true;
+    case RedisCommand::HGETALL:
+        if (r.tokenCount != 2) {
+            return false;
+        }
+        sub.assign("a");
+        return true;
+    case RedisCommand::HGET:
+        if (r.tokenCount != 3) {
+            return false;
+        }
+        sub.assign("h");
+        sub.append(r.tokens[2].s, r.tokens[2].len);
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void addStats(HotKeyCache::Stats& total, const HotKeyCache::Stats& s)
+{
+    total.hits += s.hits;
+    total.misses += s.misses;
+    total.admitted += s.admitted;
+    total.rejected += s.rejected;
+    total.evicted += s.evicted;
+    total.expired += s.expired;
+    total.invalidated += s.invalidated;
+    total.memory += s.memory;
+    total.entries += s.entries;
+}
+
+
+HotKeyCache::HotKeyCache(void)
+{
+    m_enabled = false;
+    m_shardMemory = m_option.maxMemory / ShardCount;
+    m_negativeShardMemory = m_option.negativeMaxMemory / ShardCount;
+    m_trackingDown = 0;
+}
+
+HotKeyCache::~HotKeyCache(void)
+{
+    for (size_t i = 0; i < m_trackers.size(); ++i) {
+        HotKeyCacheTracker* t = m_trackers[i];
+        closeTracker(t);
+        t->retryEvent.remove();
+        delete t;
+    }
+    clear();
+}
+
+void HotKeyCache::setOption(const HotKeyCache::Option &opt)
+{
+    m_option = opt;
+    m_shardMemory = m_option.maxMemory / ShardCount;
+    m_negativeShardMemory = m_option.negativeMaxMemory / ShardCount;
+}
+
+bool HotKeyCache::isCacheable(int commandType)
+{
+    switch (commandType) {
+    case RedisCommand::GET:
+    case RedisCommand::HGET:
+    case RedisCommand::HGETALL:
+        return true;
+    default:
+        return false;
+    }
+}
+
+//Commands which never change the key. Every other command routed by
+//key drops the cached replies of the key
+bool HotKeyCache::isReadOnly(int commandType)
+{
+    switch (commandType) {
+    case RedisCommand::BITCOUNT: case RedisCommand::BITPOS:
+    case RedisCommand::DUMP: case RedisCommand::EXISTS:
+    case RedisCommand::GET: case RedisCommand::GETBIT: case RedisCommand::GETRANGE:
+    case RedisCommand::HGET: case RedisCommand::HMGET: case RedisCommand::HEXISTS:
+    case RedisCommand::HLEN: case RedisCommand::HKEYS: case RedisCommand::HVALS:
+    case RedisCommand::HGETALL:
+    case RedisCommand::LRANGE: case RedisCommand::LINDEX: case RedisCommand::LLEN:
+    case RedisCommand::MGET:
+    case RedisCommand::PTTL: case RedisCommand::PUBLISH: case RedisCommand::PFCOUNT:
+    case RedisCommand::SMEMBERS: case RedisCommand::SCARD: case RedisCommand::SISMEMBER:
+    case RedisCommand::SRANDMEMBER: case RedisCommand::STRLEN:
+    case RedisCommand::TTL: case RedisCommand::TYPE:
+    case RedisCommand::ZRANGE: case RedisCommand::ZRANK: case RedisCommand::ZREVRANK:
+    case RedisCommand::ZREVRANGE: case RedisCommand::ZRANGEBYSCORE:
+    case RedisCommand::ZCOUNT: case RedisCommand::ZCARD:
+        return true;
+    default:
+        return false;
+    }
+}
+
+HotKeyCache::Shard *HotKeyCache::shardOf(const char *key, int len, unsigned int *hash)
+{
+    unsigned int h = hashForBytes(key, len);
+    *hash = h;
+    return &m_shards[h % ShardCount];
+}
+
+void HotKeyCache::sketchAdd(HotKeyCache::Shard *shard, unsigned int h1, unsigned int h2)
+{
+    unsigned int h = h1 / ShardCount;
+    for (int i = 0; i < SketchDepth; ++i) {
+        unsigned char& c = shard->sketch[i][(h + i * h2) % SketchWidth];
+        if (c < 255) {
+            ++c;
+        }
+    }
+
+    //The counters are halved from time to time, so keys which are
+    //no longer read lose their frequency
+    if (++shard->sketchAdds >= SketchWidth * 10) {
+        shard->sketchAdds = 0;
+        for (int i = 0; i < SketchDepth; ++i) {
+            for (int j = 0; j < SketchWidth; ++j) {
+                shard->sketch[i][j] >>= 1;
+            }
+        }
+    }
+}
+
+int HotKeyCache::sketchEstimate(HotKeyCache::Shard *shard, unsigned int h1, unsigned int h2)
+{
+    unsigned int h = h1 / ShardCount;
+    int estimate = 255;
+    for (int i = 0; i < SketchDepth; ++i) {
+        int c = shard->sketch[i][(h + i * h2) % SketchWidth];
+        if (c < estimate) {
+            estimate = c;
+        }
+    }
+    return estimate;
+}
+
+void HotKeyCache::removeEntry(HotKeyCache::Shard *shard, int slot)
+{
+    Entry* e = shard->ring[slot];
+    shard->stats.memory -= e->memory;
+    --shard->stats.entries;
+    shard->index.erase(e->key);
+    shard->ring[slot] = NULL;
+    shard->freeSlots.push_back(slot);
+    delete e;
+}
+
+//CLOCK: a referenced entry gets a second chance, expired entries go first
+bool HotKeyCache::evict(HotKeyCache::Shard *shard, long long need, long long now)
+{
+    int steps = shard->ring.size() * 2 + 1;
+    while (shard->stats.memory + need > m_shardMemory && steps-- > 0 && !shard->index.empty()) {
+        if (shard->hand >= (int)shard->ring.size()) {
+            shard->hand = 0;
+        }
+        Entry* e = shard->ring[shard->hand];
+        if (e) {
+            bool expired = true;
+            for (size_t i = 0; i < e->replies.size(); ++i) {
+                if (e->replies[i].expireTime > now) {
+                    expired = false;
+                    break;
+                }
+            }
+            if (e->referenced && !expired) {
+                e->referenced = false;
+            } else {
+                removeEntry(shard, shard->hand);
+                if (expired) {
+                    ++shard->stats.expired;
+                } else {
+                    ++shard->stats.evicted;
+                }
+            }
+        }
+        ++shard->hand;
+    }
+    return (shard->stats.memory + need <= m_shardMemory);
+}
+
+bool HotKeyCache::lookupNegative(HotKeyCache::Shard *shard, const std::string &key, const std::string &sub, long long now)
+{
+    std::unordered_map<std::string, NegativeEntry>::iterator it = shard->negatives.find(key);
+    if (it == shard->negatives.end()) {
+        return false;
+    }
+    std::vector<Negative>& subs = it->second.subs;
+    for (size_t i = 0; i < subs.size(); ++i) {
+        if (subs[i].sub != sub) {
+            continue;
+        }
+        if (subs[i].expireTime > now) {
+            return true;
+        }
+        it->second.memory -= subs[i].sub.size();
+        shard->negativeStats.memory -= subs[i].sub.size();
+        ++shard->negativeStats.expired;
+        subs.erase(subs.begin() + i);
+        if (subs.empty()) {
+            removeNegative(shard, it);
+        }
+        break;
+    }
+    return false;
+}
+
+void HotKeyCache::removeNegative(HotKeyCache::Shard *shard, std::unordered_map<std::string, NegativeEntry>::iterator it)
+{
+    shard->negativeStats.memory -= it->second.memory;
+    --shard->negativeStats.entries;
+    shard->negatives.erase(it);
+}
+
+//FIFO: the TTL of nil replies is short, the oldest ones expire first.
+//Entries dropped meanwhile leave stale names behind, which are skipped
+bool HotKeyCache::evictNegative(HotKeyCache::Shard *shard, long long need, long long now)
+{
+    while (!shard->negativeOrder.empty() &&
+           (shard->negativeStats.memory + need > m_negativeShardMemory ||
+            shard->negativeOrder.size() > shard->negatives.size() * 2 + 64)) {
+        std::pair<std::string, unsigned int> front = shard->negativeOrder.front();
+        shard->negativeOrder.pop_front();
+        std::unordered_map<std::string, NegativeEntry>::iterator it = shard->negatives.find(front.first);
+        if (it == shard->negatives.end() || it->second.seq != front.second) {
+            continue;
+        }
+        bool expired = true;
+        for (size_t i = 0; i < it->second.subs.size(); ++i) {
+            if (it->second.subs[i].expireTime > now) {
+                expired = false;
+                break;
+            }
+        }
+        removeNegative(shard, it);
+        if (expired) {
+            ++shard->negativeStats.expired;
+        } else {
+            ++shard->negativeStats.evicted;
+        }
+    }
+    return (shard->negativeStats.memory + need <= m_negativeShardMemory);
+}
+
+bool HotKeyCache::lookup(ClientPacket *packet, const char *key, int len)
+{
+    std::string sub;
+    if (!requestSub(packet, sub)) {
+        return false;
+    }
+
+    unsigned int h1;
+    unsigned int h2 = hash_fnv1a_32(key, len) | 1;
+    Shard* shard = shardOf(key, len, &h1);
+    long long now = currentMsec();
+    std::string keyString(key, len);
+    bool hit = false;
+    bool negative = false;
+
+    shard->locker.lock();
+    sketchAdd(shard, h1, h2);
+    std::unordered_map<std::string, int>::iterator it = shard->index.find(keyString);
+    if (it != shard->index.end()) {
+        Entry* e = shard->ring[it->second];
+        for (size_t i = 0; i < e->replies.size(); ++i) {
+            Reply& reply = e->replies[i];
+            if (reply.sub != sub) {
+                continue;
+            }
+            if (reply.expireTime > now) {
+                packet->sendBuff.append(reply.data.data(), reply.data.size());
+                e->referenced = true;
+                hit = true;
+            } else {
+                int size = reply.sub.size() + reply.data.size();
+                e->memory -= size;
+                shard->stats.memory -= size;
+                ++shard->stats.expired;
+                e->replies.erase(e->replies.begin() + i);
+                if (e->replies.empty()) {
+                    removeEntry(shard, it->second);
+                }
+            }
+            break;
+        }
+    }
+    if (!hit && m_option.negativeTtl > 0 && packet->commandType != RedisCommand::HGETALL) {
+        negative = lookupNegative(shard, keyString, sub, now);
+        if (negative) {
+            ++shard->negativeStats.hits;
+        } else {
+            ++shard->negativeStats.misses;
+        }
+    }
+    if (hit) {
+        ++shard->stats.hits;
+    } else if (!negative) {
+        ++shard->stats.misses;
+    }
+    unsigned int epoch = shard->epoch;
+    shard->locker.unlock();
+
+    if (negative) {
+        packet->sendBuff.append("$-1\r\n");
+    }
+    if (hit || negative) {
+        packet->setFinishedState(ClientPacket::RequestFinished);
+        return true;
+    }
+
+    HotKeyCacheTicket& t = packet->cacheTicket;
+    t.cache = this;
+    t.fill = true;
+    t.key = key;
+    t.keyLen = len;
+    t.replyOffset = packet->sendBuff.size();
+    t.epoch = epoch;
+    return false;
+}
+
+void HotKeyCache::invalidate(ClientPacket *packet, const char *key, int len)
+{
+    invalidate(key, len);
+
+    HotKeyCacheTicket& t = packet->cacheTicket;
+    t.cache = this;
+    t.fill = false;
+    t.key = key;
+    t.keyLen = len;
+}
+
+void HotKeyCache::invalidate(const char *key, int len)
+{
+    unsigned int h;
+    Shard* shard = shardOf(key, len, &h);
+    shard->locker.lock();
+    //Fills started before the write are dropped
+    ++shard->epoch;
+    std::unordered_map<std::string, int>::iterator it = shard->index.find(std::string(key, len));
+    if (it != shard->index.end()) {
+        removeEntry(shard, it->second);
+        ++shard->stats.invalidated;
+    }
+    std::unordered_map<std::string, NegativeEntry>::iterator n = shard->negatives.find(std::string(key, len));
+    if (n != shard->negatives.end()) {
+        removeNegative(shard, n);
+        ++shard->negativeStats.invalidated;
+    }
+    shard->locker.unlock();
+}
+
+void HotKeyCache::requestFinished(ClientPacket *packet)
+{
+    HotKeyCacheTicket& t = packet->cacheTicket;
+    if (!t.fill) {
+        invalidate(t.key, t.keyLen);
+        return;
+    }
+    if (packet->finishedState != ClientPacket::RequestFinished) {
+        return;
+    }
+
+    //Only a complete, successful reply is cached
+    char* data = packet->sendBuff.data() + t.replyOffset;
+    int size = packet->sendBuff.size() - t.replyOffset;
+    RedisProtoParseResult r;
+    if (RedisProto::parse(data, size, &r) != RedisProto::ProtoOK || r.protoBuffLen != size) {
+        return;
+    }
+    if (r.type == RedisProtoParseResult::Error ||
+        (r.type == RedisProtoParseResult::MultiBulk && r.integer < 0)) {
+        return;
+    }
+
+    std::string sub;
+    if (!requestSub(packet, sub)) {
+        return;
+    }
+
+    //Nil is not a value, it goes to the negative cache
+    if (r.type == RedisProtoParseResult::Bulk && r.tokens[0].len < 0) {
+        if (m_option.negativeTtl > 0) {
+            fillNegative(packet, sub);
+        }
+        return;
+    }
+
+    fill(t.key, t.keyLen, sub, data, size, t.epoch, false);
+}
+
+bool HotKeyCache::prefill(const char *key, int len, const char *data, int size, unsigned int epoch)
+{
+    return fill(key, len, std::string("g"), data, size, epoch, true);
+}
+
+unsigned int HotKeyCache::epoch(const char *key, int len)
+{
+    unsigned int h;
+    Shard* shard = shardOf(key, len, &h);
+    shard->locker.lock();
+    unsigned int epoch = shard->epoch;
+    shard->locker.unlock();
+    return epoch;
+}
+
+//Keys with a GET reply, the most read first by the sketch estimate.
+//Expired replies count too, the key was hot enough to be admitted
+std::vector<std::string> HotKeyCache::hotKeys(int maxKeys)
+{
+    std::vector<std::pair<int, std::string> > keys;
+    for (int i = 0; i < ShardCount; ++i) {
+        Shard* shard = &m_shards[i];
+        shard->locker.lock();
+        for (size_t j = 0; j < shard->ring.size(); ++j) {
+            Entry* e = shard->ring[j];
+            if (!e) {
+                continue;
+            }
+            for (size_t k = 0; k < e->replies.size(); ++k) {
+                if (e->replies[k].sub == "g") {
+                    unsigned int h1 = hashForBytes(e->key.data(), e->key.size());
+                    unsigned int h2 = hash_fnv1a_32(e->key.data(), e->key.size()) | 1;
+                    keys.push_back(std::make_pair(-sketchEstimate(shard, h1, h2), e->key));
+                    break;
+                }
+            }
+        }
+        shard->locker.unlock();
+    }
+
+    std::sort(keys.begin(), keys.end());
+    std::vector<std::string> result;
+    for (size_t i = 0; i < keys.size() && (int)i < maxKeys; ++i) {
+        result.push_back(keys[i].second);
+    }
+    return result;
+}
+
+//A prefill is a key known to be hot, it is admitted whatever the sketch
+//says and the sketch learns it, so its next fills are admitted too
+bool HotKeyCache::fill(const char *key, int keyLen, const std::string &sub,
+                       const char *data, int size, unsigned int epoch, bool admitted)
+{
+    unsigned int h1;
+    unsigned int h2 = hash_fnv1a_32(key, keyLen) | 1;
+    Shard* shard = shardOf(key, keyLen, &h1);
+    long long now = currentMsec();
+    int need = sub.size() + size;
+
+    //Without invalidations from the backend, only a short TTL is safe
+    int ttl = m_option.ttl;
+    if (m_option.tracking && __sync_add_and_fetch(&m_trackingDown, 0) > 0) {
+        ttl = m_option.fallbackTtl;
+    }
+
+    shard->locker.lock();
+    if (shard->epoch != epoch) {
+        shard->locker.unlock();
+        return false;
+    }
+    if (admitted) {
+        while (sketchEstimate(shard, h1, h2) < m_option.admitHits) {
+            sketchAdd(shard, h1, h2);
+        }
+    }
+    if (EntryOverhead + keyLen + need > m_shardMemory / 8 ||
+        sketchEstimate(shard, h1, h2) < m_option.admitHits) {
+        ++shard->stats.rejected;
+        shard->locker.unlock();
+        return false;
+    }
+    if (!evict(shard, EntryOverhead + keyLen + need, now)) {
+        ++shard->stats.rejected;
+        shard->locker.unlock();
+        return false;
+    }
+
+    std::string keyString(key, keyLen);
+    Entry* e = NULL;
+    std::unordered_map<std::string, int>::iterator it = shard->index.find(keyString);
+    if (it != shard->index.end()) {
+        e = shard->ring[it->second];
+    } else {
+        e = new Entry;
+        e->key = keyString;
+        e->memory = EntryOverhead + keyLen;
+        e->referenced = false;
+        int slot;
+        if (!shard->freeSlots.empty()) {
+            slot = shard->freeSlots.back();
+            shard->freeSlots.pop_back();
+            shard->ring[slot] = e;
+        } else {
+            slot = shard->ring.size();
+            shard->ring.push_back(e);
+        }
+        shard->index[keyString] = slot;
+        shard->stats.memory += e->memory;
+        ++shard->stats.entries;
+    }
+
+    Reply* reply = NULL;
+    for (size_t i = 0; i < e->replies.size(); ++i) {
+        if (e->replies[i].sub == sub) {
+            reply = &e->replies[i];
+            e->memory -= reply->sub.size() + reply->data.size();
+            shard->stats.memory -= reply->sub.size() + reply->data.size();
+            break;
+        }
+    }
+    if (!reply) {
+        e->replies.push_back(Reply());
+        reply = &e->replies.back();
+        reply->sub = sub;
+    }
+    reply->data.assign(data, size);
+    reply->expireTime = now + ttl;
+    e->memory += need;
+    shard->stats.memory += need;
+    ++shard->stats.admitted;
+
+    std::unordered_map<std::string, NegativeEntry>::iterator n = shard->negatives.find(keyString);
+    if (n != shard->negatives.end()) {
+        removeNegative(shard, n);
+    }
+    shard->locker.unlock();
+    return true;
+}
+
+void HotKeyCache::fillNegative(ClientPacket *packet, const std::string &sub)
+{
+    HotKeyCacheTicket& t = packet->cacheTicket;
+    unsigned int h1;
+    unsigned int h2 = hash_fnv1a_32(t.key, t.keyLen) | 1;
+    Shard* shard = shardOf(t.key, t.keyLen, &h1);
+    long long now = currentMsec();
+    int need = EntryOverhead + t.keyLen + sub.size();
+
+    int ttl = m_option.negativeTtl;
+    if (m_option.tracking && __sync_add_and_fetch(&m_trackingDown, 0) > 0 &&
+        m_option.fallbackTtl < ttl) {
+        ttl = m_option.fallbackTtl;
+    }
+
+    shard->locker.lock();
+    if (shard->epoch != t.epoch) {
+        shard->locker.unlock();
+        return;
+    }
+    if (need > m_negativeShardMemory / 8 ||
+        sketchEstimate(shard, h1, h2) < m_option.admitHits ||
+        !evictNegative(shard, need, now)) {
+        ++shard->negativeStats.rejected;
+        shard->locker.unlock();
+        return;
+    }
+
+    std::string key(t.key, t.keyLen);
+    std::unordered_map<std::string, NegativeEntry>::iterator it = shard->negatives.find(key);
+    if (it == shard->negatives.end()) {
+        NegativeEntry e;
+        e.memory = EntryOverhead + t.keyLen;
+        e.seq = ++shard->negativeSeq;
+        it = shard->negatives.insert(std::make_pair(key, e)).first;
+        shard->negativeOrder.push_back(std::make_pair(key, e.seq));
+        shard->negativeStats.memory += e.memory;
+        ++shard->negativeStats.entries;
+    }
+
+    Negative* negative = NULL;
+    for (size_t i = 0; i < it->second.subs.size(); ++i) {
+        if (it->second.subs[i].sub == sub) {
+            negative = &it->second.subs[i];
+            break;
+        }
+    }
+    if (!negative) {
+        it->second.subs.push_back(Negative());
+        negative = &it->second.subs.back();
+        negative->sub = sub;
+        it->second.memory += sub.size();
+        shard->negativeStats.memory += sub.size();
+    }
+    negative->expireTime = now + ttl;
+    ++shard->negativeStats.admitted;
+    shard->locker.unlock();
+}
+
+void HotKeyCache::clear(void)
+{
+    for (int i = 0; i < ShardCount; ++i) {
+        Shard* shard = &m_shards[i];
+        shard->locker.lock();
+        for (size_t j = 0; j < shard->ring.size(); ++j) {
+            delete shard->ring[j];
+        }
+        shard->ring.clear();
+        shard->freeSlots.clear();
+        shard->index.clear();
+        shard->hand = 0;
+        ++shard->epoch;
+        shard->stats.memory = 0;
+        shard->stats.entries = 0;
+        shard->negatives.clear();
+        shard->negativeOrder.clear();
+        shard->negativeStats.memory = 0;
+        shard->negativeStats.entries = 0;
+        shard->locker.unlock();
+    }
+}
+
+void HotKeyCache::addTracking(RedisServant *master)
+{
+    HotKeyCacheTracker* t = new HotKeyCacheTracker;
+    t->cache = this;
+    t->servant = master;
+    t->retryEvent.setTimer(master->eventLoop(), onTrackerRetry, t);
+    m_trackers.push_back(t);
+    __sync_add_and_fetch(&m_trackingDown, 1);
+    if (!connectTracker(t)) {
+        t->retryEvent.active(TrackingRetryInterval);
+    }
+}
+
+//The connection is opened in the loop of the master without blocking
+//it, the commands follow once it is writable
+bool HotKeyCache::connectTracker(HotKeyCacheTracker *t)
+{
+    RedisServant* servant = t->servant;
+    if (!servant->isActived()) {
+        return false;
+    }
+    if (!t->conn.asyncConnect(servant->redisAddress())) {
+        return false;
+    }
+    t->state = HotKeyCacheTracker::Connecting;
+    t->writeEvent.set(servant->eventLoop(), t->conn.m_socket.socket(), EV_WRITE, onTrackerConnected, t);
+    t->writeEvent.active(TrackingConnectTimeout);
+    return true;
+}
+
+void HotKeyCache::onTrackerConnected(socket_t sock, short events, void *arg)
+{
+    HotKeyCacheTracker* t = (HotKeyCacheTracker*)arg;
+    RedisServant* servant = t->servant;
+    if ((events & EV_TIMEOUT) || t->conn.m_socket.error() != 0) {
+        LOG(Logger::Warning, "Cache tracking connection (%s:%d) failed. retry after %d ms",
+            servant->redisAddress().ip(), servant->redisAddress().port(),
+            (int)TrackingRetryInterval);
+        t->cache->closeTracker(t);
+        t->retryEvent.active(TrackingRetryInterval);
+        return;
+    }
+
+    t->input.clear();
+    t->readEvent.set(servant->eventLoop(), sock, EV_READ | EV_PERSIST, onTrackerRead, t);
+    t->readEvent.active();
+    std::string pwd = servant->connectionPool()->password();
+    if (!pwd.empty()) {
+        char cmd[600];
+        sprintf(cmd, "*2\r\n$4\r\nAUTH\r\n$%d\r\n%s\r\n", (int)pwd.length(), pwd.c_str());
+        t->state = HotKeyCacheTracker::WaitAuth;
+        t->cache->sendTrackerCommand(t, cmd);
+        if (t->state == HotKeyCacheTracker::Closed) {
+            t->retryEvent.active(TrackingRetryInterval);
+            return;
+        }
+    } else {
+        t->state = HotKeyCacheTracker::WaitClientId;
+    }
+    t->cache->sendTrackerCommand(t, "*2\r\n$6\r\nCLIENT\r\n$2\r\nID\r\n");
+    if (t->state == HotKeyCacheTracker::Closed) {
+        t->retryEvent.active(TrackingRetryInterval);
+    }
+}
+
+void HotKeyCache::closeTracker(HotKeyCacheTracker *t)
+{
+    if (t->conn.isActived()) {
+        if (t->state == HotKeyCacheTracker::Connecting) {
+            t->writeEvent.remove();
+        } else {
+            t->readEvent.remove();
+        }
+        t->conn.disconnect();
+    }
+    t->input.clear();
+    if (t->state == HotKeyCacheTracker::Tracking) {
+        //Invalidations are lost from now on, the cached replies may be stale
+        __sync_add_and_fetch(&m_trackingDown, 1);
+        clear();
+    }
+    t->state = HotKeyCacheTracker::Closed;
+}
+
+void HotKeyCache::sendTrackerCommand(HotKeyCacheTracker *t, const char *cmd)
+{
+    //The commands are tiny and sent once per connection
+    int len = strlen(cmd);
+    if (t->conn.m_socket.asyncSend(cmd, len) != len) {
+        LOG(Logger::Warning, "Cache tracking connection (%s:%d): send failed",
+            t->servant->redisAddress().ip(), t->servant->redisAddress().port());
+        closeTracker(t);
+    }
+}
+
+bool HotKeyCache::trackerReply(HotKeyCacheTracker *t, RedisProtoParseResult &r)
+{
+    const HostAddress& addr = t->servant->redisAddress();
+    switch (t->state) {
+    case HotKeyCacheTracker::WaitAuth:
+        if (r.type == RedisProtoParseResult::Error) {
+            LOG(Logger::Warning, "Cache tracking connection (%s:%d): authentication failed",
+                addr.ip(), addr.port());
+            return false;
+        }
+        t->state = HotKeyCacheTracker::WaitClientId;
+        return true;
+    case HotKeyCacheTracker::WaitClientId: {
+        //The id is copied as the server wrote it, ":<id>\r\n", it may
+        //not fit the parsed int
+        int idlen = r.protoBuffLen - 3;
+        if (r.type != RedisProtoParseResult::Integer || idlen <= 0 || idlen > 20) {
+            LOG(Logger::Warning, "Cache tracking connection (%s:%d): CLIENT ID failed",
+                addr.ip(), addr.port());
+            return false;
+        }
+        char id[32];
+        char cmd[256];
+        memcpy(id, r.protoBuff + 1, idlen);
+        id[idlen] = 0;
+        sprintf(cmd, "*6\r\n$6\r\nCLIENT\r\n$8\r\nTRACKING\r\n$2\r\nON\r\n$8\r\nREDIRECT\r\n"
+                     "$%d\r\n%s\r\n$5\r\nBCAST\r\n"
+                     "*2\r\n$9\r\nSUBSCRIBE\r\n$20\r\n__redis__:invalidate\r\n", idlen, id);
+        t->state = HotKeyCacheTracker::WaitTracking;
+        sendTrackerCommand(t, cmd);
+        return (t->state != HotKeyCacheTracker::Closed);
+    }
+    case HotKeyCacheTracker::WaitTracking:
+        if (r.type != RedisProtoParseResult::Status) {
+            LOG(Logger::Warning, "Cache tracking connection (%s:%d): CLIENT TRACKING is not supported",
+                addr.ip(), addr.port());
+            return false;
+        }
+        t->state = HotKeyCacheTracker::WaitSubscribe;
+        return true;
+    case HotKeyCacheTracker::WaitSubscribe:
+        if (r.type != RedisProtoParseResult::MultiBulk) {
+            return false;
+        }
+        t->state = HotKeyCacheTracker::Tracking;
+        __sync_sub_and_fetch(&m_trackingDown, 1);
+        LOG(Logger::Message, "Cache tracking connection (%s:%d) established", addr.ip(), addr.port());
+        return true;
+    case HotKeyCacheTracker::Tracking:
+        break;
+    default:
+        return false;
+    }
+
+    if (r.type != RedisProtoParseResult::MultiBulk || r.tokenCount != 3
+        || r.tokens[0].len != 7 || strncasecmp(r.tokens[0].s, "message", 7) != 0) {
+        return true;
+    }
+
+    //The keys come as an array, nil after FLUSHALL or FLUSHDB
+    RedisProtoParseResult keys;
+    Token& tok = r.tokens[2];
+    if (tok.s == NULL || RedisProto::parse(tok.s, tok.len, &keys) != RedisProto::ProtoOK) {
+        clear();
+        return true;
+    }
+    if (keys.type == RedisProtoParseResult::Bulk) {
+        invalidate(keys.tokens[0].s, keys.tokens[0].len);
+    } else if (keys.type != RedisProtoParseResult::MultiBulk || keys.integer < 0 ||
+               keys.integer > keys.tokenCount) {
+        clear();
+    } else {
+        for (int i = 0; i < keys.tokenCount; ++i) {
+            if (keys.tokens[i].s != NULL) {
+                invalidate(keys.tokens[i].s, keys.tokens[i].len);
+            }
+        }
+    }
+    return true;
+}
+
+void HotKeyCache::onTrackerRead(socket_t, short, void *arg)
+{
+    HotKeyCacheTracker* t = (HotKeyCacheTracker*)arg;
+    HotKeyCache* cache = t->cache;
+    if (!t->conn.isActived()) {
+        return;
+    }
+
+    IOBuffer::DirectCopy cp = t->input.beginCopy();
+    int n = t->conn.m_socket.asyncRecv(cp.address, cp.maxsize);
+    if (n == TcpSocket::IOAgain) {
+        return;
+    }
+    if (n <= 0) {
+        LOG(Logger::Warning, "Cache tracking connection (%s:%d) closed. retry after %d ms",
+            t->servant->redisAddress().ip(), t->servant->redisAddress().port(),
+            (int)TrackingRetryInterval);
+        cache->closeTracker(t);
+        t->retryEvent.active(TrackingRetryInterval);
+        return;
+    }
+    t->input.endCopy(n);
+
+    int offset = 0;
+    RedisProto::ParseState state;
+    for (;;) {
+        t->parseResult.reset();
+        state = RedisProto::parse(t->input.data() + offset, t->input.size() - offset, &t->parseResult);
+        if (state != RedisProto::ProtoOK) {
+            break;
+        }
+        offset += t->parseResult.protoBuffLen;
+        if (!cache->trackerReply(t, t->parseResult)) {
+            state = RedisProto::ProtoError;
+            break;
+        }
+    }
+
+    if (state == RedisProto::ProtoError) {
+        cache->closeTracker(t);
+        t->retryEvent.active(TrackingRetryInterval);
+    } else if (offset > 0) {
+        int left = t->input.size() - offset;
+        memmove(t->input.data(), t->input.data() + offset, left);
+        t->input.truncate(left);
+    }
+}
+
+void HotKeyCache::onTrackerRetry(socket_t, short, void *arg)
+{
+    HotKeyCacheTracker* t = (HotKeyCacheTracker*)arg;
+    if (t->state == HotKeyCacheTracker::Closed && !t->cache->connectTracker(t)) {
+        t->retryEvent.active(TrackingRetryInterval);
+    }
+}
+
+HotKeyCache::Stats HotKeyCache::stats(void)
+{
+    Stats total;
+    for (int i = 0; i < ShardCount; ++i) {
+        Shard* shard = &m_shards[i];
+        shard->locker.lock();
+        addStats(total, shard->stats);
+        shard->locker.unlock();
+    }
+    return total;
+}
+
+HotKeyCache::Stats HotKeyCache::negativeStats(void)
+{
+    Stats total;
+    for (int i = 0; i < ShardCount; ++i) {
+        Shard* shard = &m_shards[i];
+        shard->locker.lock();
+        addStats(total, shard->negativeStats);
+        shard->locker.unlock();
+    }
+    return total;
+}
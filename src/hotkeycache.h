@@ -0,0 +1,267 @@
+﻿/*
+* Licensed to the Apache Software Foundation (ASF) under one
+* or more contributor license agreements.  See the NOTICE file
+* distributed with this work for additional information
+* regarding copyright ownership.  The ASF licenses this file
+* to you under the Apache License, Version 2.0 (the
+* "License"); you may not use this file except in compliance
+* with the License.  You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing,
+* software distributed under the License is distributed on an
+* "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+* KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations
+* under the License.
+*/
+
+#ifndef HOTKEYCACHE_H
+#define HOTKEYCACHE_H
+
+#include <string.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+
+#include "util/locker.h"
+#include "util/iobuffer.h"
+
+#include "eventloop.h"
+#include "redisproto.h"
+#include "redisservant.h"
+
+class ClientPacket;
+class HotKeyCache;
+
+//Cache state of a request, kept in the packet until its reply arrives
+struct HotKeyCacheTicket
+{
+    HotKeyCacheTicket(void) {
+        cache = NULL;
+        fill = false;
+        key = NULL;
+        keyLen = 0;
+        replyOffset = 0;
+        epoch = 0;
+    }
+
+    HotKeyCache* cache;     //NULL when the request doesn't use the cache
+    bool fill;              //A read to be cached, otherwise a write
+    const char* key;
+    int keyLen;
+    int replyOffset;        //Offset of the reply in the send buffer
+    unsigned int epoch;     //Invalidation epoch of the shard at the miss
+};
+
+//Connection to a master which receives the invalidation messages of
+//CLIENT TRACKING in broadcast mode. It is redirected to itself, so it
+//works with RESP2: AUTH when there is a password, CLIENT ID, CLIENT
+//TRACKING, then SUBSCRIBE
+struct HotKeyCacheTracker
+{
+    enum State {
+        Closed,
+        Connecting,
+        WaitAuth,
+        WaitClientId,
+        WaitTracking,
+        WaitSubscribe,
+        Tracking
+    };
+
+    HotKeyCacheTracker(void) {
+        cache = NULL;
+        servant = NULL;
+        state = Closed;
+    }
+
+    HotKeyCache* cache;
+    RedisServant* servant;
+    RedisConnection conn;
+    Event readEvent;
+    Event writeEvent;
+    Event retryEvent;
+    IOBuffer input;
+    RedisProtoParseResult parseResult;
+    int state;
+};
+
+//Read cache of the proxy for GET, HGET and HGETALL replies. The keys are
+//spread over shards, each one with its own lock, CLOCK eviction and a
+//count-min sketch of the reads. A reply is only cached when the sketch
+//has seen enough reads of the key, so cold keys don't evict hot ones.
+//Nil replies of GET and HGET go to a separate, smaller negative cache
+//with its own TTL and memory limit
+class HotKeyCache
+{
+public:
+    struct Option {
+        Option(void) {
+            ttl = 1000;
+            maxMemory = 64 * 1024 * 1024;
+            admitHits = 2;
+            tracking = false;
+            fallbackTtl = 100;
+            negativeTtl = 0;
+            negativeMaxMemory = 8 * 1024 * 1024;
+        }
+
+        int ttl;                //Milliseconds a reply stays valid
+        long long maxMemory;    //Bytes for all the shards
+        int admitHits;          //Reads of a key before its reply is cached
+        bool tracking;          //Invalidated by the masters, see addTracking()
+        int fallbackTtl;        //TTL while a tracking connection is down
+        int negativeTtl;        //Milliseconds a nil reply stays valid, 0 to disable
+        long long negativeMaxMemory;    //Bytes for the nil replies of all the shards
+    };
+
+    struct Stats {
+        Stats(void) { memset(this, 0, sizeof(Stats)); }
+
+        long long hits;
+        long long misses;
+        long long admitted;
+        long long rejected;     //Replies not admitted, too cold or too large
+        long long evicted;
+        long long expired;
+        long long invalidated;
+        long long memory;
+        int entries;
+    };
+
+    enum {
+        ShardCount = 64,
+        SketchDepth = 4,
+        SketchWidth = 1024,
+        EntryOverhead = 96,
+        TrackingRetryInterval = 1000,
+        TrackingConnectTimeout = 3000
+    };
+
+    HotKeyCache(void);
+    ~HotKeyCache(void);
+
+    void setOption(const Option& opt);
+    Option option(void) const { return m_option; }
+
+    void setEnabled(bool b) { m_enabled = b; }
+    bool isEnabled(void) const { return m_enabled; }
+
+    static bool isCacheable(int commandType);
+    static bool isReadOnly(int commandType);
+
+    //Reply the request from the cache. On a miss the packet gets a
+    //ticket and its reply is stored when the request finished
+    bool lookup(ClientPacket* packet, const char* key, int len);
+
+    //Drop the replies of a key written by the request, now and again
+    //when the write finished, so reads racing it are not cached
+    void invalidate(ClientPacket* packet, const char* key, int len);
+    void invalidate(const char* key, int len);
+
+    //Called by the packet when the request of the ticket finished
+    void requestFinished(ClientPacket* packet);
+
+    //Store the GET reply of a key read by the proxy itself. Dropped if
+    //the key was written since epoch() was taken
+    bool prefill(const char* key, int len, const char* data, int size, unsigned int epoch);
+    unsigned int epoch(const char* key, int len);
+    std::vector<std::string> hotKeys(int maxKeys);
+
+    //Keep a tracking connection to the master, in the event loop of the
+    //servant. Writes which bypass the proxy evict the keys too. While any
+    //tracking connection is down, replies are cached for fallbackTtl
+    void addTracking(RedisServant* master);
+    int trackingCount(void) const { return m_trackers.size(); }
+    int trackingDownCount(void) const { return m_trackingDown; }
+
+    void clear(void);
+    Stats stats(void);
+    Stats negativeStats(void);
+
+private:
+    struct Reply {
+        std::string sub;        //Command tag, and the field for HGET
+        std::string data;
+        long long expireTime;
+    };
+
+    struct Entry {
+        std::string key;
+        std::vector<Reply> replies;
+        int memory;
+        bool referenced;
+    };
+
+    struct Negative {
+        std::string sub;
+        long long expireTime;
+    };
+
+    struct NegativeEntry {
+        std::vector<Negative> subs;
+        int memory;
+        unsigned int seq;       //Tells the entry apart from older ones in the FIFO
+    };
+
+    struct Shard {
+        Shard(void) {
+            hand = 0;
+            epoch = 0;
+            negativeSeq = 0;
+            sketchAdds = 0;
+            memset(sketch, 0, sizeof(sketch));
+        }
+
+        SpinLocker locker;
+        std::unordered_map<std::string, int> index;
+        std::vector<Entry*> ring;
+        std::vector<int> freeSlots;
+        int hand;
+        unsigned int epoch;
+        int sketchAdds;
+        unsigned char sketch[SketchDepth][SketchWidth];
+        Stats stats;
+        std::unordered_map<std::string, NegativeEntry> negatives;
+        std::deque<std::pair<std::string, unsigned int> > negativeOrder;
+        unsigned int negativeSeq;
+        Stats negativeStats;
+    };
+
+    Shard* shardOf(const char* key, int len, unsigned int* hash);
+    void sketchAdd(Shard* shard, unsigned int h1, unsigned int h2);
+    int sketchEstimate(Shard* shard, unsigned int h1, unsigned int h2);
+    void removeEntry(Shard* shard, int slot);
+    bool evict(Shard* shard, long long need, long long now);
+    bool fill(const char* key, int keyLen, const std::string& sub,
+              const char* data, int size, unsigned int epoch, bool admitted);
+    bool lookupNegative(Shard* shard, const std::string& key, const std::string& sub, long long now);
+    void fillNegative(ClientPacket* packet, const std::string& sub);
+    void removeNegative(Shard* shard, std::unordered_map<std::string, NegativeEntry>::iterator it);
+    bool evictNegative(Shard* shard, long long need, long long now);
+    bool connectTracker(HotKeyCacheTracker* t);
+    void closeTracker(HotKeyCacheTracker* t);
+    bool trackerReply(HotKeyCacheTracker* t, RedisProtoParseResult& r);
+    void sendTrackerCommand(HotKeyCacheTracker* t, const char* cmd);
+    static void onTrackerConnected(socket_t sock, short events, void* arg);
+    static void onTrackerRead(socket_t sock, short, void* arg);
+    static void onTrackerRetry(socket_t sock, short, void* arg);
+
+private:
+    bool m_enabled;
+    Option m_option;
+    long long m_shardMemory;
+    long long m_negativeShardMemory;
+    Shard m_shards[ShardCount];
+    std::vector<HotKeyCacheTracker*> m_trackers;
+    int m_trackingDown;
+
+private:
+    HotKeyCache(const HotKeyCache&);
+    HotKeyCache& operator =(const HotKeyCache&);
+};
+
+#endif
@@ -0,0 +1,522 @@
+﻿/*
+* Licensed to the Apache Software Foundation (ASF) under one
+* or more contributor license agreements.  See the NOTICE file
+* distributed with this work for additional information
+* regarding copyright ownership.  The ASF licenses this file
+* to you under the Apache License, Version 2.0 (the
+* "License"); you may not use this file except in compliance
+* with the License.  You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing,
+* software distributed under the License is distributed on an
+* "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+* KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations
+* under the License.
+*/
+
+#include <stdlib.h>
+
+#include "util/clock.h"
+#include "util/logger.h"
+#include "command.h"
+#include "redisproto.h"
+#include "redisproxy.h"
+#include "redisservant.h"
+#include "redisservantgroup.h"
+#include "hotkeyreplicas.h"
+
+struct HotKeyReplicas::Seed
+{
+    HotKeyReplicas* owner;
+    std::string key;
+    unsigned int id;
+    unsigned int version;
+    EventLoop* loop;
+    std::vector<ClientPacket*> restores;
+    int returnCount;
+    bool failed;
+};
+
+struct HotKeyReplicas::WriteContext
+{
+    HotKeyReplicas* owner;
+    ClientPacket* packet;
+    std::vector<ClientPacket*> subs;
+    int returnCount;
+};
+
+static void appendArgument(IOBuffer& buf, const char* s, int len)
+{
+    buf.appendFormatString("$%d\r\n", len);
+    buf.append(s, len);
+    buf.append("\r\n", 2);
+}
+
+//A request of the proxy itself, the packet is released by func
+static ClientPacket* createRequest(EventLoop* loop, int commandType,
+                                   void (*func)(ClientPacket*, void*), void* arg)
+{
+    ClientPacket* packet = new ClientPacket;
+    packet->eventLoop = loop;
+    packet->commandType = commandType;
+    packet->finished_func = func;
+    packet->finished_arg = arg;
+    return packet;
+}
+
+HotKeyReplicas::HotKeyReplicas(void)
+{
+    m_proxy = NULL;
+    m_count = 0;
+    m_nextId = 0;
+    m_automaticCount = 0;
+}
+
+HotKeyReplicas::~HotKeyReplicas(void)
+{
+}
+
+bool HotKeyReplicas::route(ClientPacket *packet, const char *key, int len,
+                           std::vector<RedisServantGroup*> &groups)
+{
+    bool read = (HotKeyCache::isReadOnly(packet->commandType) &&
+                 packet->commandType != RedisCommand::PUBLISH);
+    bool reseed = false;
+    unsigned int id = 0;
+    std::string name(key, len);
+
+    m_lock.lock();
+    EntryMap::iterator it = m_entries.find(name);
+    if (it == m_entries.end()) {
+        m_lock.unlock();
+        return false;
+    }
+    Entry& e = it->second;
+    if (read) {
+        ++e.reads;
+        if (e.ready) {
+            groups.push_back(e.groups[e.next++ % e.groups.size()]);
+        } else {
+            groups.push_back(e.groups[0]);
+            //The copies failed before, they are made again
+            if (!e.seeding && currentMsec() - e.lastSeed >= SeedRetryInterval) {
+                e.seeding = true;
+                reseed = true;
+                id = e.id;
+            }
+        }
+    } else {
+        ++e.writes;
+        ++e.version;
+        groups = e.groups;
+    }
+    m_lock.unlock();
+
+    if (reseed) {
+        seed(name, id, packet->eventLoop);
+    }
+    return true;
+}
+
+void HotKeyReplicas::write(ClientPacket *packet, const std::vector<RedisServantGroup*> &groups)
+{
+    RedisProtoParseResult& r = packet->recvParseResult;
+    WriteContext* context = new WriteContext;
+    context->owner = this;
+    context->packet = packet;
+    context->returnCount = 0;
+    for (size_t i = 0; i < groups.size(); ++i) {
+        ClientPacket* sub = createRequest(packet->eventLoop, packet->commandType,
+                                          onWriteFinished, context);
+        sub->session = packet->session;
+        sub->recvBuff.append(r.protoBuff, r.protoBuffLen);
+        sub->continueToParseRecvBuffer();
+        context->subs.push_back(sub);
+    }
+    for (size_t i = 0; i < groups.size(); ++i) {
+        m_proxy->handleGroupPacket(groups[i], context->subs[i]);
+    }
+}
+
+void HotKeyReplicas::onWriteFinished(ClientPacket*, void *arg)
+{
+    WriteContext* context = (WriteContext*)arg;
+    if (++context->returnCount != (int)context->subs.size()) {
+        return;
+    }
+
+    //A replica which missed the write is not read until it is copied again
+    ClientPacket* packet = context->packet;
+    RedisProtoParseResult& r = packet->recvParseResult;
+    for (size_t i = 1; i < context->subs.size(); ++i) {
+        if (context->subs[i]->isErrorReply() && !context->subs[0]->isErrorReply()) {
+            HotKeyReplicas* owner = context->owner;
+            owner->m_lock.lock();
+            EntryMap::iterator it = owner->m_entries.find(std::string(r.tokens[1].s, r.tokens[1].len));
+            if (it != owner->m_entries.end()) {
+                it->second.ready = false;
+            }
+            owner->m_lock.unlock();
+            LOG(Logger::Warning, "Write to a replica of the hot key '%s' failed",
+                std::string(r.tokens[1].s, r.tokens[1].len).c_str());
+            break;
+        }
+    }
+
+    ClientPacket* first = context->subs[0];
+    if (first->sendBuff.isEmpty()) {
+        packet->sendBuff.append("-ERR backend is not available\r\n");
+    } else {
+        packet->sendBuff.append(first->sendBuff);
+    }
+    for (size_t i = 0; i < context->subs.size(); ++i) {
+        delete context->subs[i];
+    }
+    delete context;
+    packet->setFinishedState(ClientPacket::RequestFinished);
+}
+
+bool HotKeyReplicas::add(const char *key, int len, const std::vector<RedisServantGroup*> &groups,
+                         bool automatic, EventLoop *loop)
+{
+    RedisServantGroup* owner = m_proxy->mapToGroup(key, len);
+    if (len <= 0 || owner == NULL) {
+        return false;
+    }
+
+    Entry e;
+    e.groups.push_back(owner);
+    for (size_t i = 0; i < groups.size(); ++i) {
+        bool found = false;
+        for (size_t j = 0; j < e.groups.size(); ++j) {
+            if (e.groups[j] == groups[i]) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            e.groups.push_back(groups[i]);
+        }
+    }
+    if (e.groups.size() < 2) {
+        return false;
+    }
+    e.ready = false;
+    e.seeding = true;
+    e.automatic = automatic;
+    e.next = 0;
+    e.version = 0;
+    e.lastSeed = 0;
+    e.reads = 0;
+    e.writes = 0;
+
+    std::string name(key, len);
+    std::vector<RedisServantGroup*> removed;
+    m_lock.lock();
+    EntryMap::iterator it = m_entries.find(name);
+    if (it != m_entries.end()) {
+        //The groups left out lose their copies
+        for (size_t i = 1; i < it->second.groups.size(); ++i) {
+            RedisServantGroup* g = it->second.groups[i];
+            bool kept = false;
+            for (size_t j = 1; j < e.groups.size(); ++j) {
+                if (e.groups[j] == g) {
+                    kept = true;
+                    break;
+                }
+            }
+            if (!kept) {
+                removed.push_back(g);
+            }
+        }
+        if (it->second.automatic) {
+            --m_automaticCount;
+        }
+        e.groups[0] = it->second.groups[0];
+    }
+    e.id = ++m_nextId;
+    if (automatic) {
+        ++m_automaticCount;
+    }
+    m_entries[name] = e;
+    m_count = m_entries.size();
+    m_lock.unlock();
+
+    if (!removed.empty()) {
+        deleteCopies(name, removed, loop);
+    }
+    seed(name, e.id, loop);
+    return true;
+}
+
+bool HotKeyReplicas::remove(const char *key, int len, EventLoop *loop)
+{
+    std::string name(key, len);
+    std::vector<RedisServantGroup*> groups;
+    m_lock.lock();
+    EntryMap::iterator it = m_entries.find(name);
+    if (it == m_entries.end()) {
+        m_lock.unlock();
+        return false;
+    }
+    groups.assign(it->second.groups.begin() + 1, it->second.groups.end());
+    if (it->second.automatic) {
+        --m_automaticCount;
+    }
+    m_entries.erase(it);
+    m_count = m_entries.size();
+    m_lock.unlock();
+
+    deleteCopies(name, groups, loop);
+    return true;
+}
+
+std::vector<HotKeyReplicas::KeyInfo> HotKeyReplicas::keys(void)
+{
+    std::vector<KeyInfo> infos;
+    m_lock.lock();
+    for (EntryMap::iterator it = m_entries.begin(); it != m_entries.end(); ++it) {
+        KeyInfo info;
+        info.key = it->first;
+        info.groups = it->second.groups;
+        info.ready = it->second.ready;
+        info.automatic = it->second.automatic;
+        info.reads = it->second.reads;
+        info.writes = it->second.writes;
+        infos.push_back(info);
+    }
+    m_lock.unlock();
+    return infos;
+}
+
+//DUMP and PTTL from the master of the first group, then RESTORE to the
+//others. The copy is kept if no write ran meanwhile
+void HotKeyReplicas::seed(const std::string &key, unsigned int id, EventLoop *loop)
+{
+    m_lock.lock();
+    EntryMap::iterator it = m_entries.find(key);
+    if (it == m_entries.end() || it->second.id != id) {
+        m_lock.unlock();
+        return;
+    }
+    Entry& e = it->second;
+    RedisServantGroup* first = e.groups[0];
+    e.seeding = true;
+    e.lastSeed = currentMsec();
+    Seed* s = new Seed;
+    s->owner = this;
+    s->key = key;
+    s->id = id;
+    s->version = e.version;
+    s->loop = loop;
+    s->returnCount = 0;
+    s->failed = false;
+    m_lock.unlock();
+
+    if (first->masterCount() <= 0) {
+        seedFinished(s, false);
+        return;
+    }
+
+    ClientPacket* dump = createRequest(loop, RedisCommand::DUMP, onSeedDumped, s);
+    dump->recvBuff.append("*2\r\n$4\r\nDUMP\r\n");
+    appendArgument(dump->recvBuff, key.data(), key.size());
+    dump->recvBuff.append("*2\r\n$4\r\nPTTL\r\n");
+    appendArgument(dump->recvBuff, key.data(), key.size());
+    dump->continueToParseRecvBuffer();
+    dump->recvParseResult.protoBuff = dump->recvBuff.data();
+    dump->recvParseResult.protoBuffLen = dump->recvBuff.size();
+    dump->redisReplyCount = 2;
+    first->master(0)->handle(dump);
+}
+
+void HotKeyReplicas::onSeedDumped(ClientPacket *packet, void *arg)
+{
+    Seed* s = (Seed*)arg;
+    HotKeyReplicas* owner = s->owner;
+    char* data = packet->sendBuff.data();
+    int size = packet->sendBuff.size();
+    RedisProtoParseResult payload;
+    RedisProtoParseResult ttl;
+    bool ok = (!packet->isErrorReply() &&
+               RedisProto::parse(data, size, &payload) == RedisProto::ProtoOK &&
+               payload.type == RedisProtoParseResult::Bulk &&
+               RedisProto::parse(data + payload.protoBuffLen, size - payload.protoBuffLen, &ttl) == RedisProto::ProtoOK &&
+               ttl.type == RedisProtoParseResult::Integer);
+    if (!ok) {
+        LOG(Logger::Warning, "Copy of the hot key '%s' failed, DUMP: %.*s",
+            s->key.c_str(), size > 64 ? 64 : size, data);
+        delete packet;
+        owner->seedFinished(s, false);
+        return;
+    }
+
+    std::vector<RedisServantGroup*> groups;
+    owner->m_lock.lock();
+    EntryMap::iterator it = owner->m_entries.find(s->key);
+    if (it != owner->m_entries.end() && it->second.id == s->id) {
+        groups.assign(it->second.groups.begin() + 1, it->second.groups.end());
+    }
+    owner->m_lock.unlock();
+    if (groups.empty()) {
+        delete packet;
+        owner->seedFinished(s, false);
+        return;
+    }
+
+    //A missing key is deleted from the replicas
+    long long pttl = strtoll(ttl.protoBuff + 1, NULL, 10);
+    for (size_t i = 0; i < groups.size(); ++i) {
+        ClientPacket* restore;
+        if (payload.tokens[0].len < 0) {
+            restore = createRequest(s->loop, RedisCommand::DEL, onSeedRestored, s);
+            restore->recvBuff.append("*2\r\n$3\r\nDEL\r\n");
+            appendArgument(restore->recvBuff, s->key.data(), s->key.size());
+        } else {
+            char buf[32];
+            int n = sprintf(buf, "%lld", pttl > 0 ? pttl : 0);
+            restore = createRequest(s->loop, RedisCommand::RESTORE, onSeedRestored, s);
+            restore->recvBuff.append("*5\r\n$7\r\nRESTORE\r\n");
+            appendArgument(restore->recvBuff, s->key.data(), s->key.size());
+            appendArgument(restore->recvBuff, buf, n);
+            appendArgument(restore->recvBuff, payload.tokens[0].s, payload.tokens[0].len);
+            appendArgument(restore->recvBuff, "REPLACE", 7);
+        }
+        restore->continueToParseRecvBuffer();
+        s->restores.push_back(restore);
+    }
+    delete packet;
+
+    for (size_t i = 0; i < groups.size(); ++i) {
+        owner->m_proxy->handleGroupPacket(groups[i], s->restores[i]);
+    }
+}
+
+void HotKeyReplicas::onSeedRestored(ClientPacket *packet, void *arg)
+{
+    Seed* s = (Seed*)arg;
+    if (packet->isErrorReply()) {
+        LOG(Logger::Warning, "Copy of the hot key '%s' failed, RESTORE: %.*s",
+            s->key.c_str(), packet->sendBuff.size() > 64 ? 64 : packet->sendBuff.size(),
+            packet->sendBuff.data());
+        s->failed = true;
+    }
+    if (++s->returnCount != (int)s->restores.size()) {
+        return;
+    }
+    for (size_t i = 0; i < s->restores.size(); ++i) {
+        delete s->restores[i];
+    }
+    s->owner->seedFinished(s, !s->failed);
+}
+
+void HotKeyReplicas::seedFinished(Seed *s, bool ok)
+{
+    bool again = false;
+    m_lock.lock();
+    EntryMap::iterator it = m_entries.find(s->key);
+    if (it != m_entries.end() && it->second.id == s->id) {
+        Entry& e = it->second;
+        if (!ok) {
+            e.seeding = false;
+        } else if (e.version != s->version) {
+            again = true;
+        } else {
+            e.seeding = false;
+            e.ready = true;
+        }
+    }
+    m_lock.unlock();
+
+    if (again) {
+        seed(s->key, s->id, s->loop);
+    }
+    delete s;
+}
+
+void HotKeyReplicas::deleteCopies(const std::string &key, const std::vector<RedisServantGroup*> &groups,
+                                  EventLoop *loop)
+{
+    for (size_t i = 0; i < groups.size(); ++i) {
+        ClientPacket* del = createRequest(loop, RedisCommand::DEL, onCopyDeleted, NULL);
+        del->recvBuff.append("*2\r\n$3\r\nDEL\r\n");
+        appendArgument(del->recvBuff, key.data(), key.size());
+        del->continueToParseRecvBuffer();
+        m_proxy->handleGroupPacket(groups[i], del);
+    }
+}
+
+void HotKeyReplicas::onCopyDeleted(ClientPacket *packet, void*)
+{
+    delete packet;
+}
+
+void HotKeyReplicas::updateAutomatic(const std::vector<std::pair<std::string, unsigned long> > &counts,
+                                     EventLoop *loop)
+{
+    std::unordered_map<std::string, unsigned long> current;
+    std::vector<std::string> hot;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        const std::string& key = counts[i].first;
+        current[key] = counts[i].second;
+        std::unordered_map<std::string, unsigned long>::iterator last = m_lastCounts.find(key);
+        if (last != m_lastCounts.end() && counts[i].second - last->second >= (unsigned long)m_option.minReads) {
+            hot.push_back(key);
+        }
+    }
+
+    //Automatic keys which cooled down
+    std::vector<std::string> cold;
+    m_lock.lock();
+    for (EntryMap::iterator it = m_entries.begin(); it != m_entries.end(); ++it) {
+        if (!it->second.automatic) {
+            continue;
+        }
+        std::unordered_map<std::string, unsigned long>::iterator now = current.find(it->first);
+        std::unordered_map<std::string, unsigned long>::iterator last = m_lastCounts.find(it->first);
+        unsigned long reads = 0;
+        if (now != current.end() && last != m_lastCounts.end()) {
+            reads = now->second - last->second;
+        }
+        if (reads < (unsigned long)m_option.minReads / 2) {
+            cold.push_back(it->first);
+        }
+    }
+    m_lock.unlock();
+    m_lastCounts.swap(current);
+
+    for (size_t i = 0; i < cold.size(); ++i) {
+        LOG(Logger::Message, "Hot key '%s' is not replicated anymore", cold[i].c_str());
+        remove(cold[i].data(), cold[i].size(), loop);
+    }
+
+    int groupCount = m_proxy->groupCount();
+    for (size_t i = 0; i < hot.size(); ++i) {
+        const std::string& key = hot[i];
+        m_lock.lock();
+        bool skip = (m_entries.find(key) != m_entries.end() ||
+                     m_automaticCount >= m_option.maxKeys);
+        m_lock.unlock();
+        RedisServantGroup* owner = m_proxy->mapToGroup(key.data(), key.size());
+        if (skip || owner == NULL) {
+            continue;
+        }
+
+        //The groups after the one which owns the key
+        int index = 0;
+        while (index < groupCount && m_proxy->group(index) != owner) {
+            ++index;
+        }
+        std::vector<RedisServantGroup*> groups;
+        for (int n = 1; n < m_option.replicas && n < groupCount; ++n) {
+            groups.push_back(m_proxy->group((index + n) % groupCount));
+        }
+        if (add(key.data(), key.size(), groups, true, loop)) {
+            LOG(Logger::Message, "Hot key '%s' is replicated to %d groups",
+                key.c_str(), (int)groups.size() + 1);
+        }
+    }
+}
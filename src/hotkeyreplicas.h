@@ -0,0 +1,144 @@
+﻿/*
+* Licensed to the Apache Software Foundation (ASF) under one
+* or more contributor license agreements.  See the NOTICE file
+* distributed with this work for additional information
+* regarding copyright ownership.  The ASF licenses this file
+* to you under the Apache License, Version 2.0 (the
+* "License"); you may not use this file except in compliance
+* with the License.  You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing,
+* software distributed under the License is distributed on an
+* "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+* KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations
+* under the License.
+*/
+
+#ifndef HOTKEYREPLICAS_H
+#define HOTKEYREPLICAS_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "util/locker.h"
+
+#include "eventloop.h"
+
+class ClientPacket;
+class RedisProxy;
+class RedisServantGroup;
+
+//Keys copied to several groups. The group which owned the key when it
+//was replicated stays the first one: writes go to every group and the
+//client gets the reply of the first one, reads are spread over the
+//groups. A replica is filled with DUMP/RESTORE from the first group, and
+//reads stay on the first group until the copies are made without a
+//write in between. The keys are set by ADDKEYMAPPING with a list of
+//groups, or automatically from the read counts of the top keys
+class HotKeyReplicas
+{
+public:
+    struct Option {
+        Option(void) {
+            automatic = false;
+            replicas = 2;
+            minReads = 10000;
+            interval = 10;
+            maxKeys = 16;
+        }
+
+        bool automatic;         //Replicate the top keys
+        int replicas;           //Groups of an automatic key
+        int minReads;           //Requests of a key in an interval to replicate it
+        int interval;           //Seconds between the checks of the top keys
+        int maxKeys;            //Automatic keys at most
+    };
+
+    struct KeyInfo {
+        std::string key;
+        std::vector<RedisServantGroup*> groups;
+        bool ready;
+        bool automatic;
+        long long reads;
+        long long writes;
+    };
+
+    enum {
+        SeedRetryInterval = 1000
+    };
+
+    HotKeyReplicas(void);
+    ~HotKeyReplicas(void);
+
+    void setProxy(RedisProxy* proxy) { m_proxy = proxy; }
+
+    void setOption(const Option& opt) { m_option = opt; }
+    Option option(void) const { return m_option; }
+
+    bool isEmpty(void) const { return (m_count == 0); }
+
+    //The groups of a request on a replicated key: the one of a read, or
+    //all of them for a write. False when the key is not replicated
+    bool route(ClientPacket* packet, const char* key, int len,
+               std::vector<RedisServantGroup*>& groups);
+
+    //Send the write to every group, the client gets the reply of the first
+    void write(ClientPacket* packet, const std::vector<RedisServantGroup*>& groups);
+
+    //Copy the key to the groups, the requests to make the copies run in loop
+    bool add(const char* key, int len, const std::vector<RedisServantGroup*>& groups,
+             bool automatic, EventLoop* loop);
+    //Stop replicating the key and delete its copies
+    bool remove(const char* key, int len, EventLoop* loop);
+    std::vector<KeyInfo> keys(void);
+
+    //Request counts of the top keys since the start of the proxy. Keys
+    //above minReads in the last interval are replicated, automatic keys
+    //under half of it are not anymore
+    void updateAutomatic(const std::vector<std::pair<std::string, unsigned long> >& counts,
+                         EventLoop* loop);
+
+private:
+    struct Entry {
+        unsigned int id;
+        std::vector<RedisServantGroup*> groups;
+        bool ready;
+        bool seeding;
+        bool automatic;
+        unsigned int next;      //Group of the next read
+        unsigned int version;   //Writes to the key, a copy made meanwhile is stale
+        long long lastSeed;
+        long long reads;
+        long long writes;
+    };
+
+    typedef std::unordered_map<std::string, Entry> EntryMap;
+
+    struct Seed;
+    struct WriteContext;
+
+    void seed(const std::string& key, unsigned int id, EventLoop* loop);
+    void seedFinished(Seed* seed, bool ok);
+    void deleteCopies(const std::string& key, const std::vector<RedisServantGroup*>& groups,
+                      EventLoop* loop);
+    static void onSeedDumped(ClientPacket* packet, void* arg);
+    static void onSeedRestored(ClientPacket* packet, void* arg);
+    static void onWriteFinished(ClientPacket* packet, void* arg);
+    static void onCopyDeleted(ClientPacket* packet, void* arg);
+
+private:
+    RedisProxy* m_proxy;
+    Option m_option;
+    SpinLocker m_lock;
+    EntryMap m_entries;
+    volatile int m_count;
+    unsigned int m_nextId;
+    int m_automaticCount;
+    std::unordered_map<std::string, unsigned long> m_lastCounts;
+};
+
+#endif
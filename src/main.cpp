@@ -152,6 +152,9 @@ void startOneCache(void)
     if (!proxy.run(HostAddress(port))) {
         exit(APP_EXIT_KEY);
     }
+    if (!cfg->unixSocket().empty() && !proxy.runUnixListener(cfg->unixSocket().c_str())) {
+        exit(APP_EXIT_KEY);
+    }
 
     proxy.setTwemproxyModeEnabled(twemproxyMode);
 
@@ -173,9 +176,12 @@ void startOneCache(void)
     }
 
     const GroupOption* groupOption = cfg->groupOption();
+    const SSingleFlightInfo* flightInfo = cfg->singleFlightInfo();
     proxy.setGroupRetryTime(groupOption->group_retry_time);
     proxy.setAutoEjectGroupEnabled(groupOption->auto_eject_group);
     proxy.setEjectAfterRestoreEnabled(groupOption->eject_after_restore);
+    proxy.setMaxQueuedBytes(groupOption->max_queued_bytes);
+    proxy.setMaxScripts(groupOption->max_scripts);
     proxy.setPassword(cfg->password());
 
     for (int i = 0; i < cfg->groupCnt(); ++i) {
@@ -185,6 +191,13 @@ void startOneCache(void)
         RedisServantGroupPolicy* policy = RedisServantGroupPolicy::createPolicy(info->groupPolicy());
         group->setGroupName(info->groupName());
         group->setPolicy(policy);
+        group->setCompressThreshold(info->compressThreshold());
+        group->setReadYourWrites(info->readYourWrites());
+        RequestHedger::Option hedgeOpt;
+        hedgeOpt.delay = info->hedgeDelay();
+        hedgeOpt.percentile = info->hedgePercentile();
+        hedgeOpt.budget = info->hedgeBudget();
+        group->hedger()->setOption(hedgeOpt);
 
         const HostInfoList& hostList = info->hosts();
         HostInfoList::const_iterator itHost = hostList.begin();
@@ -196,8 +209,35 @@ void startOneCache(void)
             opt.poolSize = hostInfo.get_connectionNum();
             opt.reconnInterval = groupOption->backend_retry_interval;
             opt.maxReconnCount = groupOption->backend_retry_limit;
+            opt.blockingPoolSize = groupOption->blocking_connection_num;
+            opt.blockingTimeout = groupOption->blocking_timeout;
+            opt.readWeight = hostInfo.get_readWeight();
+            opt.requestTimeout = info->requestTimeout();
+            opt.maxQueue = groupOption->max_queue;
+            opt.maxQueueWait = groupOption->max_queue_wait;
+            opt.minPoolSize = hostInfo.get_minConnectionNum();
+            opt.maxPoolSize = hostInfo.get_maxConnectionNum();
+            opt.poolIdleTimeout = groupOption->pool_idle_timeout;
+            opt.poolGrowWait = groupOption->pool_grow_wait;
+            if (flightInfo->enable) {
+                for (size_t c = 0; c < flightInfo->commands.size(); ++c) {
+                    std::string name = flightInfo->commands[c];
+                    RedisCommand* cmd = RedisCommandTable::instance()->findCommand(name.c_str(), name.size());
+                    opt.singleFlight[cmd->type] = true;
+                }
+            }
             servant->setOption(opt);
-            servant->setRedisAddress(HostAddress(hostInfo.get_ip().c_str(), hostInfo.get_port()));
+            CircuitBreaker::Option breakerOpt;
+            breakerOpt.errors = groupOption->breaker_errors;
+            breakerOpt.errorRate = groupOption->breaker_error_rate;
+            breakerOpt.openTime = groupOption->breaker_open_time;
+            breakerOpt.probes = groupOption->breaker_probes;
+            servant->circuitBreaker()->setOption(breakerOpt);
+            if (!hostInfo.get_path().empty()) {
+                servant->setRedisAddress(HostAddress::unixAddress(hostInfo.get_path().c_str()));
+            } else {
+                servant->setRedisAddress(HostAddress(hostInfo.get_ip().c_str(), hostInfo.get_port()));
+            }
             servant->setEventLoop(proxy.eventLoop());
             if (hostInfo.get_master()) {
                 group->addMasterRedisServant(servant);
@@ -244,6 +284,49 @@ void startOneCache(void)
 
     HashFunc func = hashfuncFromName(cfg->hashFunctin().c_str());
     proxy.setHashFunction(func);
+    proxy.setHashTag(cfg->hashTag().c_str());
+
+    const SHotKeyCacheInfo* cacheInfo = cfg->hotKeyCacheInfo();
+    if (cacheInfo->enable) {
+        HotKeyCache::Option opt;
+        opt.ttl = cacheInfo->ttl;
+        opt.maxMemory = (long long)cacheInfo->max_memory * 1024 * 1024;
+        opt.admitHits = cacheInfo->admit_hits;
+        opt.tracking = cacheInfo->tracking;
+        opt.fallbackTtl = cacheInfo->fallback_ttl;
+        opt.negativeTtl = cacheInfo->negative_ttl;
+        opt.negativeMaxMemory = (long long)cacheInfo->negative_max_memory * 1024 * 1024;
+        proxy.hotKeyCache()->setOption(opt);
+        proxy.hotKeyCache()->setEnabled(true);
+
+        if (opt.tracking) {
+            for (int i = 0; i < proxy.groupCount(); ++i) {
+                RedisServantGroup* group = proxy.group(i);
+                for (int m = 0; m < group->masterCount(); ++m) {
+                    proxy.hotKeyCache()->addTracking(group->master(m));
+                }
+            }
+        }
+    }
+
+    const SCounterCoalesceInfo* counterInfo = cfg->counterCoalesceInfo();
+    if (counterInfo->enable) {
+        CounterCoalescer::Option opt;
+        opt.window = counterInfo->window;
+        opt.maxOps = counterInfo->max_ops;
+        opt.prefixes = counterInfo->prefixes;
+        proxy.counterCoalescer()->setOption(opt);
+        proxy.counterCoalescer()->setEnabled(true);
+    }
+
+    const SHotKeyReplicationInfo* replicationInfo = cfg->hotKeyReplicationInfo();
+    HotKeyReplicas::Option replicationOpt;
+    replicationOpt.automatic = replicationInfo->automatic;
+    replicationOpt.replicas = replicationInfo->replicas;
+    replicationOpt.minReads = replicationInfo->min_reads;
+    replicationOpt.interval = replicationInfo->interval;
+    replicationOpt.maxKeys = replicationInfo->max_keys;
+    proxy.hotKeyReplicas()->setOption(replicationOpt);
 
     for (int i = 0; i < cfg->keyMapCnt(); ++i) {
         const CKeyMapping* mapping = cfg->keyMapping(i);
@@ -253,6 +336,18 @@ void startOneCache(void)
         }
     }
 
+    const SWarmStartInfo* warmInfo = cfg->warmStartInfo();
+    if (warmInfo->enable) {
+        WarmStart::Option opt;
+        opt.file = warmInfo->file;
+        opt.interval = warmInfo->interval;
+        opt.maxKeys = warmInfo->max_keys;
+        opt.batchSize = warmInfo->batch_size;
+        proxy.warmStart()->setOption(opt);
+        proxy.warmStart()->setEnabled(true);
+        proxy.warmStart()->start(&listenerLoop);
+    }
+
     LOG(Logger::Message, "Start the %s on port %d. PID: %d", APP_NAME, port, getpid());
     listenerLoop.exec();
 }
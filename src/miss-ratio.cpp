@@ -0,0 +1,233 @@
+﻿/*
+* Licensed to the Apache Software Foundation (ASF) under one
+* or more contributor license agreements.  See the NOTICE file
+* distributed with this work for additional information
+* regarding copyright ownership.  The ASF licenses this file
+* to you under the Apache License, Version 2.0 (the
+* "License"); you may not use this file except in compliance
+* with the License.  You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing,
+* software distributed under the License is distributed on an
+* "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+* KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations
+* under the License.
+*/
+
+#include <algorithm>
+
+#include "util/hash.h"
+#include "miss-ratio.h"
+
+CMissRatioCurve::CMissRatioCurve() {
+    m_initThreshold = Modulus / 100;
+    m_threshold = m_initThreshold;
+    m_maxKeys = 16384;
+    m_clock = 0;
+    m_tree.resize(m_maxKeys * 4 + 1, 0);
+    reset();
+}
+
+CMissRatioCurve::~CMissRatioCurve() {}
+
+void CMissRatioCurve::setOption(double sampleRate, int maxKeys) {
+    m_lock.lock();
+    m_initThreshold = (unsigned int)(sampleRate * Modulus);
+    if (m_initThreshold == 0) {
+        m_initThreshold = 1;
+    }
+    m_maxKeys = maxKeys;
+    m_lock.unlock();
+    reset();
+}
+
+void CMissRatioCurve::reset() {
+    m_lock.lock();
+    m_threshold = m_initThreshold;
+    m_samples.clear();
+    m_byHash.clear();
+    m_tree.assign(m_maxKeys * 4 + 1, 0);
+    m_clock = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        m_buckets[i] = 0;
+    }
+    m_references = 0;
+    m_totalSize = 0;
+    m_lock.unlock();
+}
+
+// The threshold is read without the lock: a key sampled at a threshold
+// lowered meanwhile is checked again under the lock
+bool CMissRatioCurve::isSampled(const char* key, int len, unsigned int* t) const {
+    *t = hashForBytes(key, len) & (Modulus - 1);
+    return *t < m_threshold;
+}
+
+void CMissRatioCurve::access(const char* key, int len, int size) {
+    unsigned int t;
+    if (len <= 0 || !isSampled(key, len, &t)) {
+        return;
+    }
+
+    m_lock.lock();
+    if (t >= m_threshold) {
+        m_lock.unlock();
+        return;
+    }
+    m_references += 1;
+    std::string name(key, len);
+    SampleMap::iterator it = m_samples.find(name);
+    if (it != m_samples.end()) {
+        // Distinct sampled keys read since the last read of this one
+        Sample& s = it->second;
+        int distance = treeSum(m_clock) - treeSum(s.last);
+        double scaled = distance * (double)Modulus / m_threshold;
+        int b = 0;
+        while (b < BucketCount - 1 && (double)(1LL << b) <= scaled) {
+            ++b;
+        }
+        m_buckets[b] += 1;
+        m_totalSize += (len + size) - s.size;
+        s.size = len + size;
+        touch(s);
+    } else {
+        // A cold miss, it is only counted in the references
+        Sample s;
+        s.t = t;
+        s.last = 0;
+        s.size = len + size;
+        m_totalSize += s.size;
+        touch(s);
+        m_samples[name] = s;
+        m_byHash.insert(std::make_pair(t, name));
+        evictSamples();
+    }
+    m_lock.unlock();
+}
+
+void CMissRatioCurve::remove(const char* key, int len) {
+    unsigned int t;
+    if (len <= 0 || !isSampled(key, len, &t)) {
+        return;
+    }
+
+    m_lock.lock();
+    SampleMap::iterator it = m_samples.find(std::string(key, len));
+    if (it != m_samples.end()) {
+        treeAdd(it->second.last, -1);
+        m_totalSize -= it->second.size;
+        m_byHash.erase(std::make_pair(it->second.t, it->first));
+        m_samples.erase(it);
+    }
+    m_lock.unlock();
+}
+
+// Too many keys: the ones with the largest hash are dropped and the
+// sampling rate goes down. The counts so far are scaled to the new rate
+void CMissRatioCurve::evictSamples() {
+    if ((int)m_samples.size() <= m_maxKeys) {
+        return;
+    }
+
+    unsigned int threshold = m_byHash.rbegin()->first;
+    while (!m_byHash.empty() && m_byHash.rbegin()->first >= threshold) {
+        std::set<std::pair<unsigned int, std::string> >::iterator last = --m_byHash.end();
+        SampleMap::iterator it = m_samples.find(last->second);
+        treeAdd(it->second.last, -1);
+        m_totalSize -= it->second.size;
+        m_samples.erase(it);
+        m_byHash.erase(last);
+    }
+
+    double ratio = (double)threshold / m_threshold;
+    for (int i = 0; i < BucketCount; ++i) {
+        m_buckets[i] *= ratio;
+    }
+    m_references *= ratio;
+    m_threshold = threshold;
+}
+
+void CMissRatioCurve::touch(Sample& s) {
+    if (s.last > 0) {
+        treeAdd(s.last, -1);
+        s.last = 0;
+    }
+    if (m_clock + 1 >= (int)m_tree.size()) {
+        compact();
+    }
+    s.last = ++m_clock;
+    treeAdd(s.last, 1);
+}
+
+// The logical times are renumbered in the order of the last accesses,
+// so the tree keeps its size whatever the number of reads
+void CMissRatioCurve::compact() {
+    std::vector<std::pair<int, Sample*> > order;
+    order.reserve(m_samples.size());
+    for (SampleMap::iterator it = m_samples.begin(); it != m_samples.end(); ++it) {
+        if (it->second.last > 0) {
+            order.push_back(std::make_pair(it->second.last, &it->second));
+        }
+    }
+    std::sort(order.begin(), order.end());
+
+    std::fill(m_tree.begin(), m_tree.end(), 0);
+    m_clock = 0;
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i].second->last = ++m_clock;
+        treeAdd(m_clock, 1);
+    }
+}
+
+void CMissRatioCurve::treeAdd(int pos, int value) {
+    for (; pos < (int)m_tree.size(); pos += pos & (-pos)) {
+        m_tree[pos] += value;
+    }
+}
+
+int CMissRatioCurve::treeSum(int pos) const {
+    int sum = 0;
+    for (; pos > 0; pos -= pos & (-pos)) {
+        sum += m_tree[pos];
+    }
+    return sum;
+}
+
+double CMissRatioCurve::hitRatio(long long cacheKeys) {
+    double hits = 0;
+    m_lock.lock();
+    for (int b = 0; b < BucketCount && (1LL << b) <= cacheKeys; ++b) {
+        hits += m_buckets[b];
+    }
+    double ratio = (m_references > 0) ? hits / m_references : 0;
+    m_lock.unlock();
+    return ratio;
+}
+
+double CMissRatioCurve::sampleRate() {
+    return (double)m_threshold / Modulus;
+}
+
+int CMissRatioCurve::sampledKeys() {
+    m_lock.lock();
+    int count = m_samples.size();
+    m_lock.unlock();
+    return count;
+}
+
+long long CMissRatioCurve::references() {
+    m_lock.lock();
+    long long count = (long long)(m_references * Modulus / m_threshold);
+    m_lock.unlock();
+    return count;
+}
+
+double CMissRatioCurve::averageSize() {
+    m_lock.lock();
+    double size = m_samples.empty() ? 0 : (double)m_totalSize / m_samples.size();
+    m_lock.unlock();
+    return size;
+}
@@ -0,0 +1,89 @@
+﻿/*
+* Licensed to the Apache Software Foundation (ASF) under one
+* or more contributor license agreements.  See the NOTICE file
+* distributed with this work for additional information
+* regarding copyright ownership.  The ASF licenses this file
+* to you under the Apache License, Version 2.0 (the
+* "License"); you may not use this file except in compliance
+* with the License.  You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing,
+* software distributed under the License is distributed on an
+* "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+* KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations
+* under the License.
+*/
+
+#ifndef ONE_CACHE_MISS_RATIO
+#define ONE_CACHE_MISS_RATIO
+
+#include <set>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "util/locker.h"
+
+// Miss ratio curve of an LRU cache, estimated with SHARDS: only the keys
+// whose hash is below a threshold are tracked, and their reuse distances
+// are scaled by the sampling rate. When more than maxKeys keys are
+// sampled, the threshold is lowered so the memory stays bounded.
+class CMissRatioCurve
+{
+public:
+    enum {
+        Modulus = 1 << 24,
+        BucketCount = 40    // bucket b counts the distances in [2^(b-1), 2^b)
+    };
+
+    CMissRatioCurve();
+    ~CMissRatioCurve();
+
+    void setOption(double sampleRate, int maxKeys);
+
+    // A read of the key, size is the bytes of the reply
+    void access(const char* key, int len, int size);
+    // A write of the key, the next read of it is a miss
+    void remove(const char* key, int len);
+    void reset();
+
+    // Hit ratio of an LRU cache holding cacheKeys keys
+    double hitRatio(long long cacheKeys);
+    double sampleRate();
+    int sampledKeys();
+    long long references();     // estimated reads of all the keys
+    double averageSize();       // bytes of a key and its reply
+
+private:
+    struct Sample {
+        unsigned int t;
+        int last;               // logical time of the last access
+        int size;
+    };
+    typedef std::unordered_map<std::string, Sample> SampleMap;
+
+    bool isSampled(const char* key, int len, unsigned int* t) const;
+    void evictSamples();
+    void touch(Sample& s);
+    void compact();
+    void treeAdd(int pos, int value);
+    int treeSum(int pos) const;
+
+private:
+    SpinLocker        m_lock;
+    volatile unsigned int m_threshold;
+    unsigned int      m_initThreshold;
+    int               m_maxKeys;
+    SampleMap         m_samples;
+    std::set<std::pair<unsigned int, std::string> > m_byHash;
+    std::vector<int>  m_tree;       // Fenwick tree of the last access times
+    int               m_clock;
+    double            m_buckets[BucketCount];
+    double            m_references;
+    long long         m_totalSize;
+};
+
+#endif
@@ -24,6 +24,7 @@
 #define OUTPUTSTATUS    "OUTPUTSTATUS"
 #define TOPKEY          "TOPKEY"
 #define TOPVALUE          "TOPVALUE"
+#define MRC             "MRC"
 
 CCommandRecorder::CCommandRecorder() {
     for (int i = 0; i < RedisCommand::CMD_COUNT; i++) {
@@ -151,6 +152,7 @@ CRedisRecorder::CRedisRecorder() {
 
 CProxyMonitor::CProxyMonitor(){
     m_topKeyEnable = false;
+    m_missRatioEnable = false;
 }
 
 CProxyMonitor::~CProxyMonitor(){}
@@ -231,6 +233,43 @@ void topKeyProc(ClientPacket* packet, void* arg) {
 }
 
 
+// MRC [RESET]
+void missRatioProc(ClientPacket* packet, void* arg) {
+    IOBuffer& iobuffer = packet->sendBuff;
+    CProxyMonitor* monitor = (CProxyMonitor*)arg;
+    CMissRatioCurve* mrc = monitor->missRatioCurve();
+    RedisProtoParseResult& requestParseResult = packet->recvParseResult;
+    if (requestParseResult.tokenCount == 2 && requestParseResult.tokens[1].len == 5 &&
+        strncasecmp(requestParseResult.tokens[1].s, "RESET", 5) == 0) {
+        mrc->reset();
+        iobuffer.append("+OK\r\n");
+        packet->setFinishedState(ClientPacket::RequestFinished);
+        return;
+    }
+    if (requestParseResult.tokenCount != 1) {
+        packet->setFinishedState(ClientPacket::WrongNumberOfArguments);
+        return;
+    }
+
+    double avgSize = mrc->averageSize();
+    iobuffer.append("+");
+    iobuffer.appendFormatString("enabled:%d\n", monitor->m_missRatioEnable ? 1 : 0);
+    iobuffer.appendFormatString("sample_rate:%.6f\n", mrc->sampleRate());
+    iobuffer.appendFormatString("sampled_keys:%d\n", mrc->sampledKeys());
+    iobuffer.appendFormatString("references:%lld\n", mrc->references());
+    iobuffer.appendFormatString("average_size:%.0f\n", avgSize);
+    iobuffer.appendFormatString("%-12s %-12s %s\n", "KEYS", "MEMORY(MB)", "HIT_RATIO");
+    for (long long keys = 1024; keys <= 16 * 1024 * 1024; keys *= 2) {
+        iobuffer.appendFormatString("%-12lld %-12.1f %.2f%%\n",
+                                    keys,
+                                    keys * avgSize / CByteCounter::MBSIZE,
+                                    mrc->hitRatio(keys) * 100);
+    }
+    iobuffer.append("\r\n");
+    packet->setFinishedState(ClientPacket::RequestFinished);
+}
+
+
 void CProxyMonitor::proxyStarted(RedisProxy* proxy) {
     m_proxyBeginTime.timmingBegin();
     m_redisProxy = proxy;
@@ -270,10 +309,52 @@ void CProxyMonitor::proxyStarted(RedisProxy* proxy) {
     topValue.arg = this;
     RedisCommandTable::instance()->registerCommand(&topValue, 1);
 
+    // miss ratio curve
+    RedisCommand mrc;
+    strcpy(mrc.name, MRC);
+    mrc.len = strlen(MRC);
+    mrc.type = -1;
+    mrc.proc = missRatioProc;
+    mrc.arg = this;
+    RedisCommandTable::instance()->registerCommand(&mrc, 1);
+
     m_topKeyEnable = CRedisProxyCfg::instance()->topKeyEnable();
     if (m_topKeyEnable) {
         m_topKeyRecorderThread.start();
     }
+
+    const SMissRatioInfo* mrcInfo = CRedisProxyCfg::instance()->missRatioInfo();
+    m_missRatioEnable = mrcInfo->enable;
+    if (m_missRatioEnable) {
+        m_missRatioCurve.setOption(mrcInfo->sample_rate, mrcInfo->max_keys);
+    }
+
+    // hot keys replicated from the request counts of the top keys
+    const SHotKeyReplicationInfo* replicationInfo = CRedisProxyCfg::instance()->hotKeyReplicationInfo();
+    if (m_topKeyEnable && replicationInfo->automatic) {
+        m_hotKeyReplicationEvent.setTimer(proxy->eventLoop(), onHotKeyReplicationTimer, this);
+        m_hotKeyReplicationEvent.active(replicationInfo->interval * 1000);
+    }
+}
+
+void CProxyMonitor::onHotKeyReplicationTimer(socket_t, short, void* arg) {
+    CProxyMonitor* monitor = (CProxyMonitor*)arg;
+    HotKeyReplicas* replicas = monitor->m_redisProxy->hotKeyReplicas();
+    HotKeyReplicas::Option opt = replicas->option();
+
+    std::vector<std::pair<std::string, unsigned long> > counts;
+    CTopKeyRecorderThread& recorder = monitor->m_topKeyRecorderThread;
+    recorder.m_lock.lock();
+    CTopKeyRecorderThread::KeyCntMap::iterator it = recorder.m_keyCntMap.begin();
+    for (; it != recorder.m_keyCntMap.end(); ++it) {
+        if (it->second->keyCnt >= (unsigned long)opt.minReads) {
+            counts.push_back(std::make_pair(std::string(it->first), it->second->keyCnt));
+        }
+    }
+    recorder.m_lock.unlock();
+
+    replicas->updateAutomatic(counts, monitor->m_redisProxy->eventLoop());
+    monitor->m_hotKeyReplicationEvent.active(opt.interval * 1000);
 }
 
 char* CIpUtil::int2ipstr (int ip) {
@@ -315,6 +396,20 @@ void CProxyMonitor::replyClientFinished(ClientPacket* packet) {
         }
     }
 
+    // GET/HGET/HGETALL and MGET are the reads of a cache, writes drop the key
+    RedisProtoParseResult& r = packet->recvParseResult;
+    if (m_missRatioEnable && packet->commandType >= 0 && r.tokenCount >= 2) {
+        if (HotKeyCache::isCacheable(packet->commandType)) {
+            m_missRatioCurve.access(r.tokens[1].s, r.tokens[1].len, replySize);
+        } else if (packet->commandType == RedisCommand::MGET) {
+            for (int i = 1; i < r.tokenCount; ++i) {
+                m_missRatioCurve.access(r.tokens[i].s, r.tokens[i].len, replySize / (r.tokenCount - 1));
+            }
+        } else if (!HotKeyCache::isReadOnly(packet->commandType)) {
+            m_missRatioCurve.remove(r.tokens[1].s, r.tokens[1].len);
+        }
+    }
+
     int ip = packet->clientAddress._sockaddr()->sin_addr.s_addr;
     // add client info
     m_clientLock.lock();
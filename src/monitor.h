@@ -27,6 +27,7 @@
 #include "redisservant.h"
 #include "redisproxy.h"
 #include "top-key.h"
+#include "miss-ratio.h"
 #include "redis-proxy-config.h"
 
 class CCommandRecorder {
@@ -148,8 +149,12 @@ public:
     ClientRecorderMap* clientRecordMap() { return &m_clientRecMap; }
     RedisProxy* redisProxy()             { return m_redisProxy; }
     CTopKeyRecorderThread* topKeyRecorder()    { return &m_topKeyRecorderThread; }
+    CMissRatioCurve* missRatioCurve()    { return &m_missRatioCurve; }
+private:
+    static void onHotKeyReplicationTimer(socket_t, short, void* arg);
 public:
     bool m_topKeyEnable;
+    bool m_missRatioEnable;
 private:
     // for client
     ClientRecorderMap      m_clientRecMap;
@@ -163,6 +168,8 @@ private:
     SpinLocker                 m_topKeyLock;
 
     CTopKeyRecorderThread  m_topKeyRecorderThread;
+    CMissRatioCurve        m_missRatioCurve;
+    Event                  m_hotKeyReplicationEvent;
 };
 
 
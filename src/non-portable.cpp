@@ -220,10 +220,24 @@ int NonPortable::setVipAddress(const char*, const char*, int)
 socket_t NonPortable::createUnixSocketFile(const char* file)
 {
 #ifndef WIN32
+    sockaddr_un server_addr;
+    if (strlen(file) >= sizeof(server_addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    struct stat st;
+    if (lstat(file, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(file);
+    }
+
     socket_t server_sockfd = -1;
     server_sockfd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server_sockfd < 0) {
+        return -1;
+    }
 
-    sockaddr_un server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sun_family = AF_UNIX;
     strcpy(server_addr.sun_path, file);
 
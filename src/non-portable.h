@@ -30,7 +30,7 @@ void guard(void (*driverFunc)(), int exit_key);
 //daemon
 int daemonize(void);
 
-//create unix socket file
+//create unix socket file, a stale socket left at the path is removed
 socket_t createUnixSocketFile(const char* file);
 
 //vip address
@@ -0,0 +1,492 @@
+﻿/*
+* Licensed to the Apache Software Foundation (ASF) under one
+* or more contributor license agreements.  See the NOTICE file
+* distributed with this work for additional information
+* regarding copyright ownership.  The ASF licenses this file
+* to you under the Apache License, Version 2.0 (the
+* "License"); you may not use this file except in compliance
+* with the License.  You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing,
+* software distributed under the License is distributed on an
+* "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+* KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations
+* under the License.
+*/
+
+#include <string.h>
+#include <strings.h>
+#include <vector>
+
+#include "util/logger.h"
+#include "redisproxy.h"
+#include "redisservantgroup.h"
+#include "pubsub.h"
+
+PubSubMessage *PubSubMessage::create(const char *data, int len)
+{
+    PubSubMessage* msg = new PubSubMessage;
+    msg->refCount = 1;
+    msg->len = len;
+    msg->data = new char[len];
+    memcpy(msg->data, data, len);
+    return msg;
+}
+
+void PubSubMessage::ref(void)
+{
+    __sync_add_and_fetch(&refCount, 1);
+}
+
+void PubSubMessage::unref(void)
+{
+    if (__sync_sub_and_fetch(&refCount, 1) == 0) {
+        delete []data;
+        delete this;
+    }
+}
+
+
+
+PubSub::PubSub(void)
+{
+    m_proxy = NULL;
+}
+
+PubSub::~PubSub(void)
+{
+    UpstreamMap::iterator it = m_upstreams.begin();
+    for (; it != m_upstreams.end(); ++it) {
+        PubSubUpstream* up = it->second;
+        closeUpstream(up);
+        up->retryEvent.remove();
+        delete up;
+    }
+}
+
+int PubSub::subscribe(ClientPacket *packet, RedisServantGroup *group, const char *channel, int len)
+{
+    PubSubSubscriber* sub = packet->subscriber;
+    if (!sub) {
+        sub = new PubSubSubscriber;
+        sub->packet = packet;
+        sub->pubsub = this;
+        sub->replying = true;
+        sub->notify.setTimer(packet->eventLoop, onNotify, sub);
+        packet->subscriber = sub;
+    }
+
+    std::string name(channel, len);
+    if (sub->channels.find(name) != sub->channels.end()) {
+        return sub->channels.size();
+    }
+
+    m_mutex.lock();
+    PubSubUpstream* up = upstream(group);
+    if (up) {
+        std::set<PubSubSubscriber*>& subs = up->channels[name];
+        if (subs.empty()) {
+            sendCommand(up, "SUBSCRIBE", name);
+        }
+        subs.insert(sub);
+    }
+    m_mutex.unlock();
+
+    if (!up) {
+        return -1;
+    }
+    sub->channels[name] = up;
+    return sub->channels.size();
+}
+
+int PubSub::unsubscribe(ClientPacket *packet, const char *channel, int len)
+{
+    PubSubSubscriber* sub = packet->subscriber;
+    if (!sub) {
+        return 0;
+    }
+
+    std::map<std::string, PubSubUpstream*>::iterator it = sub->channels.find(std::string(channel, len));
+    if (it != sub->channels.end()) {
+        m_mutex.lock();
+        removeChannel(it->second, it->first, sub);
+        m_mutex.unlock();
+        sub->channels.erase(it);
+    }
+    return sub->channels.size();
+}
+
+void PubSub::removeSubscriber(ClientPacket *packet)
+{
+    PubSubSubscriber* sub = packet->subscriber;
+    if (!sub) {
+        return;
+    }
+
+    m_mutex.lock();
+    std::map<std::string, PubSubUpstream*>::iterator it = sub->channels.begin();
+    for (; it != sub->channels.end(); ++it) {
+        removeChannel(it->second, it->first, sub);
+    }
+    m_mutex.unlock();
+
+    //No more messages after the subscriber left the upstream channels
+    sub->notify.remove();
+    PubSubMessage* msg;
+    while ((msg = sub->messages.take(NULL)) != NULL) {
+        msg->unref();
+    }
+    packet->subscriber = NULL;
+    delete sub;
+}
+
+void PubSub::replyFinished(ClientPacket *packet)
+{
+    PubSubSubscriber* sub = packet->subscriber;
+    sub->replying = false;
+    sub->pushing = false;
+
+    sub->locker.lock();
+    bool wakeup = (sub->overflow || !sub->messages.isEmpty());
+    sub->locker.unlock();
+    if (wakeup) {
+        sub->notify.active(0);
+    }
+}
+
+PubSubUpstream *PubSub::upstream(RedisServantGroup *group)
+{
+    UpstreamMap::iterator it = m_upstreams.find(group);
+    if (it != m_upstreams.end()) {
+        return it->second;
+    }
+
+    PubSubUpstream* up = new PubSubUpstream;
+    up->pubsub = this;
+    up->group = group;
+    up->retryEvent.setTimer(m_proxy->eventLoop(), onUpstreamRetry, up);
+    if (!connectUpstream(up)) {
+        delete up;
+        return NULL;
+    }
+    m_upstreams[group] = up;
+    return up;
+}
+
+bool PubSub::connectUpstream(PubSubUpstream *up)
+{
+    RedisServantGroup* group = up->group;
+    RedisServant* servant = NULL;
+    for (int i = 0; i < group->masterCount() && !servant; ++i) {
+        if (group->master(i)->isActived()) {
+            servant = group->master(i);
+        }
+    }
+    for (int i = 0; i < group->slaveCount() && !servant; ++i) {
+        if (group->slave(i)->isActived()) {
+            servant = group->slave(i);
+        }
+    }
+    if (!servant) {
+        return false;
+    }
+
+    //The connection is opened in the proxy loop without blocking the
+    //caller, a client loop or the retry timer
+    const HostAddress& addr = servant->redisAddress();
+    if (!up->conn.asyncConnect(addr)) {
+        return false;
+    }
+    up->connected = false;
+    up->address = addr;
+    up->password = servant->connectionPool()->password();
+    up->writeEvent.set(m_proxy->eventLoop(), up->conn.m_socket.socket(), EV_WRITE, onUpstreamConnected, up);
+    up->writeEvent.active(ConnectTimeout);
+    return true;
+}
+
+void PubSub::onUpstreamConnected(socket_t sock, short events, void *arg)
+{
+    PubSubUpstream* up = (PubSubUpstream*)arg;
+    PubSub* pubsub = up->pubsub;
+    pubsub->m_mutex.lock();
+    if (!up->conn.isActived() || up->connected) {
+        pubsub->m_mutex.unlock();
+        return;
+    }
+    if ((events & EV_TIMEOUT) || up->conn.m_socket.error() != 0) {
+        LOG(Logger::Warning, "Pub/Sub connection of group '%s' failed. retry after %d ms",
+            up->group->groupName(), (int)RetryInterval);
+        pubsub->closeUpstream(up);
+        up->retryEvent.active(RetryInterval);
+        pubsub->m_mutex.unlock();
+        return;
+    }
+
+    LOG(Logger::Message, "Pub/Sub connection of group '%s' connected to %s:%d",
+        up->group->groupName(), up->address.ip(), up->address.port());
+
+    EventLoop* loop = pubsub->m_proxy->eventLoop();
+    up->connected = true;
+    up->input.clear();
+    up->output.clear();
+    up->sentBytes = 0;
+    up->readEvent.set(loop, sock, EV_READ | EV_PERSIST, onUpstreamRead, up);
+    up->readEvent.active();
+    up->writeEvent.set(loop, sock, EV_WRITE, onUpstreamWrite, up);
+    if (!up->password.empty()) {
+        up->output.appendFormatString("*2\r\n$4\r\nAUTH\r\n$%d\r\n", (int)up->password.size());
+        up->output.append(up->password.data(), up->password.size());
+        up->output.append("\r\n", 2);
+        up->writeEvent.active();
+    }
+
+    //The channels subscribed meanwhile, or again after reconnected
+    std::map<std::string, std::set<PubSubSubscriber*> >::iterator it = up->channels.begin();
+    for (; it != up->channels.end(); ++it) {
+        pubsub->sendCommand(up, "SUBSCRIBE", it->first);
+    }
+    pubsub->m_mutex.unlock();
+}
+
+void PubSub::closeUpstream(PubSubUpstream *up)
+{
+    if (up->conn.isActived()) {
+        up->readEvent.remove();
+        up->writeEvent.remove();
+        up->conn.disconnect();
+    }
+    up->connected = false;
+    up->input.clear();
+    up->output.clear();
+    up->sentBytes = 0;
+}
+
+void PubSub::removeChannel(PubSubUpstream *up, const std::string &channel, PubSubSubscriber *sub)
+{
+    std::map<std::string, std::set<PubSubSubscriber*> >::iterator it = up->channels.find(channel);
+    if (it == up->channels.end()) {
+        return;
+    }
+    it->second.erase(sub);
+    if (it->second.empty()) {
+        up->channels.erase(it);
+        sendCommand(up, "UNSUBSCRIBE", channel);
+    }
+}
+
+void PubSub::sendCommand(PubSubUpstream *up, const char *cmd, const std::string &channel)
+{
+    //The channels are subscribed when the connection is up
+    if (!up->connected) {
+        return;
+    }
+    up->output.appendFormatString("*2\r\n$%d\r\n%s\r\n$%d\r\n",
+                                  (int)strlen(cmd), cmd, (int)channel.size());
+    up->output.append(channel.data(), channel.size());
+    up->output.append("\r\n", 2);
+    up->writeEvent.active();
+}
+
+void PubSub::dispatch(PubSubUpstream *up, RedisProtoParseResult &r)
+{
+    if (r.type == RedisProtoParseResult::Error) {
+        LOG(Logger::Warning, "Pub/Sub connection of group '%s': %.*s",
+            up->group->groupName(), r.tokens[0].len, r.tokens[0].s);
+        return;
+    }
+
+    //Only messages are forwarded. The subscribe confirmations were
+    //already replied to the clients by the proxy
+    if (r.type != RedisProtoParseResult::MultiBulk || r.tokenCount != 3
+        || r.tokens[0].len != 7 || strncasecmp(r.tokens[0].s, "message", 7) != 0) {
+        return;
+    }
+
+    std::map<std::string, std::set<PubSubSubscriber*> >::iterator it;
+    it = up->channels.find(std::string(r.tokens[1].s, r.tokens[1].len));
+    if (it == up->channels.end()) {
+        return;
+    }
+
+    PubSubMessage* msg = PubSubMessage::create(r.protoBuff, r.protoBuffLen);
+    std::set<PubSubSubscriber*>::iterator subIt = it->second.begin();
+    for (; subIt != it->second.end(); ++subIt) {
+        PubSubSubscriber* sub = *subIt;
+        bool wakeup = false;
+        sub->locker.lock();
+        if (sub->pending >= MaxPendingMessages) {
+            wakeup = !sub->overflow;
+            sub->overflow = true;
+        } else {
+            msg->ref();
+            sub->messages.append(msg);
+            wakeup = (sub->pending == 0);
+            ++sub->pending;
+        }
+        sub->locker.unlock();
+        if (wakeup) {
+            sub->notify.active(0);
+        }
+    }
+    msg->unref();
+}
+
+//The messages are written straight from the shared frames while the
+//socket takes them. Only what is left is copied to the send buffer of
+//the client, it is written when the socket is writable again
+void PubSub::flush(PubSubSubscriber *sub)
+{
+    ClientPacket* packet = sub->packet;
+    std::vector<PubSubMessage*> msgs;
+    sub->locker.lock();
+    PubSubMessage* msg;
+    while ((msg = sub->messages.take(NULL)) != NULL) {
+        msgs.push_back(msg);
+    }
+    sub->pending = 0;
+    sub->locker.unlock();
+
+    bool blocked = false;
+    for (size_t i = 0; i < msgs.size(); ++i) {
+        msg = msgs[i];
+        int sent = 0;
+        if (!blocked) {
+            sent = packet->clientSocket.asyncSend(msg->data, msg->len);
+            if (sent < msg->len) {
+                //An error shows up again when the rest is written
+                blocked = true;
+                sent = (sent > 0) ? sent : 0;
+            }
+        }
+        if (sent < msg->len) {
+            packet->sendBuff.append(msg->data + sent, msg->len - sent);
+        }
+        msg->unref();
+    }
+
+    sub->pushing = true;
+    packet->server->writeReply(packet);
+}
+
+void PubSub::onUpstreamRead(socket_t, short, void *arg)
+{
+    PubSubUpstream* up = (PubSubUpstream*)arg;
+    PubSub* pubsub = up->pubsub;
+    pubsub->m_mutex.lock();
+    if (!up->conn.isActived()) {
+        pubsub->m_mutex.unlock();
+        return;
+    }
+
+    IOBuffer::DirectCopy cp = up->input.beginCopy();
+    int n = up->conn.m_socket.asyncRecv(cp.address, cp.maxsize);
+    if (n == TcpSocket::IOAgain) {
+        pubsub->m_mutex.unlock();
+        return;
+    }
+    if (n <= 0) {
+        LOG(Logger::Warning, "Pub/Sub connection of group '%s' closed. retry after %d ms",
+            up->group->groupName(), (int)RetryInterval);
+        pubsub->closeUpstream(up);
+        up->retryEvent.active(RetryInterval);
+        pubsub->m_mutex.unlock();
+        return;
+    }
+    up->input.endCopy(n);
+
+    int offset = 0;
+    RedisProto::ParseState state;
+    for (;;) {
+        up->parseResult.reset();
+        state = RedisProto::parse(up->input.data() + offset, up->input.size() - offset, &up->parseResult);
+        if (state != RedisProto::ProtoOK) {
+            break;
+        }
+        offset += up->parseResult.protoBuffLen;
+        pubsub->dispatch(up, up->parseResult);
+    }
+
+    if (state == RedisProto::ProtoError) {
+        LOG(Logger::Warning, "Pub/Sub connection of group '%s': protocol error",
+            up->group->groupName());
+        pubsub->closeUpstream(up);
+        up->retryEvent.active(RetryInterval);
+    } else if (offset > 0) {
+        int left = up->input.size() - offset;
+        memmove(up->input.data(), up->input.data() + offset, left);
+        up->input.truncate(left);
+    }
+    pubsub->m_mutex.unlock();
+}
+
+void PubSub::onUpstreamWrite(socket_t, short, void *arg)
+{
+    PubSubUpstream* up = (PubSubUpstream*)arg;
+    PubSub* pubsub = up->pubsub;
+    pubsub->m_mutex.lock();
+    if (up->conn.isActived() && up->sentBytes < up->output.size()) {
+        int ret = up->conn.m_socket.asyncSend(up->output.data() + up->sentBytes,
+                                              up->output.size() - up->sentBytes);
+        if (ret == TcpSocket::IOError) {
+            LOG(Logger::Warning, "Pub/Sub connection of group '%s': %s",
+                up->group->groupName(), strerror(errno));
+            pubsub->closeUpstream(up);
+            up->retryEvent.active(RetryInterval);
+        } else {
+            if (ret > 0) {
+                up->sentBytes += ret;
+            }
+            if (up->sentBytes == up->output.size()) {
+                up->output.clear();
+                up->sentBytes = 0;
+            } else {
+                up->writeEvent.active();
+            }
+        }
+    }
+    pubsub->m_mutex.unlock();
+}
+
+void PubSub::onUpstreamRetry(socket_t, short, void *arg)
+{
+    PubSubUpstream* up = (PubSubUpstream*)arg;
+    PubSub* pubsub = up->pubsub;
+    pubsub->m_mutex.lock();
+    if (!up->conn.isActived() && !pubsub->connectUpstream(up)) {
+        up->retryEvent.active(RetryInterval);
+    }
+    pubsub->m_mutex.unlock();
+}
+
+void PubSub::onNotify(socket_t, short, void *arg)
+{
+    PubSubSubscriber* sub = (PubSubSubscriber*)arg;
+    ClientPacket* packet = sub->packet;
+
+    //Pushed after the current reply is written
+    if (sub->replying || sub->pushing) {
+        return;
+    }
+
+    sub->locker.lock();
+    bool overflow = sub->overflow;
+    sub->locker.unlock();
+    if (overflow) {
+        LOG(Logger::Debug, "Subscriber (%s:%d) is too slow. close the connection",
+            packet->clientAddress.ip(), packet->clientAddress.port());
+        packet->_event.remove();
+        packet->server->closeConnection(packet);
+        return;
+    }
+
+    //Wait for the rest of a partially received request
+    if (!packet->recvBuff.isEmpty()) {
+        return;
+    }
+    packet->_event.remove();
+    sub->pubsub->flush(sub);
+}
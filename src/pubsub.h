@@ -0,0 +1,158 @@
+﻿/*
+* Licensed to the Apache Software Foundation (ASF) under one
+* or more contributor license agreements.  See the NOTICE file
+* distributed with this work for additional information
+* regarding copyright ownership.  The ASF licenses this file
+* to you under the Apache License, Version 2.0 (the
+* "License"); you may not use this file except in compliance
+* with the License.  You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing,
+* software distributed under the License is distributed on an
+* "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+* KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations
+* under the License.
+*/
+
+#ifndef PUBSUB_H
+#define PUBSUB_H
+
+#include <map>
+#include <set>
+#include <string>
+
+#include "util/iobuffer.h"
+#include "util/locker.h"
+#include "util/queue.h"
+
+#include "eventloop.h"
+#include "redisproto.h"
+#include "redisservant.h"
+
+class ClientPacket;
+class RedisProxy;
+class RedisServantGroup;
+class PubSub;
+struct PubSubUpstream;
+
+//A message frame as received from redis. It is copied once and
+//shared by all the local subscribers of the channel, they write it to
+//their socket from here
+struct PubSubMessage
+{
+    static PubSubMessage* create(const char* data, int len);
+    void ref(void);
+    void unref(void);
+
+    int refCount;
+    int len;
+    char* data;
+};
+
+//Pub/Sub state of a client. The members are used in the event loop
+//of the client, except the message queue which is filled by the
+//upstream connections
+struct PubSubSubscriber
+{
+    PubSubSubscriber(void) {
+        packet = NULL;
+        pubsub = NULL;
+        pending = 0;
+        overflow = false;
+        replying = false;
+        pushing = false;
+    }
+
+    ClientPacket* packet;
+    PubSub* pubsub;
+    std::map<std::string, PubSubUpstream*> channels;
+    SpinLocker locker;
+    Queue<PubSubMessage*> messages;
+    int pending;
+    bool overflow;          //Too many pending messages, the client is closed
+    bool replying;          //A request of the client is being processed
+    bool pushing;           //Messages are being written to the client
+    Event notify;
+};
+
+//The shared subscriber connection of a group, used in the proxy event loop
+struct PubSubUpstream
+{
+    PubSubUpstream(void) {
+        pubsub = NULL;
+        group = NULL;
+        connected = false;
+        sentBytes = 0;
+    }
+
+    PubSub* pubsub;
+    RedisServantGroup* group;
+    RedisConnection conn;
+    bool connected;         //The channels wait in the map until then
+    HostAddress address;
+    std::string password;
+    Event readEvent;
+    Event writeEvent;
+    Event retryEvent;
+    IOBuffer input;
+    IOBuffer output;
+    int sentBytes;
+    RedisProtoParseResult parseResult;
+    std::map<std::string, std::set<PubSubSubscriber*> > channels;
+};
+
+
+class PubSub
+{
+public:
+    enum {
+        MaxPendingMessages = 10000,
+        RetryInterval = 1000,
+        ConnectTimeout = 3000
+    };
+
+    PubSub(void);
+    ~PubSub(void);
+
+    void setProxy(RedisProxy* p) { m_proxy = p; }
+    RedisProxy* proxy(void) const { return m_proxy; }
+
+    //Return the number of channels of the client, -1 if the group has
+    //no usable redis
+    int subscribe(ClientPacket* packet, RedisServantGroup* group, const char* channel, int len);
+    int unsubscribe(ClientPacket* packet, const char* channel, int len);
+    void removeSubscriber(ClientPacket* packet);
+
+    //Called when a reply was written to a subscriber, the messages
+    //received meanwhile are pushed in the next loop iteration
+    void replyFinished(ClientPacket* packet);
+
+private:
+    PubSubUpstream* upstream(RedisServantGroup* group);
+    bool connectUpstream(PubSubUpstream* up);
+    void closeUpstream(PubSubUpstream* up);
+    void removeChannel(PubSubUpstream* up, const std::string& channel, PubSubSubscriber* sub);
+    void sendCommand(PubSubUpstream* up, const char* cmd, const std::string& channel);
+    void dispatch(PubSubUpstream* up, RedisProtoParseResult& r);
+    void flush(PubSubSubscriber* sub);
+    static void onUpstreamConnected(socket_t sock, short events, void* arg);
+    static void onUpstreamRead(socket_t sock, short, void* arg);
+    static void onUpstreamWrite(socket_t sock, short, void* arg);
+    static void onUpstreamRetry(socket_t sock, short, void* arg);
+    static void onNotify(socket_t sock, short, void* arg);
+
+private:
+    typedef std::map<RedisServantGroup*, PubSubUpstream*> UpstreamMap;
+    UpstreamMap m_upstreams;
+    Mutex m_mutex;
+    RedisProxy* m_proxy;
+
+private:
+    PubSub(const PubSub&);
+    PubSub& operator =(const PubSub&);
+};
+
+#endif
@@ -18,6 +18,7 @@
 */
 
 #include <time.h>
+#include <ctype.h>
 
 #include "redis-proxy-config.h"
 #include "redis-servant-select.h"
@@ -55,12 +56,16 @@ const TiXmlElement* COperateXml::get_rootElement() {
 // host info
 CHostInfo::CHostInfo() {
     ip = "";
+    path = "";
     host_name = "";
     port = 0;
     master = false;
     priority = 0;
     policy = 0;
     connection_num = 50;
+    min_connection_num = -1;
+    max_connection_num = -1;
+    read_weight = 1;
     memset(password, '\0', sizeof(password));
 }
 
@@ -71,6 +76,11 @@ string CHostInfo::get_ip()const
     return ip;
 }
 
+string CHostInfo::get_path()const
+{
+    return path;
+}
+
 string CHostInfo::get_hostName()const
 {
     return host_name;
@@ -80,15 +90,28 @@ bool CHostInfo::get_master()const       { return master;}
 int CHostInfo::get_policy()const        { return policy;}
 int CHostInfo::get_priority()const      { return priority;}
 int CHostInfo::get_connectionNum()const { return connection_num;}
+int CHostInfo::get_minConnectionNum()const
+{
+    return (min_connection_num < 0) ? connection_num : min_connection_num;
+}
+int CHostInfo::get_maxConnectionNum()const
+{
+    return (max_connection_num < 0) ? connection_num : max_connection_num;
+}
+int CHostInfo::get_readWeight()const    { return read_weight;}
 const string CHostInfo::passWord()const  {return string(password, strlen(password));}
 
 void CHostInfo::set_ip(string& s)        { ip = s;}
+void CHostInfo::set_path(string& s)      { path = s;}
 void CHostInfo::set_hostName(string& s)  { host_name = s;}
 void CHostInfo::set_port(int p)          { port = p;}
 void CHostInfo::set_master(bool m)       { master = m;}
 void CHostInfo::set_policy(int p)        { policy = p;}
 void CHostInfo::set_priority(int p)      { priority = p;}
 void CHostInfo::set_connectionNum(int p) { connection_num = p;}
+void CHostInfo::set_minConnectionNum(int p) { min_connection_num = p;}
+void CHostInfo::set_maxConnectionNum(int p) { max_connection_num = p;}
+void CHostInfo::set_readWeight(int w)    { read_weight = w;}
 void CHostInfo::set_passWord(const char* p) { strcpy(password, p);}
 
 
@@ -99,6 +122,12 @@ CGroupInfo::CGroupInfo()
     m_weight = 1;
     m_hashMin = 0;
     m_hashMax = 0;
+    m_compressThreshold = 0;
+    m_readYourWrites = 0;
+    m_hedgeDelay = 0;
+    m_hedgePercentile = 0;
+    m_hedgeBudget = 10;
+    m_requestTimeout = 0;
 }
 
 CGroupInfo::~CGroupInfo() {}
@@ -111,6 +140,34 @@ CRedisProxyCfg::CRedisProxyCfg() {
     memset(m_vip.if_alias_name, '\0', sizeof(m_vip.if_alias_name));
     memset(m_vip.vip_address, '\0', sizeof(m_vip.vip_address));
     m_vip.enable = false;
+    m_hotKeyCache.enable = false;
+    m_hotKeyCache.ttl = 1000;
+    m_hotKeyCache.max_memory = 64;
+    m_hotKeyCache.admit_hits = 2;
+    m_hotKeyCache.tracking = false;
+    m_hotKeyCache.fallback_ttl = 100;
+    m_hotKeyCache.negative_ttl = 0;
+    m_hotKeyCache.negative_max_memory = 8;
+    m_missRatio.enable = false;
+    m_missRatio.sample_rate = 0.01;
+    m_missRatio.max_keys = 16384;
+    m_singleFlight.enable = false;
+    m_singleFlight.commands.push_back("GET");
+    m_singleFlight.commands.push_back("HGET");
+    m_singleFlight.commands.push_back("HGETALL");
+    m_counterCoalesce.enable = false;
+    m_counterCoalesce.window = 5;
+    m_counterCoalesce.max_ops = 1000;
+    m_hotKeyReplication.automatic = false;
+    m_hotKeyReplication.replicas = 2;
+    m_hotKeyReplication.min_reads = 10000;
+    m_hotKeyReplication.interval = 10;
+    m_hotKeyReplication.max_keys = 16;
+    m_warmStart.enable = false;
+    m_warmStart.file = "onecache.warm";
+    m_warmStart.interval = 60;
+    m_warmStart.max_keys = 1000;
+    m_warmStart.batch_size = 100;
     memset(m_logFile, '\0', sizeof(m_logFile));
     memset(m_pidFile, '\0', sizeof(m_pidFile));
     m_daemonize = false;
@@ -187,6 +244,30 @@ void CRedisProxyCfg::set_groupAttribute(TiXmlAttribute *groupAttr, CGroupInfo& p
             memcpy(pGroup.m_groupPolicy, value, strlen(value)+1);
             continue;
         }
+        if (0 == strcasecmp(name, "compress_threshold")) {
+            pGroup.m_compressThreshold = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "read_your_writes")) {
+            pGroup.m_readYourWrites = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "hedge_delay")) {
+            pGroup.m_hedgeDelay = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "hedge_percentile")) {
+            pGroup.m_hedgePercentile = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "hedge_budget")) {
+            pGroup.m_hedgeBudget = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "request_timeout")) {
+            pGroup.m_requestTimeout = atoi(value);
+            continue;
+        }
     }
 }
 
@@ -205,10 +286,27 @@ void CRedisProxyCfg::set_hostAttribute(TiXmlAttribute *addrAttr, CHostInfo& pHos
             pHostInfo.set_ip(s);
             continue;
         }
+        if (0 == strcasecmp(name, "path")) {
+            string s = value;
+            pHostInfo.set_path(s);
+            continue;
+        }
         if (0 == strcasecmp(name, "connection_num")) {
             pHostInfo.set_connectionNum(atoi(value));
             continue;
         }
+        if (0 == strcasecmp(name, "min_connection_num")) {
+            pHostInfo.set_minConnectionNum(atoi(value));
+            continue;
+        }
+        if (0 == strcasecmp(name, "max_connection_num")) {
+            pHostInfo.set_maxConnectionNum(atoi(value));
+            continue;
+        }
+        if (0 == strcasecmp(name, "read_weight")) {
+            pHostInfo.set_readWeight(atoi(value));
+            continue;
+        }
         if (0 == strcasecmp(name, "port")) {
             pHostInfo.set_port(atoi(value));
             continue;
@@ -247,11 +345,28 @@ void CRedisProxyCfg::set_hostEle(TiXmlElement* hostContactEle, CHostInfo& hostIn
             hostInfo.set_ip(s);
             continue;
         }
+        if (0 == strcasecmp(strValue, "path")) {
+            string s = strText;
+            hostInfo.set_path(s);
+            continue;
+        }
         if (0 == strcasecmp(strValue, "connection_num")) {
             if (hostContactEle->GetText() != NULL)
                 hostInfo.set_connectionNum(atoi(strText));
             continue;
         }
+        if (0 == strcasecmp(strValue, "min_connection_num")) {
+            hostInfo.set_minConnectionNum(atoi(strText));
+            continue;
+        }
+        if (0 == strcasecmp(strValue, "max_connection_num")) {
+            hostInfo.set_maxConnectionNum(atoi(strText));
+            continue;
+        }
+        if (0 == strcasecmp(strValue, "read_weight")) {
+            hostInfo.set_readWeight(atoi(strText));
+            continue;
+        }
         if (0 == strcasecmp(strValue, "port")) {
             hostInfo.set_port(atoi(strText));
             continue;
@@ -306,6 +421,10 @@ void CRedisProxyCfg::getRootAttr(const TiXmlElement* pRootNode) {
             strcpy(m_pidFile, value);
             continue;
         }
+        if (0 == strcasecmp(name, "unix_socket")) {
+            m_unixSocket = value;
+            continue;
+        }
         if (0 == strcasecmp(name, "password")) {
             m_password = value;
             continue;
@@ -314,6 +433,10 @@ void CRedisProxyCfg::getRootAttr(const TiXmlElement* pRootNode) {
             m_hashFunction = value;
             continue;
         }
+        if (0 == strcasecmp(name, "hash_tag")) {
+            m_hashTag = value;
+            continue;
+        }
         if (0 == strcasecmp(name, "daemonize")) {
             if(strcasecmp(value, "0") != 0 && strcasecmp(value, "") != 0 ) {
                 m_daemonize = true;
@@ -363,6 +486,198 @@ void CRedisProxyCfg::getVipAttr(const TiXmlElement* vidNode) {
     }
 }
 
+void CRedisProxyCfg::getHotKeyCacheAttr(const TiXmlElement* pNode) {
+    TiXmlAttribute *addrAttr = (TiXmlAttribute *)pNode->FirstAttribute();
+    for (; addrAttr != NULL; addrAttr = addrAttr->Next()) {
+        const char* name = addrAttr->Name();
+        const char* value = addrAttr->Value();
+        if (value == NULL) value = "";
+        if (0 == strcasecmp(name, "ttl")) {
+            m_hotKeyCache.ttl = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "max_memory")) {
+            m_hotKeyCache.max_memory = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "admit_hits")) {
+            m_hotKeyCache.admit_hits = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "fallback_ttl")) {
+            m_hotKeyCache.fallback_ttl = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "negative_ttl")) {
+            m_hotKeyCache.negative_ttl = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "negative_max_memory")) {
+            m_hotKeyCache.negative_max_memory = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "tracking")) {
+            if(strcasecmp(value, "0") != 0 && strcasecmp(value, "") != 0 ) {
+                m_hotKeyCache.tracking = true;
+            }
+            continue;
+        }
+        if (0 == strcasecmp(name, "enable")) {
+            if(strcasecmp(value, "0") != 0 && strcasecmp(value, "") != 0 ) {
+                m_hotKeyCache.enable = true;
+            }
+        }
+    }
+}
+
+void CRedisProxyCfg::getMissRatioAttr(const TiXmlElement* pNode) {
+    TiXmlAttribute *addrAttr = (TiXmlAttribute *)pNode->FirstAttribute();
+    for (; addrAttr != NULL; addrAttr = addrAttr->Next()) {
+        const char* name = addrAttr->Name();
+        const char* value = addrAttr->Value();
+        if (value == NULL) value = "";
+        if (0 == strcasecmp(name, "sample_rate")) {
+            m_missRatio.sample_rate = atof(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "max_keys")) {
+            m_missRatio.max_keys = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "enable")) {
+            if(strcasecmp(value, "0") != 0 && strcasecmp(value, "") != 0 ) {
+                m_missRatio.enable = true;
+            }
+        }
+    }
+}
+
+void CRedisProxyCfg::getSingleFlightAttr(const TiXmlElement* pNode) {
+    TiXmlAttribute *addrAttr = (TiXmlAttribute *)pNode->FirstAttribute();
+    for (; addrAttr != NULL; addrAttr = addrAttr->Next()) {
+        const char* name = addrAttr->Name();
+        const char* value = addrAttr->Value();
+        if (value == NULL) value = "";
+        if (0 == strcasecmp(name, "commands")) {
+            // comma separated command names
+            m_singleFlight.commands.clear();
+            string cmd;
+            for (const char* p = value; ; ++p) {
+                if (*p == ',' || *p == '\0') {
+                    if (!cmd.empty()) m_singleFlight.commands.push_back(cmd);
+                    cmd.clear();
+                    if (*p == '\0') break;
+                } else if (*p != ' ') {
+                    cmd += toupper(*p);
+                }
+            }
+            continue;
+        }
+        if (0 == strcasecmp(name, "enable")) {
+            if(strcasecmp(value, "0") != 0 && strcasecmp(value, "") != 0 ) {
+                m_singleFlight.enable = true;
+            }
+        }
+    }
+}
+
+void CRedisProxyCfg::getCounterCoalesceAttr(const TiXmlElement* pNode) {
+    TiXmlAttribute *addrAttr = (TiXmlAttribute *)pNode->FirstAttribute();
+    for (; addrAttr != NULL; addrAttr = addrAttr->Next()) {
+        const char* name = addrAttr->Name();
+        const char* value = addrAttr->Value();
+        if (value == NULL) value = "";
+        if (0 == strcasecmp(name, "window")) {
+            m_counterCoalesce.window = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "max_ops")) {
+            m_counterCoalesce.max_ops = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "prefixes")) {
+            // comma separated key prefixes
+            m_counterCoalesce.prefixes.clear();
+            string prefix;
+            for (const char* p = value; ; ++p) {
+                if (*p == ',' || *p == '\0') {
+                    if (!prefix.empty()) m_counterCoalesce.prefixes.push_back(prefix);
+                    prefix.clear();
+                    if (*p == '\0') break;
+                } else if (*p != ' ') {
+                    prefix += *p;
+                }
+            }
+            continue;
+        }
+        if (0 == strcasecmp(name, "enable")) {
+            if(strcasecmp(value, "0") != 0 && strcasecmp(value, "") != 0 ) {
+                m_counterCoalesce.enable = true;
+            }
+        }
+    }
+}
+
+void CRedisProxyCfg::getHotKeyReplicationAttr(const TiXmlElement* pNode) {
+    TiXmlAttribute *addrAttr = (TiXmlAttribute *)pNode->FirstAttribute();
+    for (; addrAttr != NULL; addrAttr = addrAttr->Next()) {
+        const char* name = addrAttr->Name();
+        const char* value = addrAttr->Value();
+        if (value == NULL) value = "";
+        if (0 == strcasecmp(name, "replicas")) {
+            m_hotKeyReplication.replicas = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "min_reads")) {
+            m_hotKeyReplication.min_reads = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "interval")) {
+            m_hotKeyReplication.interval = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "max_keys")) {
+            m_hotKeyReplication.max_keys = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "auto")) {
+            if(strcasecmp(value, "0") != 0 && strcasecmp(value, "") != 0 ) {
+                m_hotKeyReplication.automatic = true;
+            }
+        }
+    }
+}
+
+void CRedisProxyCfg::getWarmStartAttr(const TiXmlElement* pNode) {
+    TiXmlAttribute *addrAttr = (TiXmlAttribute *)pNode->FirstAttribute();
+    for (; addrAttr != NULL; addrAttr = addrAttr->Next()) {
+        const char* name = addrAttr->Name();
+        const char* value = addrAttr->Value();
+        if (value == NULL) value = "";
+        if (0 == strcasecmp(name, "file")) {
+            m_warmStart.file = value;
+            continue;
+        }
+        if (0 == strcasecmp(name, "interval")) {
+            m_warmStart.interval = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "max_keys")) {
+            m_warmStart.max_keys = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "batch_size")) {
+            m_warmStart.batch_size = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "enable")) {
+            if(strcasecmp(value, "0") != 0 && strcasecmp(value, "") != 0 ) {
+                m_warmStart.enable = true;
+            }
+        }
+    }
+}
+
 void CRedisProxyCfg::setHashMappingNode(TiXmlElement* pNode) {
     TiXmlElement* pNext = pNode->FirstChildElement();
     for (; pNext != NULL; pNext = pNext->NextSiblingElement()) {
@@ -405,6 +720,54 @@ void CRedisProxyCfg::setGroupOption(const TiXmlElement* vidNode) {
             m_groupOption.group_retry_time = atoi(value);
             continue;
         }
+        if (0 == strcasecmp(name, "blocking_connection_num")) {
+            m_groupOption.blocking_connection_num = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "blocking_timeout")) {
+            m_groupOption.blocking_timeout = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "max_queue")) {
+            m_groupOption.max_queue = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "max_queue_wait")) {
+            m_groupOption.max_queue_wait = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "max_queued_bytes")) {
+            m_groupOption.max_queued_bytes = atoll(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "max_scripts")) {
+            m_groupOption.max_scripts = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "pool_idle_timeout")) {
+            m_groupOption.pool_idle_timeout = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "pool_grow_wait")) {
+            m_groupOption.pool_grow_wait = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "breaker_errors")) {
+            m_groupOption.breaker_errors = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "breaker_error_rate")) {
+            m_groupOption.breaker_error_rate = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "breaker_open_time")) {
+            m_groupOption.breaker_open_time = atoi(value);
+            continue;
+        }
+        if (0 == strcasecmp(name, "breaker_probes")) {
+            m_groupOption.breaker_probes = atoi(value);
+            continue;
+        }
 
         if (0 == strcasecmp(name, "auto_eject_group")) {
             if(strcasecmp(value, "0") != 0 && strcasecmp(value, "") != 0 ) {
@@ -599,6 +962,36 @@ bool CRedisProxyCfg::loadCfg(const char* file) {
             continue;
         }
 
+        if (0 == strcasecmp(pNode->Value(), "hot_key_cache")) {
+            getHotKeyCacheAttr(pNode);
+            continue;
+        }
+
+        if (0 == strcasecmp(pNode->Value(), "miss_ratio_curve")) {
+            getMissRatioAttr(pNode);
+            continue;
+        }
+
+        if (0 == strcasecmp(pNode->Value(), "single_flight")) {
+            getSingleFlightAttr(pNode);
+            continue;
+        }
+
+        if (0 == strcasecmp(pNode->Value(), "counter_coalesce")) {
+            getCounterCoalesceAttr(pNode);
+            continue;
+        }
+
+        if (0 == strcasecmp(pNode->Value(), "hot_key_replication")) {
+            getHotKeyReplicationAttr(pNode);
+            continue;
+        }
+
+        if (0 == strcasecmp(pNode->Value(), "warm_start")) {
+            getWarmStartAttr(pNode);
+            continue;
+        }
+
         if (0 == strcasecmp(pNode->Value(), "hash")) {
             TiXmlElement* pNext = pNode->FirstChildElement();
             if (NULL == pNext) continue;
@@ -657,6 +1050,16 @@ bool CRedisProxyCfgChecker::isValid(CRedisProxyCfg* pCfg, const char*& errMsg)
         return false;
     }
 
+    if (!pCfg->hashTag().empty() && pCfg->hashTag().length() != 2) {
+        errMsg = "hash_tag should be two characters, such as {}";
+        return false;
+    }
+
+    if (pCfg->unixSocket().length() > HostAddress::MaxPathLength) {
+        errMsg = "onecache's unix_socket path is too long";
+        return false;
+    }
+
     bool barray[REDIS_PROXY_HASH_MAX] = {0};
     string groupNameBuf[512];
     int groupCnt_ = pCfg->groupCnt();
@@ -672,9 +1075,55 @@ bool CRedisProxyCfgChecker::isValid(CRedisProxyCfg* pCfg, const char*& errMsg)
         }
         if (!empty) {
             if (0 != strcasecmp(group->groupPolicy(), POLICY_READ_BALANCE) &&
-                0 != strcasecmp(group->groupPolicy(), POLICY_MASTER_ONLY))
+                0 != strcasecmp(group->groupPolicy(), POLICY_MASTER_ONLY) &&
+                0 != strcasecmp(group->groupPolicy(), POLICY_LATENCY_AWARE) &&
+                0 != strcasecmp(group->groupPolicy(), POLICY_LEAST_OUTSTANDING))
             {
-                errMsg = "group's policy is wrong, it should be  read_balance or master_only";
+                errMsg = "group's policy is wrong, it should be  read_balance, master_only, latency_aware or least_outstanding";
+                return false;
+            }
+        }
+
+        if (group->compressThreshold() < 0) {
+            errMsg = "group's compress_threshold can't be negative";
+            return false;
+        }
+
+        if (group->readYourWrites() < 0) {
+            errMsg = "group's read_your_writes can't be negative";
+            return false;
+        }
+
+        if (group->hedgeDelay() < 0) {
+            errMsg = "group's hedge_delay can't be negative";
+            return false;
+        }
+        if (group->hedgePercentile() < 0 || group->hedgePercentile() >= 100) {
+            errMsg = "group's hedge_percentile should be between 0 and 99";
+            return false;
+        }
+        if (group->hedgeBudget() < 0 || group->hedgeBudget() > 100) {
+            errMsg = "group's hedge_budget should be between 0 and 100";
+            return false;
+        }
+        if (group->requestTimeout() < 0) {
+            errMsg = "group's request_timeout can't be negative";
+            return false;
+        }
+
+        const HostInfoList& hosts = group->hosts();
+        for (HostInfoList::const_iterator it = hosts.begin(); it != hosts.end(); ++it) {
+            if (it->get_readWeight() < 0) {
+                errMsg = "host's read_weight can't be negative";
+                return false;
+            }
+            if (it->get_path().length() > HostAddress::MaxPathLength) {
+                errMsg = "host's path is too long";
+                return false;
+            }
+            if (it->get_minConnectionNum() > it->get_connectionNum() ||
+                it->get_maxConnectionNum() < it->get_connectionNum()) {
+                errMsg = "host's connection_num should be between min_connection_num and max_connection_num";
                 return false;
             }
         }
@@ -729,6 +1178,46 @@ bool CRedisProxyCfgChecker::isValid(CRedisProxyCfg* pCfg, const char*& errMsg)
         return false;
     }
 
+    if (groupOp->blocking_connection_num < 0) {
+        errMsg = "blocking_connection_num invalid";
+        return false;
+    }
+
+    if (groupOp->blocking_timeout < 0) {
+        errMsg = "blocking_timeout invalid";
+        return false;
+    }
+
+    if (groupOp->max_queue < 0 || groupOp->max_queue_wait < 0 || groupOp->max_queued_bytes < 0) {
+        errMsg = "max_queue, max_queue_wait and max_queued_bytes can't be negative";
+        return false;
+    }
+
+    if (groupOp->max_scripts < 0) {
+        errMsg = "max_scripts can't be negative";
+        return false;
+    }
+
+    if (groupOp->pool_idle_timeout < 0 || groupOp->pool_grow_wait < 0) {
+        errMsg = "pool_idle_timeout and pool_grow_wait can't be negative";
+        return false;
+    }
+
+    if (groupOp->breaker_errors < 0 || groupOp->breaker_open_time < 0) {
+        errMsg = "breaker_errors and breaker_open_time can't be negative";
+        return false;
+    }
+
+    if (groupOp->breaker_error_rate < 0 || groupOp->breaker_error_rate > 100) {
+        errMsg = "breaker_error_rate should be between 0 and 100";
+        return false;
+    }
+
+    if (groupOp->breaker_probes < 1) {
+        errMsg = "breaker_probes should be at least 1";
+        return false;
+    }
+
     if (groupOp->auto_eject_group) {
         if (groupOp->group_retry_time <= 0) {
             errMsg = "group_retry_time invalid";
@@ -736,6 +1225,122 @@ bool CRedisProxyCfgChecker::isValid(CRedisProxyCfg* pCfg, const char*& errMsg)
         }
     }
 
+    const SHotKeyCacheInfo* cacheInfo = pCfg->hotKeyCacheInfo();
+    if (cacheInfo->enable) {
+        if (cacheInfo->ttl <= 0) {
+            errMsg = "hot_key_cache's ttl invalid";
+            return false;
+        }
+        if (cacheInfo->max_memory <= 0) {
+            errMsg = "hot_key_cache's max_memory invalid";
+            return false;
+        }
+        if (cacheInfo->admit_hits < 0 || cacheInfo->admit_hits > 255) {
+            errMsg = "hot_key_cache's admit_hits invalid";
+            return false;
+        }
+        if (cacheInfo->tracking && cacheInfo->fallback_ttl <= 0) {
+            errMsg = "hot_key_cache's fallback_ttl invalid";
+            return false;
+        }
+        if (cacheInfo->negative_ttl < 0) {
+            errMsg = "hot_key_cache's negative_ttl invalid";
+            return false;
+        }
+        if (cacheInfo->negative_ttl > 0 && cacheInfo->negative_max_memory <= 0) {
+            errMsg = "hot_key_cache's negative_max_memory invalid";
+            return false;
+        }
+    }
+
+    const SMissRatioInfo* mrcInfo = pCfg->missRatioInfo();
+    if (mrcInfo->enable) {
+        if (mrcInfo->sample_rate <= 0 || mrcInfo->sample_rate > 1) {
+            errMsg = "miss_ratio_curve's sample_rate invalid";
+            return false;
+        }
+        if (mrcInfo->max_keys <= 0 || mrcInfo->max_keys > 1000000) {
+            errMsg = "miss_ratio_curve's max_keys invalid";
+            return false;
+        }
+    }
+
+    const SSingleFlightInfo* flightInfo = pCfg->singleFlightInfo();
+    if (flightInfo->enable) {
+        for (size_t i = 0; i < flightInfo->commands.size(); ++i) {
+            string name = flightInfo->commands[i];
+            RedisCommand* cmd = RedisCommandTable::instance()->findCommand(name.c_str(), name.size());
+            if (cmd == NULL || !HotKeyCache::isReadOnly(cmd->type) || cmd->type == RedisCommand::PUBLISH) {
+                errMsg = "single_flight's commands must be read commands";
+                return false;
+            }
+        }
+    }
+
+    const SCounterCoalesceInfo* counterInfo = pCfg->counterCoalesceInfo();
+    if (counterInfo->enable) {
+        if (counterInfo->window <= 0 || counterInfo->window > 1000) {
+            errMsg = "counter_coalesce's window invalid";
+            return false;
+        }
+        if (counterInfo->max_ops <= 0) {
+            errMsg = "counter_coalesce's max_ops invalid";
+            return false;
+        }
+        if (counterInfo->prefixes.empty()) {
+            errMsg = "counter_coalesce's prefixes cannot be empty";
+            return false;
+        }
+    }
+
+    const SHotKeyReplicationInfo* replicationInfo = pCfg->hotKeyReplicationInfo();
+    if (replicationInfo->automatic) {
+        if (replicationInfo->replicas < 2 || replicationInfo->replicas > pCfg->groupCnt()) {
+            errMsg = "hot_key_replication's replicas invalid";
+            return false;
+        }
+        if (replicationInfo->min_reads <= 0) {
+            errMsg = "hot_key_replication's min_reads invalid";
+            return false;
+        }
+        if (replicationInfo->interval <= 0) {
+            errMsg = "hot_key_replication's interval invalid";
+            return false;
+        }
+        if (replicationInfo->max_keys <= 0) {
+            errMsg = "hot_key_replication's max_keys invalid";
+            return false;
+        }
+        if (!pCfg->topKeyEnable()) {
+            errMsg = "hot_key_replication's auto needs top_key enabled";
+            return false;
+        }
+    }
+
+    const SWarmStartInfo* warmInfo = pCfg->warmStartInfo();
+    if (warmInfo->enable) {
+        if (!cacheInfo->enable) {
+            errMsg = "warm_start needs hot_key_cache enabled";
+            return false;
+        }
+        if (warmInfo->file.empty()) {
+            errMsg = "warm_start's file cannot be empty";
+            return false;
+        }
+        if (warmInfo->interval <= 0) {
+            errMsg = "warm_start's interval invalid";
+            return false;
+        }
+        if (warmInfo->max_keys <= 0) {
+            errMsg = "warm_start's max_keys invalid";
+            return false;
+        }
+        if (warmInfo->batch_size <= 0 || warmInfo->batch_size >= RedisProtoParseResult::MaxToken) {
+            errMsg = "warm_start's batch_size invalid";
+            return false;
+        }
+    }
+
     int hashMapCnt = pCfg->hashMapCnt();
     for (int i = 0; i < hashMapCnt; ++i) {
         const CHashMapping* p = pCfg->hashMapping(i);
@@ -59,30 +59,42 @@ public:
     CHostInfo();
     ~CHostInfo();
     string get_ip()const;
+    string get_path()const;
     string get_hostName()const;
     int get_port()const;
     bool get_master()const;
     int get_policy()const;
     int get_priority()const;
     int get_connectionNum()const;
+    int get_minConnectionNum()const;
+    int get_maxConnectionNum()const;
+    int get_readWeight()const;
     const string passWord()const;
 
     void set_ip(string& s);
+    void set_path(string& s);
     void set_hostName(string& s);
     void set_port(int p);
     void set_master(bool m);
     void set_policy(int p);
     void set_priority(int p);
     void set_connectionNum(int p);
+    void set_minConnectionNum(int p);
+    void set_maxConnectionNum(int p);
+    void set_readWeight(int w);
     void set_passWord(const char* p);
 private:
     string ip;
+    string path;                //Unix socket of the backend, used instead of ip and port
     string host_name;
     int port;
     bool master;
     int priority;
     int policy;
     int connection_num;
+    int min_connection_num;     //Bounds of the adaptive pool, -1 for connection_num
+    int max_connection_num;
+    int read_weight;
     char password[512];
 };
 typedef std::vector<CHostInfo> HostInfoList;
@@ -98,6 +110,51 @@ struct SVipInfo {
     bool enable;
 };
 
+struct SHotKeyCacheInfo {
+    bool enable;
+    int  ttl;           // milliseconds
+    int  max_memory;    // MB
+    int  admit_hits;
+    bool tracking;
+    int  fallback_ttl;  // milliseconds
+    int  negative_ttl;  // milliseconds, 0 to disable
+    int  negative_max_memory;   // MB
+};
+
+struct SMissRatioInfo {
+    bool   enable;
+    double sample_rate;
+    int    max_keys;
+};
+
+struct SSingleFlightInfo {
+    bool   enable;
+    std::vector<string> commands;
+};
+
+struct SCounterCoalesceInfo {
+    bool   enable;
+    int    window;      // milliseconds
+    int    max_ops;
+    std::vector<string> prefixes;
+};
+
+struct SWarmStartInfo {
+    bool   enable;
+    string file;
+    int    interval;    // seconds
+    int    max_keys;
+    int    batch_size;
+};
+
+struct SHotKeyReplicationInfo {
+    bool   automatic;   // replicate the top keys
+    int    replicas;    // groups of an automatic key
+    int    min_reads;   // requests of a key in an interval
+    int    interval;    // seconds
+    int    max_keys;
+};
+
 
 class CHashMapping {
 public:
@@ -132,6 +189,12 @@ public:
     int hashMin()const { return m_hashMin; }
     int hashMax()const { return m_hashMax; }
     unsigned int weight()const { return m_weight;}
+    int compressThreshold()const { return m_compressThreshold; }
+    int readYourWrites()const { return m_readYourWrites; }
+    int hedgeDelay()const { return m_hedgeDelay; }
+    int hedgePercentile()const { return m_hedgePercentile; }
+    int hedgeBudget()const { return m_hedgeBudget; }
+    int requestTimeout()const { return m_requestTimeout; }
     const HostInfoList& hosts() const { return m_hosts; }
     void setGroupPolicy(const char* p) {
         strcpy(m_groupPolicy, p);
@@ -143,6 +206,12 @@ private:
     int           m_hashMin;
     int           m_hashMax;
     unsigned int  m_weight;
+    int           m_compressThreshold;
+    int           m_readYourWrites;
+    int           m_hedgeDelay;
+    int           m_hedgePercentile;
+    int           m_hedgeBudget;
+    int           m_requestTimeout;
     HostInfoList  m_hosts;
     friend class CRedisProxyCfg;
 };
@@ -156,10 +225,34 @@ struct GroupOption {
         group_retry_time = 30;
         auto_eject_group = false;
         eject_after_restore = false;
+        blocking_connection_num = 10;
+        blocking_timeout = 0;
+        max_queue = 0;
+        max_queue_wait = 0;
+        max_queued_bytes = 0;
+        max_scripts = 1024;
+        pool_idle_timeout = 0;
+        pool_grow_wait = 5;
+        breaker_errors = 0;
+        breaker_error_rate = 0;
+        breaker_open_time = 1000;
+        breaker_probes = 1;
     }
     int  backend_retry_interval;
     int  backend_retry_limit;
     int  group_retry_time;
+    int  blocking_connection_num;
+    int  blocking_timeout;
+    int  max_queue;
+    int  max_queue_wait;
+    long long max_queued_bytes;
+    int  max_scripts;
+    int  pool_idle_timeout;
+    int  pool_grow_wait;
+    int  breaker_errors;
+    int  breaker_error_rate;
+    int  breaker_open_time;
+    int  breaker_probes;
     bool auto_eject_group;
     bool eject_after_restore;
 };
@@ -184,12 +277,20 @@ public:
     const SHashInfo*  hashInfo()const {return &m_hashInfo;}
     const GroupOption* groupOption()const {return &m_groupOption;}
     const SVipInfo*  vipInfo()const {return &m_vip;}
+    const SHotKeyCacheInfo* hotKeyCacheInfo()const {return &m_hotKeyCache;}
+    const SSingleFlightInfo* singleFlightInfo()const {return &m_singleFlight;}
+    const SMissRatioInfo* missRatioInfo()const {return &m_missRatio;}
+    const SCounterCoalesceInfo* counterCoalesceInfo()const {return &m_counterCoalesce;}
+    const SHotKeyReplicationInfo* hotKeyReplicationInfo()const {return &m_hotKeyReplication;}
+    const SWarmStartInfo* warmStartInfo()const {return &m_warmStart;}
     int threadNum()const {return m_threadNum;}
     int port() const {return m_port;}
     const char* logFile(){ return m_logFile; }
     const char* pidFile() const{ return m_pidFile; }
+    const string unixSocket()const { return m_unixSocket;}
     const string password()const { return m_password;}
     const string hashFunctin()const { return m_hashFunction;}
+    const string hashTag()const { return m_hashTag;}
     bool isTwemproxyMode()const {return m_isTwemproxyMode;}
     bool daemonize() { return m_daemonize;}
     bool debug() { return m_debug;}
@@ -207,12 +308,20 @@ private:
     KeyMappingList*  m_keyMappingList;
     SHashInfo        m_hashInfo;
     SVipInfo         m_vip;
+    SHotKeyCacheInfo m_hotKeyCache;
+    SSingleFlightInfo m_singleFlight;
+    SMissRatioInfo   m_missRatio;
+    SCounterCoalesceInfo m_counterCoalesce;
+    SHotKeyReplicationInfo m_hotKeyReplication;
+    SWarmStartInfo   m_warmStart;
     int              m_threadNum;
     int              m_port;
     char             m_logFile[512];
     char             m_pidFile[512];
+    string           m_unixSocket;
     string           m_password;
     string           m_hashFunction;
+    string           m_hashTag;
     bool             m_daemonize;
     bool             m_debug;
     bool             m_guard;
@@ -231,6 +340,12 @@ private:
     void set_hostEle(TiXmlElement* hostContactEle, CHostInfo& hostInfo);
     void getRootAttr(const TiXmlElement* pRootNode);
     void getVipAttr(const TiXmlElement* vidNode);
+    void getHotKeyCacheAttr(const TiXmlElement* pNode);
+    void getSingleFlightAttr(const TiXmlElement* pNode);
+    void getMissRatioAttr(const TiXmlElement* pNode);
+    void getCounterCoalesceAttr(const TiXmlElement* pNode);
+    void getHotKeyReplicationAttr(const TiXmlElement* pNode);
+    void getWarmStartAttr(const TiXmlElement* pNode);
     void getGroupNode(TiXmlElement* pNode);
     void setHashMappingNode(TiXmlElement* pNode);
     void setKeyMappingNode(TiXmlElement* pNode);
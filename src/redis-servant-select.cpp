@@ -17,6 +17,9 @@
 * under the License.
 */
 
+#include <vector>
+#include <unordered_map>
+
 #include "command.h"
 #include "redisproxy.h"
 #include "redisservant.h"
@@ -81,13 +84,15 @@ static int CommandType[RedisCommand::CMD_COUNT] = {0};
 void initCommandType()
 {
     for (int i = 0; i < RedisCommand::CMD_COUNT; ++i) {
-        // DUMP DEL DECR DECRBY EXPIREAT EXISTS EXPIRE GETSET HSET HSETNX HMSET HINCRBY
+        // BLPOP BRPOP BRPOPLPUSH DUMP DEL DECR DECRBY EXPIREAT EXISTS EXPIRE GETSET HSET HSETNX HMSET HINCRBY
         // HDEL HINCRBYFLOAT INCR INCRBY INCRBYFLOAT LPUSH LPUSHX LPOP LREM
         // LINSERT   LSET LTRIM MSET PSETEX PERSIST PEXPIRE
         // PEXPIREAT PTTL  PING RESTORE RPOP RPUSH RPUSHX SADD SREM
-        // SPOP SETBIT SETRANGE SET SETEX
+        // SPOP SETBIT SETRANGE SET SETEX SCAN EXEC WATCH EVAL EVALSHA PUBLISH
         // SETNX TTL ZADD ZREM ZINCRBY ZREMRANGEBYRANK ZREMRANGEBYSCORE
         if (RedisCommand::APPEND == i || RedisCommand::BITPOS == i
+            || RedisCommand::BLPOP == i || RedisCommand::BRPOP == i
+            || RedisCommand::BRPOPLPUSH == i
             || RedisCommand::DUMP == i || RedisCommand::DEL == i
             || RedisCommand::DECR == i || RedisCommand::DECRBY == i
             || RedisCommand::EXPIREAT == i || RedisCommand::EXISTS == i
@@ -109,6 +114,9 @@ void initCommandType()
             || RedisCommand::SREM == i || RedisCommand::SPOP == i
             || RedisCommand::SETBIT == i || RedisCommand::SETRANGE == i
             || RedisCommand::SET == i || RedisCommand::SETEX == i
+            || RedisCommand::SCAN == i || RedisCommand::EXEC == i
+            || RedisCommand::WATCH == i || RedisCommand::EVAL == i
+            || RedisCommand::EVALSHA == i || RedisCommand::PUBLISH == i
             || RedisCommand::SETNX == i || RedisCommand::TTL == i
             || RedisCommand::ZADD == i || RedisCommand::ZREM == i
             || RedisCommand::ZINCRBY == i || RedisCommand::ZREMRANGEBYRANK == i
@@ -130,26 +138,76 @@ public:
 
 static CommandTypeInit init;
 
-ReadBalancePolicy::ReadBalancePolicy(void) {
-    m_readCnt = 0;
+static bool isWrite(ClientPacket* packet)
+{
+    if (packet->commandType < 0 || packet->commandType >= RedisCommand::CMD_COUNT) {
+        return true;
+    }
+    return 1 == CommandType[packet->commandType];
 }
 
+// current weights of the smooth weighted round-robin, per thread and
+// group, in the order of the masters then the slaves
+typedef std::unordered_map<const RedisServantGroup*, std::vector<int> > CurrentWeights;
+static __thread CurrentWeights* t_currentWeights = NULL;
+
+// reads picked by the thread, rotates the choices of the policies
+// without a counter shared by the client threads
+static __thread unsigned int t_readCount = 0;
+
+ReadBalancePolicy::ReadBalancePolicy(void) {}
+
 ReadBalancePolicy::~ReadBalancePolicy(void) {}
 
 
 RedisServant* ReadBalancePolicy::selectServant(RedisServantGroup* group, ClientPacket* packet)
 {
-    if (packet->commandType < 0 || packet->commandType >= RedisCommand::CMD_COUNT) {
+    if (isWrite(packet) || group->readsOwnWrite(packet)) {
         return m_servantSelect.selectMaster(group);
     }
-    if (1 == CommandType[packet->commandType]) {
+
+    RedisServant* servant = weightedServant(group);
+    if (servant == NULL) {
         return m_servantSelect.selectMaster(group);
     }
+    return servant;
+}
 
-    if (0 == (++m_readCnt % 2)){
-        return m_servantSelect.selectSlave(group);
+// nginx's smooth weighted round-robin: every servant gains its weight,
+// the one with the most is picked and loses the total. The picks of a
+// servant are spread evenly instead of coming in a row
+RedisServant* ReadBalancePolicy::weightedServant(RedisServantGroup* group)
+{
+    if (t_currentWeights == NULL) {
+        t_currentWeights = new CurrentWeights;
     }
-    return m_servantSelect.selectMaster(group);
+    int count = group->masterCount() + group->slaveCount();
+    std::vector<int>& current = (*t_currentWeights)[group];
+    if ((int)current.size() != count) {
+        current.assign(count, 0);
+    }
+
+    RedisServant* best = NULL;
+    int bestIndex = -1;
+    int total = 0;
+    for (int i = 0; i < count; ++i) {
+        RedisServant* servant = (i < group->masterCount()) ?
+            group->master(i) : group->slave(i - group->masterCount());
+        int weight = servant->readWeight();
+        if (weight <= 0 || !servant->isActived()) {
+            continue;
+        }
+        current[i] += weight;
+        total += weight;
+        if (best == NULL || current[i] > current[bestIndex]) {
+            best = servant;
+            bestIndex = i;
+        }
+    }
+    if (best != NULL) {
+        current[bestIndex] -= total;
+    }
+    return best;
 }
 
 RedisServant* MasterOnlyPolicy::selectServant(RedisServantGroup* group, ClientPacket*)
@@ -157,5 +215,79 @@ RedisServant* MasterOnlyPolicy::selectServant(RedisServantGroup* group, ClientPa
     return m_servantSelect.selectMaster(group);
 }
 
+LatencyAwarePolicy::LatencyAwarePolicy(void) {}
+
+LatencyAwarePolicy::~LatencyAwarePolicy(void) {}
+
+RedisServant* LatencyAwarePolicy::selectServant(RedisServantGroup* group, ClientPacket* packet)
+{
+    if (isWrite(packet) || group->readsOwnWrite(packet)) {
+        return m_servantSelect.selectMaster(group);
+    }
+
+    int count = group->masterCount() + group->slaveCount();
+    if (count < 2) {
+        return m_servantSelect.selectMaster(group);
+    }
+
+    // power of two choices: a cheap pick that still avoids the slow ones
+    unsigned int r = (++t_readCount) * 2654435761U;
+    int a = r % count;
+    int b = (a + 1 + (r >> 16) % (count - 1)) % count;
+    RedisServant* first = activeServant(group, a);
+    RedisServant* second = activeServant(group, b);
+    if (first == NULL || second == NULL) {
+        return (first != NULL) ? first : second;
+    }
+    return (second->load() < first->load()) ? second : first;
+}
+
+// the servant at the index among the masters then the slaves, or the
+// next active one
+RedisServant* LatencyAwarePolicy::activeServant(RedisServantGroup* group, int index)
+{
+    int count = group->masterCount() + group->slaveCount();
+    for (int i = 0; i < count; ++i) {
+        int n = (index + i) % count;
+        RedisServant* servant = (n < group->masterCount()) ?
+            group->master(n) : group->slave(n - group->masterCount());
+        if (servant->isActived()) {
+            return servant;
+        }
+    }
+    return NULL;
+}
+
+LeastOutstandingPolicy::LeastOutstandingPolicy(void) {}
+
+LeastOutstandingPolicy::~LeastOutstandingPolicy(void) {}
+
+RedisServant* LeastOutstandingPolicy::selectServant(RedisServantGroup* group, ClientPacket* packet)
+{
+    if (isWrite(packet) || group->readsOwnWrite(packet)) {
+        return m_servantSelect.selectMaster(group);
+    }
+
+    // the scan starts at a rotating servant so the ties are spread
+    int count = group->masterCount() + group->slaveCount();
+    unsigned int start = ++t_readCount;
+    RedisServant* best = NULL;
+    int bestInFlight = 0;
+    for (int i = 0; i < count; ++i) {
+        int n = (start + i) % count;
+        RedisServant* servant = (n < group->masterCount()) ?
+            group->master(n) : group->slave(n - group->masterCount());
+        if (!servant->isActived()) {
+            continue;
+        }
+        int inFlight = servant->inFlight();
+        if (best == NULL || inFlight < bestInFlight) {
+            best = servant;
+            bestInFlight = inFlight;
+        }
+    }
+    return best;
+}
+
 
 
@@ -24,6 +24,8 @@
 
 #define POLICY_READ_BALANCE "read_balance"
 #define POLICY_MASTER_ONLY  "master_only"
+#define POLICY_LATENCY_AWARE "latency_aware"
+#define POLICY_LEAST_OUTSTANDING "least_outstanding"
 
 class ServantSelect
 {
@@ -41,15 +43,18 @@ private:
 };
 
 
+//Reads are spread over the masters and slaves by their read_weight with
+//a smooth weighted round-robin. Each thread keeps its own current weights
 class ReadBalancePolicy : public RedisServantGroupPolicy
 {
 public:
     ReadBalancePolicy(void);
     ~ReadBalancePolicy(void);
     virtual RedisServant* selectServant(RedisServantGroup* g, ClientPacket* p);
+private:
+    RedisServant* weightedServant(RedisServantGroup* g);
 private:
     ServantSelect m_servantSelect;
-    unsigned int  m_readCnt;
 };
 
 
@@ -64,6 +69,34 @@ private:
 };
 
 
+//Reads go to the better of two random servants, masters or slaves,
+//by reply latency times the requests in flight
+class LatencyAwarePolicy : public RedisServantGroupPolicy
+{
+public:
+    LatencyAwarePolicy(void);
+    ~LatencyAwarePolicy(void);
+    virtual RedisServant* selectServant(RedisServantGroup* g, ClientPacket* p);
+private:
+    RedisServant* activeServant(RedisServantGroup* g, int index);
+private:
+    ServantSelect m_servantSelect;
+};
+
+
+//Reads go to the servant, master or slave, with the fewest requests
+//queued or on a connection
+class LeastOutstandingPolicy : public RedisServantGroupPolicy
+{
+public:
+    LeastOutstandingPolicy(void);
+    ~LeastOutstandingPolicy(void);
+    virtual RedisServant* selectServant(RedisServantGroup* g, ClientPacket* p);
+private:
+    ServantSelect m_servantSelect;
+};
+
+
 
 #endif
 
@@ -60,15 +60,11 @@ static int readTextEndByCRLF(char* s, int len, int* stringlen)
         return READ_ERROR;
     }
 
-    if (s[pos] != '\r') {
+    if (pos + 1 >= len) {
         return READ_AGAIN;
-    } else {
-        if (pos < len) {
-            ++pos;
-            return (s[pos] == '\n') ? pos + 1 : READ_ERROR;
-        }
     }
-    return READ_AGAIN;
+    ++pos;
+    return (s[pos] == '\n') ? pos + 1 : READ_ERROR;
 }
 
 
@@ -91,15 +87,11 @@ static int readNumberLine(char* s, int len, int* num)
     }
     *num *= signed_num;
 
-    if (s[pos] != '\r') {
+    if (pos + 1 >= len) {
         return READ_AGAIN;
-    } else {
-        if (pos < len) {
-            ++pos;
-            return (s[pos] == '\n') ? pos + 1 : READ_ERROR;
-        }
     }
-    return READ_AGAIN;
+    ++pos;
+    return (s[pos] == '\n') ? pos + 1 : READ_ERROR;
 }
 
 static int readBulk(char* s, int len, Token* tok)
@@ -118,12 +110,14 @@ static int readBulk(char* s, int len, Token* tok)
         }
 
         pos += ret;
+        if (stringlen < 0) {
+            //Nil bulk
+            tok->s = NULL;
+            tok->len = -1;
+            return pos;
+        }
         if (pos == len) {
-            if (stringlen <= 0) {
-                return pos;
-            } else {
-                return READ_AGAIN;
-            }
+            return READ_AGAIN;
         }
 
         str = s + pos;
@@ -140,6 +134,8 @@ static int readBulk(char* s, int len, Token* tok)
     }
 }
 
+static int readElement(char* s, int len, Token* tok);
+
 static int readMultiBulk(char* s, int len, Token* toks, int* cnt)
 {
     int pos = 0;
@@ -155,9 +151,15 @@ static int readMultiBulk(char* s, int len, Token* toks, int* cnt)
             return ret;
         }
         pos += ret;
+        if (argc <= 0) {
+            //Nil or empty multi bulk
+            *cnt = argc;
+            return pos;
+        }
         while (pos < len && (lines != argc)) {
-            Token* tok = toks + lines;
-            ret = readBulk(s + pos, len - pos, tok);
+            Token dummy;
+            Token* tok = (toks != NULL && lines < RedisProtoParseResult::MaxToken) ? toks + lines : &dummy;
+            ret = readElement(s + pos, len - pos, tok);
             if (ret < 0) {
                 return ret;
             }
@@ -239,6 +241,44 @@ static int readInteger(char* s, int len, int* num)
 }
 
 
+static int readElement(char* s, int len, Token* tok)
+{
+    int ret = READ_ERROR;
+    switch (s[0]) {
+    case '$':
+        ret = readBulk(s, len, tok);
+        break;
+    case '+':
+        ret = readStatus(s, len, tok);
+        break;
+    case '-':
+        ret = readError(s, len, tok);
+        break;
+    case ':': {
+        int num = 0;
+        ret = readInteger(s, len, &num);
+        if (ret > 0) {
+            tok->s = s + 1;
+            tok->len = ret - 3;
+        }
+        break;
+    }
+    case '*': {
+        //Nested multi bulk: the token covers the whole raw reply
+        int cnt = 0;
+        ret = readMultiBulk(s, len, NULL, &cnt);
+        if (ret > 0) {
+            tok->s = s;
+            tok->len = ret;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    return ret;
+}
+
 
 RedisProto::RedisProto(void)
 {
@@ -274,6 +314,9 @@ void RedisProto::outputProtoString(const char* s, int len)
 RedisProto::ParseState RedisProto::parse(char *s, int len, RedisProtoParseResult *result)
 {
     int ret = 0;
+    if (len <= 0) {
+        return ProtoIncomplete;
+    }
     switch (s[0]) {
     case '+':
         result->type = RedisProtoParseResult::Status;
@@ -293,7 +336,15 @@ RedisProto::ParseState RedisProto::parse(char *s, int len, RedisProtoParseResult
         break;
     case '*':
         result->type = RedisProtoParseResult::MultiBulk;
-        ret = readMultiBulk(s, len, result->tokens, &result->tokenCount);
+        ret = readMultiBulk(s, len, result->tokens, &result->integer);
+        if (ret > 0) {
+            result->tokenCount = result->integer;
+            if (result->tokenCount > RedisProtoParseResult::MaxToken) {
+                result->tokenCount = RedisProtoParseResult::MaxToken;
+            } else if (result->tokenCount < 0) {
+                result->tokenCount = 0;
+            }
+        }
         break;
     default: {
         int stringlen = 0;
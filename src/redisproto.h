@@ -51,8 +51,9 @@ public:
     char* protoBuff;
     int protoBuffLen;
     int type;
-    int integer;
-    Token tokens[MaxToken];
+    int integer;            //Integer reply, or element count of a multi bulk
+    Token tokens[MaxToken]; //At most MaxToken elements are kept, the
+                            //proxy refuses longer client requests
     int tokenCount;
 };
 
@@ -17,6 +17,7 @@
 * under the License.
 */
 
+#include "util/clock.h"
 #include "util/logger.h"
 #include "command.h"
 #include "cmdhandler.h"
@@ -24,6 +25,7 @@
 #include "redisservant.h"
 #include "redisproxy.h"
 #include "redis-proxy-config.h"
+#include "compressor.h"
 
 ClientPacket::ClientPacket(void)
 {
@@ -34,17 +36,59 @@ ClientPacket::ClientPacket(void)
     sendToRedisBytes = 0;
     requestServant = NULL;
     redisSocket = NULL;
+    keepRedisSocket = false;
+    redisTimeout = -1;
+    redisReplyCount = 1;
+    transaction = NULL;
+    subscriber = NULL;
+    flight = NULL;
+    decompressOffset = -1;
+    session = this;
+    lastWriteTime = 0;
+    servantStartTime = 0;
+    servantSent = false;
+    queuedTime = 0;
+    paused = false;
     auth = false;
     finished_func = defaultFinishedHandler;
 }
 
 ClientPacket::~ClientPacket(void)
 {
+    TimerWheel::cancel(&redisTimer);
 }
 
 void ClientPacket::setFinishedState(ClientPacket::State state)
 {
     finishedState = state;
+    if (redisTimer.isActive()) {
+        TimerWheel::cancel(&redisTimer);
+    }
+    if (servantStartTime > 0) {
+        long long startTime = servantStartTime;
+        servantStartTime = 0;
+        requestServant->requestFinished(startTime, servantSent);
+        servantSent = false;
+    }
+    if (decompressOffset >= 0) {
+        if (state == RequestFinished) {
+            ValueCompressor::decompressReply(this, decompressOffset);
+        }
+        decompressOffset = -1;
+    }
+    if (!compressedRequest.empty()) {
+        std::string().swap(compressedRequest);
+    }
+    if (cacheTicket.cache) {
+        HotKeyCache* cache = cacheTicket.cache;
+        cacheTicket.cache = NULL;
+        cache->requestFinished(this);
+    }
+    if (flight) {
+        RequestFlight* f = flight;
+        flight = NULL;
+        f->servant->flightFinished(this, f);
+    }
     finished_func(this, finished_arg);
 }
 
@@ -106,6 +150,7 @@ RedisProxy::RedisProxy(void)
 {
     m_monitor = &dummy;
     m_hashFunc = hashForBytes;
+    m_hashTag[0] = 0;
     m_slotCount = 0;
     m_slots = NULL;
     m_vipAddress[0] = 0;
@@ -114,8 +159,15 @@ RedisProxy::RedisProxy(void)
     m_groupRetryTime = 30;
     m_autoEjectGroup = false;
     m_ejectAfterRestoreEnabled = false;
+    m_maxQueuedBytes = 0;
+    m_maxScripts = DefaultMaxScripts;
+    m_pausedClients = 0;
+    m_readYourWrites = false;
     m_threadPoolRefCount = 0;
     m_proxyManager.setProxy(this);
+    m_pubsub.setProxy(this);
+    m_hotKeyReplicas.setProxy(this);
+    m_warmStart.setProxy(this);
     m_twemproxyMode = false;
 }
 
@@ -156,6 +208,11 @@ bool RedisProxy::run(const HostAddress& addr)
         {"DELKEYMAPPING", 13, -1, onDelKeyMapping, NULL},
         {"SHOWMAPPING", 11, -1, onShowMapping, NULL},
         {"POOLINFO", 8, -1, onPoolInfo, NULL},
+        {"HOTKEYCACHE", 11, -1, onHotKeyCache, NULL},
+        {"SINGLEFLIGHT", 12, -1, onSingleFlight, NULL},
+        {"COUNTERCOALESCE", 15, -1, onCounterCoalesce, NULL},
+        {"WARMSTART", 9, -1, onWarmStart, NULL},
+        {"HEDGE", 5, -1, onHedge, NULL},
         {"SHUTDOWN", 8, -1, onShutDown, this}
     };
     RedisCommandTable::instance()->registerCommand(cmds, sizeof(cmds)/sizeof(RedisCommand));
@@ -163,9 +220,39 @@ bool RedisProxy::run(const HostAddress& addr)
     return TcpServer::run(addr);
 }
 
+bool RedisProxy::runUnixListener(const char* path)
+{
+    if (!isRunning() || !m_unixSocket.isNull()) {
+        return false;
+    }
+
+    TcpSocket sock = NonPortable::createUnixSocketFile(path);
+    if (sock.isNull()) {
+        LOG(Logger::Error, "RedisProxy::runUnixListener: listen failed at %s: %s",
+            path, strerror(errno));
+        return false;
+    }
+    sock.setNonBlocking();
+
+    //The clients are accepted by the handler of the tcp listener
+    m_unixListener.set(eventLoop(), sock.socket(), EV_READ | EV_PERSIST, onAcceptHandler, (TcpServer*)this);
+    m_unixListener.active();
+    m_unixSocket = sock;
+    m_unixPath = path;
+    LOG(Logger::Message, "Listen on unix socket %s", path);
+    return true;
+}
+
 void RedisProxy::stop(void)
 {
     TcpServer::stop();
+    if (!m_unixSocket.isNull()) {
+        m_unixListener.remove();
+        m_unixSocket.close();
+#ifndef WIN32
+        unlink(m_unixPath.c_str());
+#endif
+    }
     if (m_vipEnabled) {
         if (!m_vipSocket.isNull()) {
             LOG(Logger::Message, "Delete VIP address...");
@@ -183,6 +270,9 @@ void RedisProxy::addRedisGroup(RedisServantGroup *group)
     if (group) {
         group->setGroupId(m_groups.size());
         m_groups.append(group);
+        if (group->readYourWrites() > 0) {
+            m_readYourWrites = true;
+        }
     }
 }
 
@@ -205,6 +295,14 @@ void RedisProxy::setSlotCount(int n)
     memset(m_slots, 0, sizeof(Slot) * n);
 }
 
+void RedisProxy::setHashTag(const char *tag)
+{
+    m_hashTag[0] = 0;
+    if (tag && strlen(tag) == 2) {
+        strcpy(m_hashTag, tag);
+    }
+}
+
 RedisServantGroup *RedisProxy::groupBySlot(int n) const
 {
     if (n >= 0 && n < m_slotCount) {
@@ -234,6 +332,19 @@ RedisServantGroup *RedisProxy::mapToGroup(const char* key, int len)
         }
     }
 
+    //Only the part between the hash tag is hashed, like twemproxy
+    if (m_hashTag[0] != 0) {
+        const char* begin = (const char*)memchr(key, m_hashTag[0], len);
+        if (begin) {
+            ++begin;
+            const char* end = (const char*)memchr(begin, m_hashTag[1], len - (begin - key));
+            if (end && end != begin) {
+                key = begin;
+                len = end - begin;
+            }
+        }
+    }
+
     if (!m_twemproxyMode) {
         unsigned int hash = m_hashFunc(key, len);
         unsigned int idx = hash % m_slotCount;
@@ -269,6 +380,28 @@ RedisServantGroup *RedisProxy::mapToGroup(const char* key, int len)
 
 void RedisProxy::handleClientPacket(const char *key, int len, ClientPacket *packet)
 {
+    //For the read-your-writes window of the groups. The admin commands
+    //of the proxy don't write to the backends
+    if (m_readYourWrites && packet->commandType >= 0 &&
+        packet->commandType < RedisCommand::CMD_COUNT &&
+        !HotKeyCache::isReadOnly(packet->commandType)) {
+        packet->session->lastWriteTime = currentMsec();
+    }
+
+    if (m_counterCoalescer.isEnabled() && m_counterCoalescer.coalesce(packet, key, len)) {
+        return;
+    }
+
+    if (m_hotKeyCache.isEnabled()) {
+        if (HotKeyCache::isCacheable(packet->commandType)) {
+            if (m_hotKeyCache.lookup(packet, key, len)) {
+                return;
+            }
+        } else if (!HotKeyCache::isReadOnly(packet->commandType)) {
+            m_hotKeyCache.invalidate(packet, key, len);
+        }
+    }
+
     RedisServantGroup* group = mapToGroup(key, len);
     if (!group) {
         LOG(Logger::Debug, "Group is not available. mapToGroup return NULL");
@@ -276,6 +409,29 @@ void RedisProxy::handleClientPacket(const char *key, int len, ClientPacket *pack
         packet->setFinishedState(ClientPacket::RequestFinished);
         return;
     }
+    std::vector<RedisServantGroup*> replicas;
+    if (!m_hotKeyReplicas.isEmpty() && m_hotKeyReplicas.route(packet, key, len, replicas)) {
+        group = replicas[0];
+    }
+    if (group->compressThreshold() > 0) {
+        if (ValueCompressor::isDecompressible(packet->commandType)) {
+            packet->decompressOffset = packet->sendBuff.size();
+        } else {
+            ValueCompressor::compressRequest(packet, group->compressThreshold());
+        }
+    }
+    if (replicas.size() > 1) {
+        m_hotKeyReplicas.write(packet, replicas);
+        return;
+    }
+    handleGroupPacket(group, packet);
+}
+
+void RedisProxy::handleGroupPacket(RedisServantGroup *group, ClientPacket *packet)
+{
+    if (group->hedger()->isEnabled() && group->hedger()->handle(group, packet)) {
+        return;
+    }
     RedisServant* servant = group->findUsableServant(packet);
     if (servant) {
         servant->handle(packet);
@@ -300,6 +456,79 @@ bool RedisProxy::addGroupKeyMapping(const char *key, int len, RedisServantGroup
     return false;
 }
 
+static std::string scriptKey(const char* sha, int len)
+{
+    //SHA1 digests are compared in lower case, as redis does
+    std::string key(sha, len);
+    for (int i = 0; i < len; ++i) {
+        key[i] = (sha[i] >= 'A' && sha[i] <= 'Z') ? sha[i] + ('a' - 'A') : sha[i];
+    }
+    return key;
+}
+
+void RedisProxy::addScript(const char *sha, int shaLen, const char *body, int bodyLen)
+{
+    if (shaLen <= 0 || shaLen > MaxScriptShaLength) {
+        return;
+    }
+    std::string key = scriptKey(sha, shaLen);
+    m_scriptMutex.lock();
+    std::map<std::string, Script>::iterator it = m_scripts.find(key);
+    if (it != m_scripts.end()) {
+        m_scriptOrder.splice(m_scriptOrder.begin(), m_scriptOrder, it->second.order);
+    } else {
+        m_scriptOrder.push_front(key);
+        Script& script = m_scripts[key];
+        script.body.assign(body, bodyLen);
+        script.order = m_scriptOrder.begin();
+        while (m_maxScripts > 0 && (int)m_scripts.size() > m_maxScripts) {
+            m_scripts.erase(m_scriptOrder.back());
+            m_scriptOrder.pop_back();
+        }
+    }
+    m_scriptMutex.unlock();
+}
+
+bool RedisProxy::findScript(const char *sha, int shaLen, std::string &body)
+{
+    if (shaLen <= 0 || shaLen > MaxScriptShaLength) {
+        return false;
+    }
+    std::string key = scriptKey(sha, shaLen);
+    bool found = false;
+    m_scriptMutex.lock();
+    std::map<std::string, Script>::iterator it = m_scripts.find(key);
+    if (it != m_scripts.end()) {
+        m_scriptOrder.splice(m_scriptOrder.begin(), m_scriptOrder, it->second.order);
+        body = it->second.body;
+        found = true;
+    }
+    m_scriptMutex.unlock();
+    return found;
+}
+
+void RedisProxy::touchScript(const char *sha, int shaLen)
+{
+    if (shaLen <= 0 || shaLen > MaxScriptShaLength) {
+        return;
+    }
+    std::string key = scriptKey(sha, shaLen);
+    m_scriptMutex.lock();
+    std::map<std::string, Script>::iterator it = m_scripts.find(key);
+    if (it != m_scripts.end()) {
+        m_scriptOrder.splice(m_scriptOrder.begin(), m_scriptOrder, it->second.order);
+    }
+    m_scriptMutex.unlock();
+}
+
+void RedisProxy::clearScripts(void)
+{
+    m_scriptMutex.lock();
+    m_scripts.clear();
+    m_scriptOrder.clear();
+    m_scriptMutex.unlock();
+}
+
 void RedisProxy::removeGroupKeyMapping(const char *key, int len)
 {
     if (key && len > 0) {
@@ -341,6 +570,13 @@ void RedisProxy::closeConnection(Context* c)
 {
     ClientPacket* packet = (ClientPacket*)c;
     m_monitor->clientDisconnected(packet);
+    if (packet->paused) {
+        TimerWheel::cancel(&packet->redisTimer);
+        packet->paused = false;
+        __sync_sub_and_fetch(&m_pausedClients, 1);
+    }
+    discardTransaction(packet);
+    m_pubsub.removeSubscriber(packet);
     TcpServer::closeConnection(c);
 }
 
@@ -375,13 +611,29 @@ void RedisProxy::readRequestFinished(Context *c)
 
     RedisCommandTable* cmdtable = RedisCommandTable::instance();
     RedisCommand* command = cmdtable->findCommand(cmd, len);
+    if (packet->subscriber) {
+        packet->subscriber->replying = true;
+    }
+    //Only MaxToken arguments are parsed, the rest would be dropped silently
+    if (r.type == RedisProtoParseResult::MultiBulk && r.integer > RedisProtoParseResult::MaxToken) {
+        packet->sendBuff.appendFormatString("-ERR too many arguments, at most %d are supported\r\n",
+                                            RedisProtoParseResult::MaxToken);
+        packet->setFinishedState(ClientPacket::RequestFinished);
+        return;
+    }
     if (command) {
         packet->commandType = command->type;
         if (command->type == RedisCommand::AUTH) {
             command->proc(packet, command->arg);
         } else {
             if (packet->auth) {
-                command->proc(packet, command->arg);
+                if (isTransactionQueuing(packet, command)) {
+                    onQueueTransactionCommand(packet, command);
+                } else if (isSubscribedModeRejected(packet, command)) {
+                    onSubscribedModeCommand(packet, command);
+                } else {
+                    command->proc(packet, command->arg);
+                }
             } else {
                 packet->sendBuff.append("-NOAUTH Authentication required.\r\n");
                 packet->setFinishedState(ClientPacket::RequestFinished);
@@ -419,7 +671,9 @@ void RedisProxy::writeReply(Context *c)
 void RedisProxy::writeReplyFinished(Context *c)
 {
     ClientPacket* packet = (ClientPacket*)c;
-    m_monitor->replyClientFinished(packet);
+    if (!packet->subscriber || !packet->subscriber->pushing) {
+        m_monitor->replyClientFinished(packet);
+    }
     packet->finishedState = ClientPacket::Unknown;
     packet->commandType = -1;
     packet->sendBuff.clear();
@@ -433,9 +687,35 @@ void RedisProxy::writeReplyFinished(Context *c)
     packet->sendBufferParsedOffset = 0;
     packet->sendParseResult.reset();
     packet->recvParseResult.reset();
+    if (packet->subscriber) {
+        m_pubsub.replyFinished(packet);
+    }
+    //Backpressure: the client is read again once the servants drained
+    //their queues, its requests wait in the socket meanwhile
+    if (m_maxQueuedBytes > 0 && RedisServant::queuedBytes() > m_maxQueuedBytes) {
+        packet->paused = true;
+        __sync_add_and_fetch(&m_pausedClients, 1);
+        packet->eventLoop->timerWheel()->add(&packet->redisTimer, ResumeReadingInterval,
+                                             onResumeReading, packet);
+        return;
+    }
     waitRequest(c);
 }
 
+void RedisProxy::onResumeReading(void* arg)
+{
+    ClientPacket* packet = (ClientPacket*)arg;
+    RedisProxy* proxy = packet->proxy();
+    if (RedisServant::queuedBytes() > proxy->m_maxQueuedBytes) {
+        packet->eventLoop->timerWheel()->add(&packet->redisTimer, ResumeReadingInterval,
+                                             onResumeReading, packet);
+        return;
+    }
+    packet->paused = false;
+    __sync_sub_and_fetch(&proxy->m_pausedClients, 1);
+    proxy->waitRequest(packet);
+}
+
 void RedisProxy::vipHandler(socket_t sock, short, void* arg)
 {
     char buff[64];
@@ -26,6 +26,8 @@
 #define APP_EXIT_KEY 10
 
 #include <string>
+#include <map>
+#include <list>
 
 #include "util/tcpserver.h"
 #include "util/locker.h"
@@ -34,10 +36,17 @@
 #include "redisproto.h"
 #include "redisservantgroup.h"
 #include "proxymanager.h"
+#include "pubsub.h"
+#include "hotkeycache.h"
+#include "countercoalescer.h"
+#include "hotkeyreplicas.h"
+#include "warmstart.h"
+#include "timerwheel.h"
 
 class RedisConnection;
 class RedisServant;
 class RedisProxy;
+struct TransactionContext;
 class ClientPacket : public Context
 {
 public:
@@ -57,6 +66,8 @@ public:
     RedisProto::ParseState continueToParseSendBuffer(void);
     bool isContinueToParseRecvBuffer(void) const
     { return (recvBufferParsedOffset == recvBuff.size()); }
+    bool isErrorReply(void) const
+    { return (finishedState != RequestFinished || sendBuff.isEmpty() || sendBuff.data()[0] == '-'); }
 
     static void defaultFinishedHandler(ClientPacket *packet, void*);
 
@@ -71,6 +82,22 @@ public:
     int sendToRedisBytes;                           //Send to redis bytes
     RedisServant* requestServant;                   //Object of request
     RedisConnection* redisSocket;                   //Redis socket
+    bool keepRedisSocket;                           //Redis socket is pinned by the owner
+    int redisTimeout;                               //Reply timeout in msec, -1 for none
+    int redisReplyCount;                            //Replies expected for the request
+    TransactionContext* transaction;                //MULTI/WATCH state of the client
+    PubSubSubscriber* subscriber;                   //Pub/Sub state of the client
+    HotKeyCacheTicket cacheTicket;                  //Hot key cache state of the request
+    RequestFlight* flight;                          //Flight led by the request
+    int decompressOffset;                           //Reply to decompress, -1 for none
+    std::string compressedRequest;                  //Request sent instead of the client's one
+    ClientPacket* session;                          //Client connection of the request, itself for a client
+    long long lastWriteTime;                        //Msec of the last write of the client, 0 for none
+    long long servantStartTime;                     //Usec the servant took the request, 0 for none
+    bool servantSent;                               //The request was written to a backend connection
+    TimerWheel::Timer redisTimer;                   //Request timeout of the servant, or the paused reading of a client
+    bool paused;                                    //Reading is paused until the servants drain their queues
+    long long queuedTime;                           //Msec the request was queued by the servant
     bool auth;
 };
 
@@ -95,6 +122,12 @@ struct Slot {
 class RedisProxy : public TcpServer
 {
 public:
+    enum {
+        ResumeReadingInterval = 10,     //Msec between the checks of a paused client
+        MaxScriptShaLength = 64,
+        DefaultMaxScripts = 1024
+    };
+
     RedisProxy(void);
     ~RedisProxy(void);
 
@@ -121,15 +154,23 @@ public:
     void setMonitor(Monitor* monitor) { m_monitor = monitor; }
     Monitor* monitor(void) const { return m_monitor; }
 
+    //Clients aren't read while the servants queue more bytes, 0 for no limit
+    void setMaxQueuedBytes(long long bytes) { m_maxQueuedBytes = bytes; }
+    long long maxQueuedBytes(void) const { return m_maxQueuedBytes; }
+    int pausedClients(void) const { return m_pausedClients; }
+
     void setPassword(const std::string& pwd) { m_pwd = pwd; }
     const std::string password(void) const { return m_pwd; }
 
     bool run(const HostAddress &addr);
+    //Accept the clients on a unix socket too, after run
+    bool runUnixListener(const char* path);
     void stop(void);
 
     void addRedisGroup(RedisServantGroup* group);
     bool setSlot(int n, RedisServantGroup* group);
     void setHashFunction(HashFunc func) { m_hashFunc = func; }
+    void setHashTag(const char* tag);
     void setSlotCount(int n);
 
     HashFunc hashFunction(void) const { return m_hashFunc; }
@@ -142,12 +183,30 @@ public:
     RedisServantGroup* group(const char* name) const;
     RedisServantGroup* mapToGroup(const char* key, int len);
     void handleClientPacket(const char* key, int len, ClientPacket* packet);
+    void handleGroupPacket(RedisServantGroup* group, ClientPacket* packet);
 
     bool addGroupKeyMapping(const char* key, int len, RedisServantGroup* group);
     void removeGroupKeyMapping(const char* key, int len);
 
     StringMap<RedisServantGroup*>& keyMapping(void) { return m_keyMapping; }
 
+    //Lua scripts known to the proxy, indexed by SHA1. Above the limit the
+    //least recently used one is forgotten, its EVALSHA gets NOSCRIPT from
+    //a backend which doesn't have it. 0 for no limit
+    void setMaxScripts(int count) { m_maxScripts = count; }
+    int maxScripts(void) const { return m_maxScripts; }
+    void addScript(const char* sha, int shaLen, const char* body, int bodyLen);
+    bool findScript(const char* sha, int shaLen, std::string& body);
+    //An EVALSHA which ran keeps its script from being forgotten
+    void touchScript(const char* sha, int shaLen);
+    void clearScripts(void);
+
+    PubSub* pubsub(void) { return &m_pubsub; }
+    HotKeyCache* hotKeyCache(void) { return &m_hotKeyCache; }
+    CounterCoalescer* counterCoalescer(void) { return &m_counterCoalescer; }
+    HotKeyReplicas* hotKeyReplicas(void) { return &m_hotKeyReplicas; }
+    WarmStart* warmStart(void) { return &m_warmStart; }
+
     virtual Context* createContextObject(void);
     virtual void destroyContextObject(Context* c);
     virtual void closeConnection(Context* c);
@@ -159,11 +218,13 @@ public:
 
 private:
     static void vipHandler(socket_t, short, void*);
+    static void onResumeReading(void* arg);
 
 private:
     bool m_twemproxyMode;
     Monitor* m_monitor;
     HashFunc m_hashFunc;
+    char m_hashTag[3];
     int m_slotCount;
     Slot* m_slots;
     Vector<RedisServantGroup*> m_groups;
@@ -172,15 +233,34 @@ private:
     char m_vipAddress[256];
     Event m_vipEvent;
     bool m_vipEnabled;
+    TcpSocket m_unixSocket;
+    Event m_unixListener;
+    std::string m_unixPath;
     int  m_groupRetryTime;
     bool m_autoEjectGroup;
     bool m_ejectAfterRestoreEnabled;
+    long long m_maxQueuedBytes;
+    volatile int m_pausedClients;
+    bool m_readYourWrites;
     StringMap<RedisServantGroup*> m_keyMapping;
     unsigned int m_threadPoolRefCount;
     EventLoopThreadPool* m_eventLoopThreadPool;
     Mutex m_groupMutex;
     ProxyManager m_proxyManager;
     std::string m_pwd;
+    struct Script {
+        std::string body;
+        std::list<std::string>::iterator order;
+    };
+    std::map<std::string, Script> m_scripts;
+    std::list<std::string> m_scriptOrder;       //Most recently used first
+    int m_maxScripts;
+    Mutex m_scriptMutex;
+    PubSub m_pubsub;
+    HotKeyCache m_hotKeyCache;
+    CounterCoalescer m_counterCoalescer;
+    HotKeyReplicas m_hotKeyReplicas;
+    WarmStart m_warmStart;
 
 private:
     RedisProxy(const RedisProxy&);
@@ -17,12 +17,22 @@
 * under the License.
 */
 
+#include <time.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#include "util/clock.h"
 #include "util/logger.h"
 #include "redisproxy.h"
 #include "redisservant.h"
+#include "timerwheel.h"
+
+static volatile long long s_queuedBytes = 0;
 
 RedisConnection::RedisConnection(void)
 {
+    m_owner = NULL;
+    m_lastUsed = 0;
 }
 
 RedisConnection::~RedisConnection(void)
@@ -34,7 +44,7 @@ bool RedisConnection::connect(const HostAddress& addr, const std::string &pwd)
 {
     timeval defaultVal;
     socketlen_t len = sizeof(timeval);
-    TcpSocket sock = TcpSocket::createTcpSocket();
+    TcpSocket sock = TcpSocket::createSocket(addr);
     if (sock.isNull()) {
         LOG(Logger::Error, "RedisConnection::connect: %s", strerror(errno));
         return false;
@@ -65,9 +75,35 @@ bool RedisConnection::connect(const HostAddress& addr, const std::string &pwd)
 
     sock.setOption(SOL_SOCKET, SO_SNDTIMEO, (char*)&defaultVal, sizeof(timeval));
     sock.setNonBlocking();
-    sock.setNoDelay();
+    if (!addr.isUnix()) {
+        sock.setNoDelay();
+    }
+    sock.setKeepAlive();
+    m_socket = sock;
+    m_lastUsed = currentUsec() / 1000;
+    return true;
+}
+
+bool RedisConnection::asyncConnect(const HostAddress& addr)
+{
+    m_socket.close();
+    TcpSocket sock = TcpSocket::createSocket(addr);
+    if (sock.isNull()) {
+        LOG(Logger::Error, "RedisConnection::asyncConnect: %s", strerror(errno));
+        return false;
+    }
+    sock.setNonBlocking();
+    if (!addr.isUnix()) {
+        sock.setNoDelay();
+    }
     sock.setKeepAlive();
+    if (sock.asyncConnect(addr) == TcpSocket::IOError) {
+        LOG(Logger::Error, "RedisConnection::asyncConnect: %s", strerror(errno));
+        sock.close();
+        return false;
+    }
     m_socket = sock;
+    m_lastUsed = currentUsec() / 1000;
     return true;
 }
 
@@ -83,6 +119,9 @@ RedisConnectionPool::RedisConnectionPool(void)
 {
     m_activeConnNums = 0;
     m_capacity = 0;
+    m_minCapacity = 0;
+    m_maxCapacity = 0;
+    m_connectOnDemand = true;
 }
 
 RedisConnectionPool::~RedisConnectionPool(void)
@@ -103,6 +142,8 @@ bool RedisConnectionPool::open(const HostAddress& addr, int capacity)
 
     m_redisAddress = addr;
     m_capacity = capacity;
+    m_minCapacity = capacity;
+    m_maxCapacity = capacity;
 
     for (int i = 0; i < m_capacity; ++i) {
         RedisConnection* sock = new RedisConnection;
@@ -111,6 +152,7 @@ bool RedisConnectionPool::open(const HostAddress& addr, int capacity)
             close();
             return false;
         } else {
+            sock->m_owner = this;
             m_pool.append(sock);
         }
     }
@@ -118,6 +160,63 @@ bool RedisConnectionPool::open(const HostAddress& addr, int capacity)
     return true;
 }
 
+void RedisConnectionPool::setup(const HostAddress &addr, int capacity)
+{
+    //Like open(), but the connections are created by select() on demand
+    close();
+    m_redisAddress = addr;
+    m_capacity = capacity;
+    m_minCapacity = capacity;
+    m_maxCapacity = capacity;
+}
+
+void RedisConnectionPool::adopt(RedisConnection* sock)
+{
+    sock->m_owner = this;
+    m_locker.lock();
+    m_pool.append(sock);
+    m_capacity = std::max(m_capacity, m_pool.size() + m_activeConnNums);
+    m_maxCapacity = std::max(m_maxCapacity, m_capacity);
+    m_locker.unlock();
+}
+
+void RedisConnectionPool::setBounds(int minCapacity, int maxCapacity)
+{
+    m_locker.lock();
+    m_minCapacity = minCapacity;
+    m_maxCapacity = maxCapacity;
+    m_capacity = std::min(std::max(m_capacity, minCapacity), maxCapacity);
+    m_locker.unlock();
+}
+
+//The pool hands out the last used connection first, so the idle ones
+//gather at its end when the load falls
+int RedisConnectionPool::closeIdle(long long idleSince)
+{
+    m_locker.lock();
+    std::vector<RedisConnection*> socks;
+    RedisConnection* sock;
+    while ((sock = m_pool.take(NULL)) != NULL) {
+        socks.push_back(sock);
+    }
+    int total = socks.size() + m_activeConnNums;
+    int closed = 0;
+    for (size_t i = 0; i < socks.size(); ++i) {
+        sock = socks[i];
+        if (sock->m_lastUsed < idleSince && total - closed > m_minCapacity) {
+            delete sock;
+            ++closed;
+        } else {
+            m_pool.append(sock);
+        }
+    }
+    if (closed > 0) {
+        m_capacity = std::max(total - closed, m_minCapacity);
+    }
+    m_locker.unlock();
+    return closed;
+}
+
 RedisConnection *RedisConnectionPool::select(void)
 {
     m_locker.lock();
@@ -125,12 +224,13 @@ RedisConnection *RedisConnectionPool::select(void)
     if (sock) {
         ++m_activeConnNums;
     } else {
-        if ((m_pool.size() + m_activeConnNums) < m_capacity) {
+        if (m_connectOnDemand && (m_pool.size() + m_activeConnNums) < m_capacity) {
             sock = new RedisConnection;
             if (!sock->connect(m_redisAddress, m_password)) {
                 delete sock;
                 sock = NULL;
             } else {
+                sock->m_owner = this;
                 ++m_activeConnNums;
             }
         }
@@ -141,23 +241,27 @@ RedisConnection *RedisConnectionPool::select(void)
 
 void RedisConnectionPool::unSelect(RedisConnection *sock)
 {
+    sock->m_lastUsed = currentUsec() / 1000;
     m_locker.lock();
-    m_pool.append(sock);
+    m_pool.prepend(sock);
     --m_activeConnNums;
     m_locker.unlock();
 }
 
-bool RedisConnectionPool::repairSocket(RedisConnection *sock)
+void RedisConnectionPool::free(RedisConnection *sock)
 {
-    sock->disconnect();
-    return sock->connect(m_redisAddress, m_password);
+    delete sock;
+    m_locker.lock();
+    --m_activeConnNums;
+    m_locker.unlock();
 }
 
-void RedisConnectionPool::free(RedisConnection *sock)
+void RedisConnectionPool::discard(RedisConnection *sock)
 {
     delete sock;
     m_locker.lock();
     --m_activeConnNums;
+    --m_capacity;
     m_locker.unlock();
 }
 
@@ -181,13 +285,34 @@ RedisServant::RedisServant(void)
 {
     m_loop = NULL;
     m_reconnCount = 0;
+    m_reconnSeed = (unsigned int)(time(NULL) ^ getpid() ^ (long)this);
+    m_connecting = NULL;
+    m_connectReplies = 0;
+    m_poolRefill = 0;
+    m_poolReplace = 0;
+    m_replaceRetries = 0;
+    m_replaceRetryTime = 0;
     m_actived = false;
     m_reconnectEnabled = true;
+    m_flightRequests = 0;
+    m_flightCoalesced = 0;
+    m_latency = 0;
+    m_latencyTime = 0;
+    m_outstanding = 0;
+    m_queued = 0;
+    m_rejected = 0;
+    m_queueWaitSum = 0;
+    m_queueWaitCount = 0;
+    m_poolGrows = 0;
+    m_poolShrinks = 0;
 }
 
 RedisServant::~RedisServant(void)
 {
     stop();
+    if (m_connecting != NULL) {
+        m_connectingEvent.remove();
+    }
 
     if (m_connListener.isActived()) {
         m_connListener.disconnect();
@@ -204,6 +329,16 @@ bool RedisServant::start(void)
     if (!m_connPool.open(m_redisAddress, m_option.poolSize)) {
         return false;
     }
+    m_connPool.setBounds(m_option.minPoolSize, m_option.maxPoolSize);
+    m_connPool.setConnectOnDemand(false);
+    m_blockingPool.setPassword(m_connPool.password());
+    m_blockingPool.setup(m_redisAddress, m_option.blockingPoolSize);
+
+    m_poolEvent.setTimer(m_loop, onAdjustPool, this);
+    if (m_option.minPoolSize < m_option.maxPoolSize) {
+        m_poolEvent.active(PoolAdjustInterval);
+    }
+    m_replaceEvent.setTimer(m_loop, onReplaceConnection, this);
 
     if (m_connListener.connect(m_redisAddress, m_connPool.password())) {
         m_connEvent.set(m_loop, m_connListener.m_socket.socket(), EV_READ, onDisconnected, this);
@@ -215,17 +350,24 @@ bool RedisServant::start(void)
 
 void RedisServant::stop(void)
 {
+    cancelRefill();
+    if (m_actived) {
+        m_poolEvent.remove();
+    }
     m_locker.lock();
     m_connPool.close();
+    m_blockingPool.close();
     while (1) {
         ClientPacket* packet = m_requests.take(NULL);
         if (packet != NULL) {
+            dequeued(packet);
             packet->sendBuff.append("-ERR server is not available\r\n");
             packet->setFinishedState(ClientPacket::RequestFinished);
         } else {
             break;
         }
     }
+    m_queued = 0;
     m_actived = false;
     m_locker.unlock();
 }
@@ -234,11 +376,43 @@ void RedisServant::stop(void)
 void RedisServant::handle(ClientPacket* packet)
 {
     packet->requestServant = this;
+    packet->redisTimeout = -1;
+    //Failed at once while the circuit is open, before the latency counts it
+    if (m_breaker.isEnabled() && !m_breaker.allowRequest()) {
+        LOG(Logger::Debug, "Redis server (%s:%d) circuit is open",
+            m_redisAddress.ip(), m_redisAddress.port());
+        packet->sendBuff.append("-ERR backend circuit is open\r\n");
+        packet->setFinishedState(ClientPacket::RequestFinished);
+        return;
+    }
+    requestStarted(packet);
+    if (packet->commandType >= 0 && m_option.singleFlight[packet->commandType]) {
+        if (joinFlight(packet)) {
+            return;
+        }
+    }
+    //The waiters of a flight get the reply of the first packet, timed out or not
+    if (m_option.requestTimeout > 0) {
+        packet->eventLoop->timerWheel()->add(&packet->redisTimer, m_option.requestTimeout,
+                                             onRequestTimeout, packet);
+    }
     RedisConnection* sock = m_connPool.select();
     if (sock == NULL) {
         if (m_actived) {
             m_locker.lock();
+            if (!admitRequest()) {
+                ++m_rejected;
+                m_locker.unlock();
+                LOG(Logger::Debug, "Redis server (%s:%d) is busy, %d requests queued",
+                    m_redisAddress.ip(), m_redisAddress.port(), m_queued);
+                packet->sendBuff.append("-BUSY too many requests queued for the backend\r\n");
+                packet->setFinishedState(ClientPacket::RequestFinished);
+                return;
+            }
+            packet->queuedTime = currentUsec() / 1000;
             m_requests.append(packet);
+            ++m_queued;
+            __sync_add_and_fetch(&s_queuedBytes, packet->recvParseResult.protoBuffLen);
             m_locker.unlock();
         } else {
             LOG(Logger::Debug, "Redis server (%s:%d) is not active",
@@ -252,16 +426,327 @@ void RedisServant::handle(ClientPacket* packet)
     }
 }
 
+//Called with the queue locked. A full queue, or one whose oldest request
+//waited too long, takes no more requests: they would only wait longer
+bool RedisServant::admitRequest(void)
+{
+    if (m_option.maxQueue > 0 && m_queued >= m_option.maxQueue) {
+        return false;
+    }
+    if (m_option.maxQueueWait > 0) {
+        ClientPacket* oldest = m_requests.first(NULL);
+        if (oldest != NULL && currentUsec() / 1000 - oldest->queuedTime > m_option.maxQueueWait) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//Called with the queue locked
+void RedisServant::dequeued(ClientPacket* packet)
+{
+    --m_queued;
+    __sync_sub_and_fetch(&s_queuedBytes, packet->recvParseResult.protoBuffLen);
+}
+
+long long RedisServant::queuedBytes(void)
+{
+    return s_queuedBytes;
+}
+
+void RedisServant::handle(ClientPacket *packet, RedisConnection *sock)
+{
+    packet->requestServant = this;
+    packet->redisSocket = sock;
+    packet->redisTimeout = -1;
+    onSendRequest(sock->m_socket.socket(), 0, packet);
+}
+
+void RedisServant::handleBlocking(ClientPacket *packet, int timeout)
+{
+    packet->requestServant = this;
+    RedisConnection* sock = m_actived ? m_blockingPool.select() : NULL;
+    if (sock == NULL) {
+        //Blocking requests are never queued, they would hold up the
+        //lane for the whole timeout
+        if (m_actived) {
+            packet->sendBuff.append("-ERR too many blocking requests\r\n");
+        } else {
+            packet->sendBuff.append("-ERR server is not available\r\n");
+        }
+        packet->setFinishedState(ClientPacket::RequestFinished);
+        return;
+    }
+
+    //Wait for the reply a little longer than the command, and no
+    //longer than the blocking timeout
+    int wait = (timeout > 0) ? timeout + BlockingReplyGrace : -1;
+    int limit = m_option.blockingTimeout * 1000;
+    if (limit > 0 && (wait < 0 || wait > limit)) {
+        wait = limit;
+    }
+    packet->redisSocket = sock;
+    packet->redisTimeout = wait;
+    onSendRequest(sock->m_socket.socket(), 0, packet);
+}
+
+void RedisServant::unpinConnection(RedisConnection *sock, bool dirty)
+{
+    if (dirty) {
+        discardConnection(sock);
+    } else {
+        onRedisSocketUseCompleted(sock);
+    }
+}
+
+bool RedisServant::joinFlight(ClientPacket* packet)
+{
+    RedisProtoParseResult& r = packet->recvParseResult;
+    std::string request(r.protoBuff, r.protoBuffLen);
+    m_flightLocker.lock();
+    FlightMap::iterator it = m_flights.find(request);
+    if (it != m_flights.end()) {
+        it->second->waiters.push_back(packet);
+        ++m_flightCoalesced;
+        m_flightLocker.unlock();
+        return true;
+    }
+
+    RequestFlight* flight = new RequestFlight;
+    flight->servant = this;
+    flight->request = request;
+    flight->replyOffset = packet->sendBuff.size();
+    m_flights[request] = flight;
+    ++m_flightRequests;
+    m_flightLocker.unlock();
+    packet->flight = flight;
+    return false;
+}
+
+void RedisServant::flightFinished(ClientPacket* packet, RequestFlight* flight)
+{
+    m_flightLocker.lock();
+    m_flights.erase(flight->request);
+    m_flightLocker.unlock();
+
+    //The waiting packets may belong to other event loops, they are
+    //finished in their own loop
+    const char* reply = packet->sendBuff.data() + flight->replyOffset;
+    int size = packet->sendBuff.size() - flight->replyOffset;
+    for (size_t i = 0; i < flight->waiters.size(); ++i) {
+        ClientPacket* waiter = flight->waiters[i];
+        waiter->sendBuff.append(reply, size);
+        waiter->decompressOffset = -1;      //Decompressed by the leader
+        waiter->_event.setTimer(waiter->eventLoop, onFlightReply, waiter);
+        waiter->_event.active(0);
+    }
+    delete flight;
+}
+
+int RedisServant::flightCount(void)
+{
+    m_flightLocker.lock();
+    int count = m_flights.size();
+    m_flightLocker.unlock();
+    return count;
+}
+
+void RedisServant::requestStarted(ClientPacket* packet)
+{
+    packet->servantStartTime = currentUsec();
+    __sync_add_and_fetch(&m_outstanding, 1);
+}
+
+//Only the requests written to a backend time it. The replies made by
+//the servant itself, busy or not available, would look fast
+void RedisServant::requestFinished(long long startTime, bool sent)
+{
+    __sync_sub_and_fetch(&m_outstanding, 1);
+    if (!sent) {
+        return;
+    }
+    long long now = currentUsec();
+    double sample = now - startTime;
+
+    m_latencyLocker.lock();
+    double decayed = m_latency * exp(-(double)(now - m_latencyTime) / LatencyDecayTime);
+    if (sample > decayed) {
+        m_latency = sample;
+    } else {
+        m_latency = decayed + (sample - decayed) / 8;
+    }
+    m_latencyTime = now;
+    m_latencyLocker.unlock();
+}
+
+double RedisServant::latency(void)
+{
+    m_latencyLocker.lock();
+    double value = m_latency * exp(-(double)(currentUsec() - m_latencyTime) / LatencyDecayTime);
+    m_latencyLocker.unlock();
+    return value;
+}
+
+void RedisServant::onFlightReply(socket_t, short, void* arg)
+{
+    ClientPacket* packet = (ClientPacket*)arg;
+    packet->setFinishedState(ClientPacket::RequestFinished);
+}
+
+void RedisServant::onRedisSocketBroken(ClientPacket* packet)
+{
+    //The error reply is made here, there is no reply to time
+    packet->servantSent = false;
+    //The breaker only keeps the requests away, the connection is
+    //replaced whatever its state
+    discardConnection(packet->redisSocket);
+    if (packet->keepRedisSocket) {
+        //The pinned connection lost its state, the owner has to know it
+        packet->redisSocket = NULL;
+    }
+}
+
 void RedisServant::onRedisSocketUseCompleted(RedisConnection* sock)
 {
+    //Connections of the blocking lane don't serve the queued requests
+    if (sock->m_owner != &m_connPool) {
+        sock->m_owner->unSelect(sock);
+        return;
+    }
+
+    //The queued request is sent from its own loop, where its timeout
+    //runs. Both see it either queued or with its connection
     m_locker.lock();
-    ClientPacket* packet = m_requests.take(NULL);
+    ClientPacket* packet;
+    long long now = currentUsec() / 1000;
+    while ((packet = m_requests.take(NULL)) != NULL) {
+        dequeued(packet);
+        m_queueWaitSum += now - packet->queuedTime;
+        ++m_queueWaitCount;
+        if (m_option.maxQueueWait > 0 && now - packet->queuedTime > m_option.maxQueueWait) {
+            ++m_rejected;
+            packet->_event.setTimer(packet->eventLoop, onQueueExpired, packet);
+            packet->_event.active(0);
+            continue;
+        }
+        packet->redisSocket = sock;
+        packet->_event.set(packet->eventLoop, sock->m_socket.socket(), EV_WRITE, onSendRequest, packet);
+        packet->_event.active();
+        break;
+    }
     m_locker.unlock();
     if (!packet) {
         m_connPool.unSelect(sock);
-    } else {
-        packet->redisSocket = sock;
-        onSendRequest(sock->m_socket.socket(), 0, packet);
+    }
+}
+
+void RedisServant::onRequestTimeout(void* arg)
+{
+    ClientPacket* packet = (ClientPacket*)arg;
+    RedisServant* servant = packet->requestServant;
+    servant->m_locker.lock();
+    bool queued = servant->m_requests.remove(packet);
+    if (queued) {
+        servant->dequeued(packet);
+    }
+    servant->m_locker.unlock();
+
+    LOG(Logger::Debug, "Redis server (%s:%d) request timeout",
+        servant->redisAddress().ip(), servant->redisAddress().port());
+    //The reply may still arrive, so the connection is closed instead of
+    //reused. A request which expired in the queue isn't failed twice
+    if (!queued) {
+        packet->_event.remove();
+        if (packet->redisSocket != NULL) {
+            servant->discardConnection(packet->redisSocket);
+            packet->redisSocket = NULL;
+        }
+    }
+    servant->requestFailed();
+    packet->sendToRedisBytes = 0;
+    packet->sendBuff.truncate(packet->sendBufferParsedOffset);
+    packet->sendBuff.append("-ERR backend timeout\r\n");
+    packet->setFinishedState(ClientPacket::RequestFinished);
+}
+
+//A request which waited too long for a connection is failed from its
+//own loop, the connection goes to the next one
+void RedisServant::onQueueExpired(socket_t, short, void* arg)
+{
+    ClientPacket* packet = (ClientPacket*)arg;
+    RedisServant* servant = packet->requestServant;
+    LOG(Logger::Debug, "Redis server (%s:%d) request waited too long for a connection",
+        servant->redisAddress().ip(), servant->redisAddress().port());
+    packet->sendBuff.append("-BUSY request waited too long for the backend\r\n");
+    packet->setFinishedState(ClientPacket::RequestFinished);
+}
+
+void RedisServant::requestSucceeded(void)
+{
+    if (m_breaker.isEnabled() && m_breaker.onSuccess()) {
+        LOG(Logger::Message, "Redis server (%s:%d) circuit closed",
+            m_redisAddress.ip(), m_redisAddress.port());
+    }
+}
+
+void RedisServant::requestFailed(void)
+{
+    if (m_breaker.isEnabled() && m_breaker.onFailure()) {
+        LOG(Logger::Warning, "Redis server (%s:%d) circuit opened for %d ms",
+            m_redisAddress.ip(), m_redisAddress.port(), m_breaker.option().openTime);
+    }
+}
+
+void RedisServant::onAdjustPool(socket_t, short, void* arg)
+{
+    RedisServant* servant = (RedisServant*)arg;
+    servant->adjustPool();
+    if (servant->m_actived) {
+        servant->m_poolEvent.active(PoolAdjustInterval);
+    }
+}
+
+//The pool grows by a quarter while the requests wait for connections,
+//and gives back the connections left idle once the load is gone
+void RedisServant::adjustPool(void)
+{
+    long long now = currentUsec() / 1000;
+    m_locker.lock();
+    bool waited = (m_queueWaitCount > 0);
+    long long wait = waited ? m_queueWaitSum / m_queueWaitCount : 0;
+    ClientPacket* oldest = m_requests.first(NULL);
+    if (oldest != NULL) {
+        waited = true;
+        wait = std::max(wait, now - oldest->queuedTime);
+    }
+    m_queueWaitSum = 0;
+    m_queueWaitCount = 0;
+    m_locker.unlock();
+
+    //The connections still to be opened count in the size of the pool
+    int capacity = m_connPool.capacity();
+    int size = capacity + m_poolReplace;
+    if (m_connecting != NULL && m_connecting != &m_connListener) {
+        ++size;
+    }
+    if (waited && wait >= m_option.poolGrowWait && size < m_connPool.maxCapacity()) {
+        int count = std::min(std::max(1, size / 4), m_connPool.maxCapacity() - size);
+        ++m_poolGrows;
+        LOG(Logger::Message, "Redis server (%s:%d) pool grows from %d to %d connections, queue wait %lld ms",
+            m_redisAddress.ip(), m_redisAddress.port(), size, size + count, wait);
+        //Opened like the replaced ones, the queued requests take them as
+        //they come
+        __sync_add_and_fetch(&m_poolReplace, count);
+        if (m_connecting == NULL) {
+            replaceConnection();
+        }
+    } else if (!waited && m_option.poolIdleTimeout > 0 && capacity > m_connPool.minCapacity()) {
+        int closed = m_connPool.closeIdle(now - m_option.poolIdleTimeout * 1000LL);
+        if (closed > 0) {
+            ++m_poolShrinks;
+            LOG(Logger::Message, "Redis server (%s:%d) pool shrinks from %d to %d connections, %d idle closed",
+                m_redisAddress.ip(), m_redisAddress.port(), capacity, m_connPool.capacity(), closed);
+        }
     }
 }
 
@@ -279,45 +764,284 @@ void RedisServant::onReconnect(socket_t, short, void* arg)
     }
 
     ++servant->m_reconnCount;
-    LOG(Logger::Message, "(%d) Reconnect to redis server...", servant->m_reconnCount);
-    if (!servant->start()) {
-        servant->m_connEvent.setTimer(servant->m_loop, onReconnect, servant);
-        servant->m_connEvent.active(opt.reconnInterval * 1000);
-        LOG(Logger::Message, "After %d second(s) reconnection...", opt.reconnInterval);
+    LOG(Logger::Message, "(%d) Reconnect to redis server (%s:%d)...", servant->m_reconnCount,
+        servant->redisAddress().ip(), servant->redisAddress().port());
+    servant->connectAsync(&servant->m_connListener);
+}
+
+//Exponential backoff from the retry interval. Half of the delay is
+//random, so the proxies don't all come back to a restarted server at once
+int RedisServant::reconnectDelay(int attempts)
+{
+    long long base = m_option.reconnInterval * 1000LL;
+    long long limit = std::max(base, (long long)MaxReconnInterval);
+    long long delay = std::min(base << std::min(attempts, 16), limit);
+    return (int)(delay / 2 + rand_r(&m_reconnSeed) % (delay / 2 + 1));
+}
+
+//The connection is opened without blocking the loop, then it has to
+//answer PING, after AUTH when there is a password
+void RedisServant::connectAsync(RedisConnection* conn)
+{
+    m_connecting = conn;
+    if (!conn->asyncConnect(m_redisAddress)) {
+        connectFinished(false);
+        return;
+    }
+    m_connectReply.clear();
+    m_connectingEvent.set(m_loop, conn->m_socket.socket(), EV_WRITE, onConnectWritable, this);
+    m_connectingEvent.active(ConnectTimeout);
+}
+
+void RedisServant::onConnectWritable(socket_t sock, short events, void* arg)
+{
+    RedisServant* servant = (RedisServant*)arg;
+    TcpSocket socket(sock);
+    if ((events & EV_TIMEOUT) || socket.error() != 0) {
+        servant->connectFinished(false);
+        return;
+    }
+
+    char request[600];
+    int len = 0;
+    std::string pwd = servant->m_connPool.password();
+    servant->m_connectReplies = 1;
+    if (!pwd.empty()) {
+        len = sprintf(request, "*2\r\n$4\r\nAUTH\r\n$%d\r\n%s\r\n", (int)pwd.length(), pwd.c_str());
+        servant->m_connectReplies = 2;
+    }
+    len += sprintf(request + len, "*1\r\n$4\r\nPING\r\n");
+    if (socket.asyncSend(request, len) != len) {
+        servant->connectFinished(false);
+        return;
+    }
+    servant->m_connectingEvent.set(servant->m_loop, sock, EV_READ, onConnectReply, servant);
+    servant->m_connectingEvent.active(ConnectTimeout);
+}
+
+void RedisServant::onConnectReply(socket_t sock, short events, void* arg)
+{
+    RedisServant* servant = (RedisServant*)arg;
+    if (events & EV_TIMEOUT) {
+        servant->connectFinished(false);
+        return;
+    }
+
+    char buff[256];
+    TcpSocket socket(sock);
+    int ret = socket.asyncRecv(buff, sizeof(buff));
+    if (ret == TcpSocket::IOAgain) {
+        servant->m_connectingEvent.active(ConnectTimeout);
+        return;
+    }
+    if (ret <= 0) {
+        servant->connectFinished(false);
+        return;
+    }
+
+    //The replies are status lines, an error one fails the check
+    std::string& reply = servant->m_connectReply;
+    reply.append(buff, ret);
+    int lines = 0;
+    for (size_t pos = reply.find("\r\n"); pos != std::string::npos; pos = reply.find("\r\n", pos + 2)) {
+        ++lines;
+    }
+    if (lines < servant->m_connectReplies) {
+        servant->m_connectingEvent.active(ConnectTimeout);
+        return;
+    }
+    bool ok = (reply[0] != '-' && reply.find("\n-") == std::string::npos);
+    if (!ok) {
+        LOG(Logger::Warning, "Redis server (%s:%d) refused the connection: %s",
+            servant->redisAddress().ip(), servant->redisAddress().port(),
+            reply.substr(0, reply.find("\r\n")).c_str());
+    }
+    servant->connectFinished(ok);
+}
+
+void RedisServant::connectFinished(bool ok)
+{
+    RedisConnection* conn = m_connecting;
+    m_connecting = NULL;
+
+    if (conn != &m_connListener) {
+        if (!ok) {
+            //The slot stays with the servant and is tried again later, the
+            //rest of a refill with it
+            delete conn;
+            if (m_poolRefill > 0) {
+                finishRefill();
+            } else {
+                __sync_add_and_fetch(&m_poolReplace, 1);
+            }
+            int delay = reconnectDelay(m_replaceRetries++);
+            m_replaceRetryTime = currentMsec() + delay;
+            m_replaceEvent.active(delay);
+            LOG(Logger::Warning, "Redis server (%s:%d) connect failed, %d connections opened again after %d ms",
+                m_redisAddress.ip(), m_redisAddress.port(), m_poolReplace, delay);
+            return;
+        }
+        m_replaceRetries = 0;
+        m_replaceRetryTime = 0;
+        m_connPool.adopt(conn);
+        //A queued request takes the new connection at once
+        RedisConnection* sock = m_connPool.select();
+        if (sock != NULL) {
+            onRedisSocketUseCompleted(sock);
+        }
+        if (m_poolRefill == 0) {
+            replaceConnection();
+            return;
+        }
+        --m_poolRefill;
+        refillPool();
+        return;
+    }
+
+    if (!ok) {
+        m_connListener.disconnect();
+        if (m_actived) {
+            stop();
+            LOG(Logger::Warning, "Redis server (%s:%d) disconnected",
+                m_redisAddress.ip(), m_redisAddress.port());
+            m_reconnCount = 0;
+        }
+        if (m_reconnectEnabled && m_reconnCount < m_option.maxReconnCount) {
+            int delay = reconnectDelay(m_reconnCount);
+            m_connEvent.setTimer(m_loop, onReconnect, this);
+            m_connEvent.active(delay);
+            LOG(Logger::Message, "After %d ms reconnection...", delay);
+        } else {
+            LOG(Logger::Message, "Stop the reconnection");
+        }
+        return;
+    }
+
+    m_reconnCount = 0;
+    m_connEvent.set(m_loop, m_connListener.m_socket.socket(), EV_READ, onDisconnected, this);
+    m_connEvent.active();
+    if (m_actived) {
+        //Only the idle listener was closed by the server
+        replaceConnection();
+        return;
+    }
+
+    //The requests queue until the refill brings the connections, one at
+    //a time so a restarted server isn't hit by the whole pool at once
+    LOG(Logger::Message, "Redis server (%s:%d) reconnected, refilling the pool",
+        m_redisAddress.ip(), m_redisAddress.port());
+    m_connPool.setup(m_redisAddress, 0);
+    m_blockingPool.setPassword(m_connPool.password());
+    m_blockingPool.setup(m_redisAddress, m_option.blockingPoolSize);
+    m_poolEvent.setTimer(m_loop, onAdjustPool, this);
+    m_replaceEvent.setTimer(m_loop, onReplaceConnection, this);
+    m_actived = true;
+    m_poolRefill = m_option.poolSize;
+    m_poolReplace = 0;
+    m_replaceRetries = 0;
+    m_replaceRetryTime = 0;
+    refillPool();
+}
+
+void RedisServant::refillPool(void)
+{
+    if (m_poolRefill > 0 && m_actived) {
+        connectAsync(new RedisConnection);
     } else {
-        servant->m_reconnCount = 0;
+        finishRefill();
+        replaceConnection();
+    }
+}
+
+//The connections the refill didn't open are replaced one at a time
+void RedisServant::finishRefill(void)
+{
+    __sync_add_and_fetch(&m_poolReplace, m_poolRefill);
+    m_poolRefill = 0;
+    m_connPool.setBounds(m_option.minPoolSize, m_option.maxPoolSize);
+    if (m_option.minPoolSize < m_option.maxPoolSize) {
+        m_poolEvent.active(PoolAdjustInterval);
+    }
+    LOG(Logger::Message, "Redis server (%s:%d) pool refilled, %d connections",
+        m_redisAddress.ip(), m_redisAddress.port(),
+        m_connPool.activeConnectionNums() + m_connPool.unActiveConnectionNums());
+}
+
+void RedisServant::cancelRefill(void)
+{
+    if (m_connecting != NULL && m_connecting != &m_connListener) {
+        m_connectingEvent.remove();
+        delete m_connecting;
+        m_connecting = NULL;
+        //The slot of a replacement goes back, a refill counts it itself
+        if (m_poolRefill == 0) {
+            __sync_add_and_fetch(&m_poolReplace, 1);
+        }
+    }
+    if (m_poolRefill > 0) {
+        finishRefill();
+    }
+}
+
+//The connections are opened one at a time, after the refill or the
+//check of the listener in progress
+void RedisServant::onReplaceConnection(socket_t, short, void* arg)
+{
+    RedisServant* servant = (RedisServant*)arg;
+    if (servant->m_connecting == NULL && servant->m_poolRefill == 0) {
+        servant->replaceConnection();
     }
 }
 
+void RedisServant::replaceConnection(void)
+{
+    if (!m_actived || m_poolReplace <= 0) {
+        return;
+    }
+    //The backoff of a failed connect holds the other ones too
+    long long wait = m_replaceRetryTime - currentMsec();
+    if (wait > 0) {
+        m_replaceEvent.active((int)wait);
+        return;
+    }
+    __sync_sub_and_fetch(&m_poolReplace, 1);
+    connectAsync(new RedisConnection);
+}
+
+//A connection of the pool is never opened again by select(), the servant
+//opens another one without blocking in its own loop. The blocking lane
+//opens its connections on demand
+void RedisServant::discardConnection(RedisConnection* sock)
+{
+    RedisConnectionPool* pool = sock->m_owner;
+    if (pool != &m_connPool) {
+        pool->free(sock);
+        return;
+    }
+    pool->discard(sock);
+    __sync_add_and_fetch(&m_poolReplace, 1);
+    m_replaceEvent.active(0);
+}
+
 void RedisServant::onDisconnected(socket_t sock, short, void *arg)
 {
     char buff[32];
     int len = recv(sock, buff, sizeof(buff), 0);
     if (len == 0) {
         RedisServant* servant = (RedisServant*)arg;
+        //The server may only have closed the idle listener, the pool is
+        //kept until a new listener can't be opened
+        servant->cancelRefill();
         servant->m_connListener.disconnect();
-        if (servant->m_connListener.connect(servant->m_redisAddress, servant->m_connPool.password())) {
-            servant->m_connEvent.set(servant->m_loop,
-                                     servant->m_connListener.m_socket.socket(),
-                                     EV_READ, onDisconnected, servant);
-            servant->m_connEvent.active();
-            return;
-        }
-
-        servant->stop();
-
-        LOG(Logger::Warning, "Redis server (%s:%d) disconnected",
-                    servant->redisAddress().ip(),
-                    servant->redisAddress().port());
-        onReconnect(0, 0, servant);
+        servant->connectAsync(&servant->m_connListener);
     }
 }
 
 void RedisServant::onSendRequest(socket_t sock, short, void *arg)
 {
     ClientPacket* packet = (ClientPacket*)arg;
-    RedisConnection* redisSocket = packet->redisSocket;
     RedisServant* redisServant = packet->requestServant;
+    packet->servantSent = true;
 
     char* sendBuff = packet->recvParseResult.protoBuff + packet->sendToRedisBytes;
     int sendSize = packet->recvParseResult.protoBuffLen - packet->sendToRedisBytes;
@@ -332,7 +1056,7 @@ void RedisServant::onSendRequest(socket_t sock, short, void *arg)
         } else {
             packet->sendToRedisBytes = 0;
             packet->_event.set(packet->eventLoop, sock, EV_READ, onRecvReply, packet);
-            packet->_event.active();
+            packet->_event.active(packet->redisTimeout);
         }
         break;
     case TcpSocket::IOAgain:
@@ -342,34 +1066,53 @@ void RedisServant::onSendRequest(socket_t sock, short, void *arg)
     case TcpSocket::IOError:
         LOG(Logger::Debug, "Send to redis server (%s:%d) failed. socket=%d",
             redisServant->redisAddress().ip(), redisServant->redisAddress().port(), sock);
-        if (!redisServant->m_connPool.repairSocket(redisSocket)) {
-            redisServant->m_connPool.free(redisSocket);
-        } else {
-            redisServant->onRedisSocketUseCompleted(redisSocket);
-        }
+        redisServant->requestFailed();
+        redisServant->onRedisSocketBroken(packet);
         packet->sendBuff.append("-ERR backend connection invalid\r\n");
         packet->setFinishedState(ClientPacket::RequestFinished);
         break;
     }
 }
 
-void RedisServant::onRecvReply(socket_t sock, short, void *arg)
+void RedisServant::onRecvReply(socket_t sock, short events, void *arg)
 {
     ClientPacket* packet = (ClientPacket*)arg;
-    RedisConnection* redisSocket = packet->redisSocket;
     RedisServant* redisServant = packet->requestServant;
+    if (events & EV_TIMEOUT) {
+        //Only blocking requests have a timeout. The reply may still
+        //arrive, so the connection is closed instead of reused
+        LOG(Logger::Debug, "Redis server (%s:%d) reply timeout. socket=%d",
+            redisServant->redisAddress().ip(), redisServant->redisAddress().port(), sock);
+        packet->redisSocket->m_owner->free(packet->redisSocket);
+        packet->redisSocket = NULL;
+        packet->sendBuff.truncate(packet->sendBufferParsedOffset);
+        packet->sendBuff.append("*-1\r\n");
+        packet->setFinishedState(ClientPacket::RequestFinished);
+        return;
+    }
+
     IOBuffer& sendbuf = packet->sendBuff;
     IOBuffer::DirectCopy cp = sendbuf.beginCopy();
     TcpSocket socket(sock);
     int ret = socket.asyncRecv(cp.address, cp.maxsize);
     switch (ret) {
-    default:
+    default: {
         sendbuf.endCopy(ret);
-        switch (packet->continueToParseSendBuffer()) {
+        RedisProto::ParseState state = packet->continueToParseSendBuffer();
+        while (state == RedisProto::ProtoOK && packet->redisReplyCount > 1) {
+            --packet->redisReplyCount;
+            state = packet->continueToParseSendBuffer();
+        }
+        switch (state) {
         case RedisProto::ProtoError:
             LOG(Logger::Debug, "Recv data from redis server (%s:%d), protocol error",
                 redisServant->redisAddress().ip(), redisServant->redisAddress().port());
-            redisServant->onRedisSocketUseCompleted(redisSocket);
+            redisServant->requestFailed();
+            if (packet->keepRedisSocket) {
+                redisServant->onRedisSocketBroken(packet);
+            } else {
+                redisServant->onRedisSocketUseCompleted(packet->redisSocket);
+            }
             packet->sendBuff.append("-ERR backend protocol error\r\n");
             packet->setFinishedState(ClientPacket::RequestFinished);
             break;
@@ -377,36 +1120,34 @@ void RedisServant::onRecvReply(socket_t sock, short, void *arg)
             onRecvReply(sock, 0, packet);
             break;
         case RedisProto::ProtoOK:
-            redisServant->onRedisSocketUseCompleted(redisSocket);
+            redisServant->requestSucceeded();
+            if (!packet->keepRedisSocket) {
+                redisServant->onRedisSocketUseCompleted(packet->redisSocket);
+            }
             packet->setFinishedState(ClientPacket::RequestFinished);
             break;
         default:
             break;
         }
         break;
+    }
     case 0:
         LOG(Logger::Debug, "Redis server (%s:%d) closed the connection. socket=%d",
             redisServant->redisAddress().ip(), redisServant->redisAddress().port(), sock);
-        if (!redisServant->m_connPool.repairSocket(redisSocket)) {
-            redisServant->m_connPool.free(redisSocket);
-        } else {
-            redisServant->onRedisSocketUseCompleted(redisSocket);
-        }
+        redisServant->requestFailed();
+        redisServant->onRedisSocketBroken(packet);
         packet->sendBuff.append("-ERR server closed the connection\r\n");
         packet->setFinishedState(ClientPacket::RequestFinished);
         break;
     case TcpSocket::IOAgain:
         packet->_event.set(packet->eventLoop, sock, EV_READ, onRecvReply, packet);
-        packet->_event.active();
+        packet->_event.active(packet->redisTimeout);
         break;
     case TcpSocket::IOError:
         LOG(Logger::Debug, "Recv from redis server (%s:%d) failed. socket=%d",
             redisServant->redisAddress().ip(), redisServant->redisAddress().port(), sock);
-        if (!redisServant->m_connPool.repairSocket(redisSocket)) {
-            redisServant->m_connPool.free(redisSocket);
-        } else {
-            redisServant->onRedisSocketUseCompleted(redisSocket);
-        }
+        redisServant->requestFailed();
+        redisServant->onRedisSocketBroken(packet);
         packet->sendBuff.append("-ERR backend connection invalid\r\n");
         packet->setFinishedState(ClientPacket::RequestFinished);
         break;
@@ -20,7 +20,11 @@
 #ifndef REDISSERVANT_H
 #define REDISSERVANT_H
 
+#include <string.h>
+#include <math.h>
 #include <string>
+#include <vector>
+#include <unordered_map>
 
 #include "util/vector.h"
 #include "util/queue.h"
@@ -28,8 +32,12 @@
 #include "util/tcpsocket.h"
 
 #include "eventloop.h"
+#include "command.h"
+#include "circuitbreaker.h"
 
 class ClientPacket;
+class RedisServant;
+class RedisConnectionPool;
 class RedisConnection
 {
 public:
@@ -37,13 +45,19 @@ public:
     ~RedisConnection(void);
 
     bool connect(const HostAddress& addr, const std::string& pwd);
+    //Start a connection without waiting, it is usable once writable
+    bool asyncConnect(const HostAddress& addr);
     bool isActived(void) const { return !m_socket.isNull(); }
     void disconnect(void);
 
 private:
     TcpSocket m_socket;
+    RedisConnectionPool* m_owner;
+    long long m_lastUsed;           //Msec the connection went back to the pool
     friend class RedisConnectionPool;
     friend class RedisServant;
+    friend class PubSub;
+    friend class HotKeyCache;
 };
 
 
@@ -61,23 +75,57 @@ public:
     int activeConnectionNums(void) const { return m_activeConnNums; }
     int unActiveConnectionNums(void) const { return m_pool.size(); }
 
+    //The capacity moves between the bounds, the controller of the servant
+    //raises it and the idle connections lower it
+    void setBounds(int minCapacity, int maxCapacity);
+    int minCapacity(void) const { return m_minCapacity; }
+    int maxCapacity(void) const { return m_maxCapacity; }
+    //Close the connections unused since the time, in msec, above the
+    //lower bound. Returns the closed connections
+    int closeIdle(long long idleSince);
+
     bool open(const HostAddress& addr, int capacity);
+    void setup(const HostAddress& addr, int capacity);
+    //A pool whose owner opens the connections in the background never
+    //connects in select(), it would block the loop of the caller
+    void setConnectOnDemand(bool b) { m_connectOnDemand = b; }
+    //Add a connection opened by the owner, the capacity follows
+    void adopt(RedisConnection* sock);
     RedisConnection* select(void);
     void unSelect(RedisConnection* sock);
-    bool repairSocket(RedisConnection* sock);
     void free(RedisConnection* sock);
+    //Like free(), the capacity shrinks until the owner adopts another one
+    void discard(RedisConnection* sock);
     void close(void);
 
 private:
     HostAddress m_redisAddress;
     SpinLocker m_locker;
     int m_capacity;
+    int m_minCapacity;
+    int m_maxCapacity;
     int m_activeConnNums;
+    bool m_connectOnDemand;
     std::string m_password;
     //Vector<RedisConnection*> m_pool;
     Queue<RedisConnection*> m_pool;
 };
 
+//Identical reads sent to a servant while one of them is in flight. Only
+//the first packet is sent, its reply is copied to the waiting packets
+struct RequestFlight
+{
+    RequestFlight(void) {
+        servant = NULL;
+        replyOffset = 0;
+    }
+
+    RedisServant* servant;
+    std::string request;                //Raw request, the key of the flight
+    int replyOffset;                    //Offset of the reply in the send buffer
+    std::vector<ClientPacket*> waiters;
+};
+
 class RedisServant
 {
 public:
@@ -87,6 +135,17 @@ public:
             maxReconnCount = 100;
             reconnInterval = 1;
             poolSize = 50;
+            blockingPoolSize = 10;
+            blockingTimeout = 0;
+            readWeight = 1;
+            requestTimeout = 0;
+            maxQueue = 0;
+            maxQueueWait = 0;
+            minPoolSize = 50;
+            maxPoolSize = 50;
+            poolIdleTimeout = 0;
+            poolGrowWait = 5;
+            memset(singleFlight, 0, sizeof(singleFlight));
         }
         ~Option(void) {}
 
@@ -94,6 +153,25 @@ public:
         int reconnInterval;
         int maxReconnCount;
         int poolSize;
+        int blockingPoolSize;   //Connections for blocking commands
+        int blockingTimeout;    //Seconds a blocking command may wait, 0 for no limit
+        int readWeight;         //Share of the reads of the read_balance policy
+        int requestTimeout;     //Msec a request may wait for its reply, 0 for no limit
+        int maxQueue;           //Requests waiting for a connection, 0 for no limit
+        int maxQueueWait;       //Msec a request may wait for a connection, 0 for no limit
+        int minPoolSize;        //Bounds of the adaptive pool, poolSize is the initial size
+        int maxPoolSize;
+        int poolIdleTimeout;    //Seconds before an idle connection is closed, 0 to keep them
+        int poolGrowWait;       //Msec of queue wait which grows the pool
+        bool singleFlight[RedisCommand::CMD_COUNT];    //Commands coalesced while in flight
+    };
+
+    enum {
+        BlockingReplyGrace = 1000,
+        PoolAdjustInterval = 1000,      //Msec between the decisions on the pool size
+        ConnectTimeout = 3000,          //Msec to open and verify a connection
+        MaxReconnInterval = 60000,      //Msec the reconnection backoff grows to
+        LatencyDecayTime = 1000000      //Usec for an idle latency to fall by e
     };
 
     RedisServant(void);
@@ -105,6 +183,7 @@ public:
 
     void setOption(const Option& opt) { m_option = opt; }
     Option option(void) const { return m_option; }
+    int readWeight(void) const { return m_option.readWeight; }
 
     void setReconnectEnabled(bool b) { m_reconnectEnabled = b; }
     bool reconnectEnabled(void) const { return m_reconnectEnabled; }
@@ -113,32 +192,127 @@ public:
     EventLoop* eventLoop(void) const { return m_loop; }
 
     RedisConnectionPool* connectionPool(void) { return &m_connPool; }
+    RedisConnectionPool* blockingConnectionPool(void) { return &m_blockingPool; }
 
-    bool isActived(void) const { return m_actived; }
+    //Not while the circuit breaker keeps the requests away
+    bool isActived(void) const { return m_actived && m_breaker.isAvailable(); }
     bool start(void);
     void stop(void);
 
     void handle(ClientPacket* packet);
+    void handle(ClientPacket* packet, RedisConnection* sock);
+
+    //Blocking commands run on a separate, bounded set of connections so
+    //they never hold the connections of the other requests. The timeout
+    //of the command is in milliseconds, 0 for no timeout
+    void handleBlocking(ClientPacket* packet, int timeout);
+
+    //Give back a connection kept by a keepRedisSocket request. A dirty
+    //connection is closed instead of going back to the pool
+    void unpinConnection(RedisConnection* sock, bool dirty);
+
+    //Called by the first packet of a flight when its reply arrived
+    void flightFinished(ClientPacket* packet, RequestFlight* flight);
+    int flightCount(void);
+    long long flightRequests(void) const { return m_flightRequests; }
+    long long flightCoalesced(void) const { return m_flightCoalesced; }
+
+    //Reply latency of the requests in usec. It follows a slower reply at
+    //once and a faster one slowly, and decays while no reply arrives so
+    //a servant left aside gets tried again
+    void requestStarted(ClientPacket* packet);
+    void requestFinished(long long startTime, bool sent);
+    double latency(void);
+    int outstandingRequests(void) const { return m_outstanding; }
+    //Cost of one more request, for the latency_aware policy
+    double load(void) { return latency() * (m_outstanding + 1); }
+
+    //Requests queued for a connection plus the connections in use, read
+    //without a lock by the least_outstanding policy
+    int inFlight(void) const { return m_queued + m_connPool.activeConnectionNums(); }
+
+    //Requests refused with -BUSY because the queue was full or too slow
+    long long rejectedRequests(void) const { return m_rejected; }
+
+    CircuitBreaker* circuitBreaker(void) { return &m_breaker; }
+
+    //Decisions of the pool size controller
+    int poolGrows(void) const { return m_poolGrows; }
+    int poolShrinks(void) const { return m_poolShrinks; }
+
+    //Bytes of the requests queued by all the servants, the proxy stops
+    //reading the clients above its limit
+    static long long queuedBytes(void);
 
 private:
+    bool joinFlight(ClientPacket* packet);
+    bool admitRequest(void);
+    void dequeued(ClientPacket* packet);
+    static void onFlightReply(socket_t sock, short, void* arg);
     void onRedisSocketUseCompleted(RedisConnection* sock);
+    void onRedisSocketBroken(ClientPacket* packet);
     static void onDisconnected(socket_t sock, short, void* arg);
     static void onReconnect(socket_t sock, short, void* arg);
+    int reconnectDelay(int attempts);
+    void connectAsync(RedisConnection* conn);
+    void connectFinished(bool ok);
+    void refillPool(void);
+    void finishRefill(void);
+    void cancelRefill(void);
+    static void onReplaceConnection(socket_t, short, void* arg);
+    void replaceConnection(void);
+    void discardConnection(RedisConnection* sock);
+    static void onConnectWritable(socket_t sock, short events, void* arg);
+    static void onConnectReply(socket_t sock, short events, void* arg);
     static void onSendRequest(socket_t sock, short, void* arg);
     static void onRecvReply(socket_t sock, short, void* arg);
+    static void onRequestTimeout(void* arg);
+    static void onQueueExpired(socket_t, short, void* arg);
+    static void onAdjustPool(socket_t, short, void* arg);
+    void adjustPool(void);
+    void requestSucceeded(void);
+    void requestFailed(void);
 
 private:
     HostAddress m_redisAddress;
     int m_reconnCount;
+    unsigned int m_reconnSeed;          //Jitter of the backoff, apart for each servant
     Event m_connEvent;
     RedisConnection m_connListener;
+    RedisConnection* m_connecting;      //The listener or a connection of the refill
+    Event m_connectingEvent;
+    std::string m_connectReply;
+    int m_connectReplies;               //Replies the check of the connection waits for
+    int m_poolRefill;                   //Connections the refill still has to open
+    volatile int m_poolReplace;         //Broken connections to open again after the refill
+    int m_replaceRetries;               //Failed connects in a row, for the backoff
+    long long m_replaceRetryTime;       //Msec before which no connection is opened again
+    Event m_replaceEvent;
     EventLoop* m_loop;
     Option m_option;
     Queue<ClientPacket*> m_requests;
+    volatile int m_queued;
+    volatile long long m_rejected;
+    long long m_queueWaitSum;       //Msec waited by the requests dequeued since the last decision
+    int m_queueWaitCount;
+    Event m_poolEvent;
+    int m_poolGrows;
+    int m_poolShrinks;
+    CircuitBreaker m_breaker;
     SpinLocker m_locker;
     bool m_actived;
     bool m_reconnectEnabled;
     RedisConnectionPool m_connPool;
+    RedisConnectionPool m_blockingPool;
+    typedef std::unordered_map<std::string, RequestFlight*> FlightMap;
+    FlightMap m_flights;
+    SpinLocker m_flightLocker;
+    long long m_flightRequests;
+    long long m_flightCoalesced;
+    SpinLocker m_latencyLocker;
+    double m_latency;
+    long long m_latencyTime;
+    volatile int m_outstanding;
 
 private:
     RedisServant(const RedisServant&);
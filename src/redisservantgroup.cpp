@@ -17,6 +17,7 @@
 * under the License.
 */
 
+#include "util/clock.h"
 #include "util/logger.h"
 #include "redisproxy.h"
 #include "redisservant.h"
@@ -46,6 +47,10 @@ RedisServantGroupPolicy *RedisServantGroupPolicy::createPolicy(const char *name)
         return new MasterOnlyPolicy;
     } else if (strcmp(name, POLICY_READ_BALANCE) == 0) {
         return new ReadBalancePolicy;
+    } else if (strcmp(name, POLICY_LATENCY_AWARE) == 0) {
+        return new LatencyAwarePolicy;
+    } else if (strcmp(name, POLICY_LEAST_OUTSTANDING) == 0) {
+        return new LeastOutstandingPolicy;
     } else {
         return new MasterOnlyPolicy;
     }
@@ -60,6 +65,8 @@ RedisServantGroup::RedisServantGroup(void)
     m_masterCount = 0;
     m_slaveCount = 0;
     m_policy = NULL;
+    m_compressThreshold = 0;
+    m_readYourWrites = 0;
 }
 
 RedisServantGroup::~RedisServantGroup(void)
@@ -135,6 +142,14 @@ void RedisServantGroup::setEnabled(bool b)
     }
 }
 
+bool RedisServantGroup::readsOwnWrite(ClientPacket* packet) const
+{
+    // a slave may not have the client's writes yet
+    long long lastWrite = packet->session->lastWriteTime;
+    return m_readYourWrites > 0 && lastWrite > 0 &&
+        currentMsec() - lastWrite < m_readYourWrites;
+}
+
 bool RedisServantGroup::isEnabled(void) const
 {
     for (int i = 0; i < m_masterCount; ++i) {
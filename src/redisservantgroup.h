@@ -20,6 +20,8 @@
 #ifndef REDISSERVANTGROUP_H
 #define REDISSERVANTGROUP_H
 
+#include "requesthedger.h"
+
 class ClientPacket;
 class RedisServant;
 class RedisServantGroup;
@@ -55,6 +57,19 @@ public:
     void setPolicy(RedisServantGroupPolicy* policy);
     RedisServantGroupPolicy* policy(void) const { return m_policy; }
 
+    //Values of at least threshold bytes are stored compressed, 0 to disable
+    void setCompressThreshold(int threshold) { m_compressThreshold = threshold; }
+    int compressThreshold(void) const { return m_compressThreshold; }
+
+    //Reads of a client go to a master for msec after its last write, 0 to disable
+    void setReadYourWrites(int msec) { m_readYourWrites = msec; }
+    int readYourWrites(void) const { return m_readYourWrites; }
+    //The client of the packet wrote within the read-your-writes window
+    bool readsOwnWrite(ClientPacket* packet) const;
+
+    //Slow reads sent again to another servant, disabled by default
+    RequestHedger* hedger(void) { return &m_hedger; }
+
     void addMasterRedisServant(RedisServant* servant);
     void addSlaveRedisServant(RedisServant* servant);
 
@@ -78,6 +93,9 @@ private:
     RedisServant* m_master[MaxServantCount];
     RedisServant* m_slaver[MaxServantCount];
     RedisServantGroupPolicy* m_policy;
+    int m_compressThreshold;
+    int m_readYourWrites;
+    RequestHedger m_hedger;
 
 private:
     RedisServantGroup(const RedisServantGroup&);
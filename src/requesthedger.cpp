@@ -0,0 +1,268 @@
+﻿/*
+* Licensed to the Apache Software Foundation (ASF) under one
+* or more contributor license agreements.  See the NOTICE file
+* distributed with this work for additional information
+* regarding copyright ownership.  The ASF licenses this file
+* to you under the Apache License, Version 2.0 (the
+* "License"); you may not use this file except in compliance
+* with the License.  You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing,
+* software distributed under the License is distributed on an
+* "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+* KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations
+* under the License.
+*/
+
+#include <algorithm>
+
+#include "util/clock.h"
+#include "util/logger.h"
+#include "command.h"
+#include "redisproxy.h"
+#include "redisservant.h"
+#include "redisservantgroup.h"
+#include "hotkeycache.h"
+#include "timerwheel.h"
+#include "requesthedger.h"
+
+struct RequestHedger::Context
+{
+    RequestHedger* owner;
+    RedisServantGroup* group;
+    ClientPacket* packet;
+    ClientPacket* subs[2];
+    long long startTime[2];
+    int sent;
+    int returned;
+    bool replied;
+    TimerWheel::Timer timer;
+};
+
+//Upper bounds of the reply time buckets in usec, 25% apart from 100us
+static const long long* bucketBounds(void)
+{
+    static long long bounds[RequestHedger::BucketCount];
+    static bool ready = false;
+    if (!ready) {
+        double bound = 100;
+        for (int i = 0; i < RequestHedger::BucketCount; ++i) {
+            bounds[i] = (long long)bound;
+            bound *= 1.25;
+        }
+        ready = true;
+    }
+    return bounds;
+}
+
+RequestHedger::RequestHedger(void)
+{
+    m_delay = 0;
+    m_requests = 0;
+    m_hedged = 0;
+    m_won = 0;
+    m_samples = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        m_buckets[i] = 0;
+    }
+    bucketBounds();
+}
+
+RequestHedger::~RequestHedger(void)
+{
+}
+
+void RequestHedger::setOption(const Option& opt)
+{
+    m_option = opt;
+    m_delay = opt.delay;
+}
+
+bool RequestHedger::handle(RedisServantGroup* group, ClientPacket* packet)
+{
+    int type = packet->commandType;
+    if (!HotKeyCache::isReadOnly(type) || type == RedisCommand::PUBLISH ||
+        group->masterCount() + group->slaveCount() < 2 || group->readsOwnWrite(packet)) {
+        return false;
+    }
+
+    RedisProtoParseResult& r = packet->recvParseResult;
+    ClientPacket* sub = new ClientPacket;
+    sub->eventLoop = packet->eventLoop;
+    sub->commandType = type;
+    sub->session = packet->session;
+    sub->recvBuff.append(r.protoBuff, r.protoBuffLen);
+    sub->continueToParseRecvBuffer();
+
+    RedisServant* servant = group->findUsableServant(sub);
+    if (servant == NULL) {
+        delete sub;
+        return false;
+    }
+
+    Context* context = new Context;
+    context->owner = this;
+    context->group = group;
+    context->packet = packet;
+    context->subs[0] = sub;
+    context->subs[1] = NULL;
+    context->startTime[0] = currentUsec();
+    context->sent = 1;
+    context->returned = 0;
+    context->replied = false;
+    sub->finished_func = onReply;
+    sub->finished_arg = context;
+    __sync_add_and_fetch(&m_requests, 1);
+
+    //The timer is armed first, the reply may come back at once
+    packet->eventLoop->timerWheel()->add(&context->timer, m_delay, onHedgeTimer, context);
+    servant->handle(sub);
+    return true;
+}
+
+//The active servant with the fewest requests in flight, besides the
+//first one. Servants without a read weight get no reads
+RedisServant* RequestHedger::secondServant(RedisServantGroup* group, RedisServant* first)
+{
+    RedisServant* best = NULL;
+    int count = group->masterCount() + group->slaveCount();
+    for (int i = 0; i < count; ++i) {
+        RedisServant* servant = (i < group->masterCount()) ?
+            group->master(i) : group->slave(i - group->masterCount());
+        if (servant == first || !servant->isActived() || servant->readWeight() <= 0) {
+            continue;
+        }
+        if (best == NULL || servant->inFlight() < best->inFlight()) {
+            best = servant;
+        }
+    }
+    return best;
+}
+
+void RequestHedger::onHedgeTimer(void* arg)
+{
+    Context* context = (Context*)arg;
+    RequestHedger* owner = context->owner;
+    if (context->replied || context->sent > 1) {
+        return;
+    }
+    if (owner->m_hedged * 100 >= owner->m_requests * owner->m_option.budget) {
+        return;
+    }
+    RedisServant* servant = owner->secondServant(context->group, context->subs[0]->requestServant);
+    if (servant == NULL) {
+        return;
+    }
+
+    ClientPacket* first = context->subs[0];
+    ClientPacket* sub = new ClientPacket;
+    sub->eventLoop = first->eventLoop;
+    sub->commandType = first->commandType;
+    sub->session = first->session;
+    sub->finished_func = onReply;
+    sub->finished_arg = context;
+    RedisProtoParseResult& r = context->packet->recvParseResult;
+    sub->recvBuff.append(r.protoBuff, r.protoBuffLen);
+    sub->continueToParseRecvBuffer();
+    context->subs[1] = sub;
+    context->startTime[1] = currentUsec();
+    context->sent = 2;
+    __sync_add_and_fetch(&owner->m_hedged, 1);
+    servant->handle(sub);
+}
+
+void RequestHedger::onReply(ClientPacket* sub, void* arg)
+{
+    Context* context = (Context*)arg;
+    RequestHedger* owner = context->owner;
+    int index = (sub == context->subs[0]) ? 0 : 1;
+    bool error = sub->isErrorReply();
+    ++context->returned;
+    if (!error) {
+        owner->record(currentUsec() - context->startTime[index]);
+    }
+
+    //An error waits for the other request if there is one
+    if (!context->replied && (!error || context->returned == context->sent)) {
+        context->replied = true;
+        TimerWheel::cancel(&context->timer);
+        ClientPacket* packet = context->packet;
+        if (sub->sendBuff.isEmpty()) {
+            packet->sendBuff.append("-ERR backend is not available\r\n");
+        } else {
+            packet->sendBuff.append(sub->sendBuff);
+        }
+        if (index == 1) {
+            __sync_add_and_fetch(&owner->m_won, 1);
+        }
+        packet->setFinishedState(ClientPacket::RequestFinished);
+    }
+
+    if (context->replied && context->returned == context->sent) {
+        for (int i = 0; i < context->sent; ++i) {
+            delete context->subs[i];
+        }
+        delete context;
+    }
+}
+
+void RequestHedger::record(long long usec)
+{
+    if (m_option.percentile <= 0) {
+        return;
+    }
+    const long long* bounds = bucketBounds();
+    int index = std::lower_bound(bounds, bounds + BucketCount, usec) - bounds;
+    if (index >= BucketCount) {
+        index = BucketCount - 1;
+    }
+    __sync_add_and_fetch(&m_buckets[index], 1);
+    if (__sync_add_and_fetch(&m_samples, 1) % PercentileWindow == 0) {
+        updateDelay();
+    }
+}
+
+//The counts are halved after each update, the delay follows the recent
+//reply times
+void RequestHedger::updateDelay(void)
+{
+    const long long* bounds = bucketBounds();
+    long long counts[BucketCount];
+    long long total = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        counts[i] = m_buckets[i];
+        total += counts[i];
+    }
+    if (total == 0) {
+        return;
+    }
+
+    long long rank = total * m_option.percentile / 100;
+    long long seen = 0;
+    int index = 0;
+    for (; index < BucketCount - 1; ++index) {
+        seen += counts[index];
+        if (seen > rank) {
+            break;
+        }
+    }
+    int delay = (int)((bounds[index] + 999) / 1000);
+    m_delay = std::max(delay, m_option.delay);
+
+    for (int i = 0; i < BucketCount; ++i) {
+        __sync_sub_and_fetch(&m_buckets[i], counts[i] / 2);
+    }
+}
+
+RequestHedger::Stats RequestHedger::stats(void) const
+{
+    Stats s;
+    s.requests = m_requests;
+    s.hedged = m_hedged;
+    s.won = m_won;
+    s.delay = m_delay;
+    return s;
+}
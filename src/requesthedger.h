@@ -0,0 +1,98 @@
+﻿/*
+* Licensed to the Apache Software Foundation (ASF) under one
+* or more contributor license agreements.  See the NOTICE file
+* distributed with this work for additional information
+* regarding copyright ownership.  The ASF licenses this file
+* to you under the Apache License, Version 2.0 (the
+* "License"); you may not use this file except in compliance
+* with the License.  You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing,
+* software distributed under the License is distributed on an
+* "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+* KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations
+* under the License.
+*/
+
+#ifndef REQUESTHEDGER_H
+#define REQUESTHEDGER_H
+
+#include "eventloop.h"
+
+class ClientPacket;
+class RedisServant;
+class RedisServantGroup;
+
+//Reads of a group which got no reply after a delay are sent again to
+//another servant. The first good reply goes to the client, the other one
+//is dropped when it arrives. The delay is fixed, or a percentile of the
+//recent reply times of the group when that is longer. The second
+//requests are kept under a share of the reads so a slow group isn't
+//loaded twice
+class RequestHedger
+{
+public:
+    struct Option {
+        Option(void) {
+            delay = 0;
+            percentile = 0;
+            budget = 10;
+        }
+
+        int delay;          //Msec before the second request, 0 to disable
+        int percentile;     //Percentile of the reply times used as the delay, 0 for a fixed delay
+        int budget;         //Second requests in percent of the reads at most
+    };
+
+    struct Stats {
+        long long requests;
+        long long hedged;
+        long long won;      //Second requests which replied first
+        int delay;
+    };
+
+    enum {
+        BucketCount = 64,
+        PercentileWindow = 1000     //Replies between the updates of the delay
+    };
+
+    RequestHedger(void);
+    ~RequestHedger(void);
+
+    void setOption(const Option& opt);
+    Option option(void) const { return m_option; }
+    bool isEnabled(void) const { return (m_option.delay > 0); }
+
+    //Send an idempotent read of the group with a timer for the second
+    //request. False if the packet can't be hedged, it is left untouched
+    bool handle(RedisServantGroup* group, ClientPacket* packet);
+
+    Stats stats(void) const;
+
+private:
+    struct Context;
+
+    RedisServant* secondServant(RedisServantGroup* group, RedisServant* first);
+    void record(long long usec);
+    void updateDelay(void);
+    static void onHedgeTimer(void* arg);
+    static void onReply(ClientPacket* packet, void* arg);
+
+private:
+    Option m_option;
+    volatile int m_delay;
+    volatile long long m_requests;
+    volatile long long m_hedged;
+    volatile long long m_won;
+    volatile long long m_samples;
+    volatile long long m_buckets[BucketCount];
+
+private:
+    RequestHedger(const RequestHedger&);
+    RequestHedger& operator =(const RequestHedger&);
+};
+
+#endif
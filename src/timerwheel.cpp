@@ -0,0 +1,145 @@
+﻿/*
+* Licensed to the Apache Software Foundation (ASF) under one
+* or more contributor license agreements.  See the NOTICE file
+* distributed with this work for additional information
+* regarding copyright ownership.  The ASF licenses this file
+* to you under the Apache License, Version 2.0 (the
+* "License"); you may not use this file except in compliance
+* with the License.  You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing,
+* software distributed under the License is distributed on an
+* "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+* KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations
+* under the License.
+*/
+
+#include "util/clock.h"
+#include "timerwheel.h"
+
+
+TimerWheel::TimerWheel(EventLoop* loop)
+{
+    m_loop = loop;
+    m_ticking = false;
+    m_current = 0;
+    m_lastTick = 0;
+    m_count = 0;
+    for (int i = 0; i < SlotCount; ++i) {
+        m_slots[i].prev = &m_slots[i];
+        m_slots[i].next = &m_slots[i];
+    }
+    m_expired.prev = &m_expired;
+    m_expired.next = &m_expired;
+    m_tick.setTimer(loop, onTick, this);
+}
+
+TimerWheel::~TimerWheel(void)
+{
+    m_tick.remove();
+}
+
+void TimerWheel::add(Timer* timer, int msec, Callback func, void* arg)
+{
+    cancel(timer);
+
+    int ticks = (msec + TickMsec - 1) / TickMsec;
+    if (ticks < 1) {
+        ticks = 1;
+    }
+
+    m_lock.lock();
+    if (!m_ticking) {
+        //The slots didn't move while the wheel was idle
+        m_ticking = true;
+        m_lastTick = currentMsec();
+        m_tick.active(TickMsec);
+    }
+    Timer* head = &m_slots[(m_current + ticks) % SlotCount];
+    timer->wheel = this;
+    timer->rounds = (ticks - 1) / SlotCount;
+    timer->func = func;
+    timer->arg = arg;
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+    ++m_count;
+    m_lock.unlock();
+}
+
+void TimerWheel::cancel(Timer* timer)
+{
+    TimerWheel* wheel = timer->wheel;
+    if (wheel == NULL) {
+        return;
+    }
+    wheel->m_lock.lock();
+    //It may have expired meanwhile
+    if (timer->wheel == wheel) {
+        wheel->unlink(timer);
+    }
+    wheel->m_lock.unlock();
+}
+
+void TimerWheel::unlink(Timer* timer)
+{
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = NULL;
+    timer->next = NULL;
+    timer->wheel = NULL;
+    --m_count;
+}
+
+//The slots passed since the last tick are walked, the libevent timer
+//may come late. The expired timers are called one at a time without the
+//lock: a callback often cancels or adds timers, even the expired ones
+void TimerWheel::onTick(socket_t, short, void* arg)
+{
+    TimerWheel* wheel = (TimerWheel*)arg;
+    Timer* expired = &wheel->m_expired;
+
+    wheel->m_lock.lock();
+    long long now = currentMsec();
+    long long ticks = (now - wheel->m_lastTick) / TickMsec;
+    if (ticks > SlotCount) {
+        ticks = SlotCount;
+    }
+    wheel->m_lastTick += ticks * TickMsec;
+    for (long long t = 0; t < ticks; ++t) {
+        wheel->m_current = (wheel->m_current + 1) % SlotCount;
+        Timer* head = &wheel->m_slots[wheel->m_current];
+        for (Timer* timer = head->next; timer != head;) {
+            Timer* next = timer->next;
+            if (timer->rounds > 0) {
+                --timer->rounds;
+            } else {
+                timer->prev->next = timer->next;
+                timer->next->prev = timer->prev;
+                timer->prev = expired->prev;
+                timer->next = expired;
+                expired->prev->next = timer;
+                expired->prev = timer;
+            }
+            timer = next;
+        }
+    }
+    if (wheel->m_count > 0) {
+        wheel->m_tick.active(TickMsec);
+    } else {
+        wheel->m_ticking = false;
+    }
+
+    while (expired->next != expired) {
+        Timer* timer = expired->next;
+        wheel->unlink(timer);
+        wheel->m_lock.unlock();
+        timer->func(timer->arg);
+        wheel->m_lock.lock();
+    }
+    wheel->m_lock.unlock();
+}
@@ -0,0 +1,96 @@
+﻿/*
+* Licensed to the Apache Software Foundation (ASF) under one
+* or more contributor license agreements.  See the NOTICE file
+* distributed with this work for additional information
+* regarding copyright ownership.  The ASF licenses this file
+* to you under the Apache License, Version 2.0 (the
+* "License"); you may not use this file except in compliance
+* with the License.  You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing,
+* software distributed under the License is distributed on an
+* "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+* KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations
+* under the License.
+*/
+
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include "util/locker.h"
+#include "util/tcpsocket.h"
+
+#include "eventloop.h"
+
+//Hashed timer wheel of an event loop, for the many short timeouts of the
+//requests. Adding and cancelling a timer take constant time, and a
+//single libevent timer ticks the wheel while it holds timers. The timers
+//are embedded in their owners so nothing is allocated. The callbacks run
+//in the loop of the wheel, a timer may be cancelled from any thread
+class TimerWheel
+{
+public:
+    typedef void (*Callback)(void* arg);
+
+    class Timer
+    {
+    public:
+        Timer(void) {
+            wheel = NULL;
+            prev = NULL;
+            next = NULL;
+            rounds = 0;
+            func = NULL;
+            arg = NULL;
+        }
+
+        bool isActive(void) const { return (wheel != NULL); }
+
+    private:
+        TimerWheel* wheel;
+        Timer* prev;
+        Timer* next;
+        int rounds;         //Turns of the wheel left before it expires
+        Callback func;
+        void* arg;
+        friend class TimerWheel;
+    };
+
+    enum {
+        SlotCount = 512,
+        TickMsec = 10
+    };
+
+    TimerWheel(EventLoop* loop);
+    ~TimerWheel(void);
+
+    //The timer expires after msec, rounded up to a tick
+    void add(Timer* timer, int msec, Callback func, void* arg);
+    static void cancel(Timer* timer);
+
+    int count(void) const { return m_count; }
+
+private:
+    void unlink(Timer* timer);
+    static void onTick(socket_t, short, void* arg);
+
+private:
+    EventLoop* m_loop;
+    Event m_tick;
+    bool m_ticking;
+    SpinLocker m_lock;
+    Timer m_slots[SlotCount];       //Heads of the circular lists
+    Timer m_expired;                //Timers of the tick not called yet
+    unsigned int m_current;
+    long long m_lastTick;
+    volatile int m_count;
+
+private:
+    TimerWheel(const TimerWheel&);
+    TimerWheel& operator =(const TimerWheel&);
+};
+
+#endif
@@ -30,6 +30,8 @@ typedef unsigned int (*HashFunc)(const char* s, int len);
 unsigned int hashForBytes(const char *key, int len);
 unsigned int hash_md5(const char *key, int len);
 void md5_signature(unsigned char *key, unsigned long length, unsigned char *result);
+//20 bytes of digest
+void sha1_signature(const unsigned char *data, unsigned long length, unsigned char *result);
 
 unsigned int hash_crc16(const char *key, int len);
 unsigned int hash_crc32(const char *key, int len);
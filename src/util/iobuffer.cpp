@@ -113,6 +113,13 @@ void IOBuffer::clear(void)
     m_ptr = m_data;
 }
 
+void IOBuffer::truncate(int size)
+{
+    if (size >= 0 && size < m_offset) {
+        m_offset = size;
+    }
+}
+
 IOBuffer::DirectCopy IOBuffer::beginCopy(void)
 {
     int freeSize = m_capacity - m_offset;
@@ -40,6 +40,7 @@ public:
     void append(const char* data, int size = -1);
     void append(const IOBuffer& rhs);
     void clear(void);
+    void truncate(int size);
 
     char* data(void) { return m_ptr; }
     const char* data(void) const { return m_ptr; }
@@ -0,0 +1,223 @@
+﻿/*
+* Licensed to the Apache Software Foundation (ASF) under one
+* or more contributor license agreements.  See the NOTICE file
+* distributed with this work for additional information
+* regarding copyright ownership.  The ASF licenses this file
+* to you under the Apache License, Version 2.0 (the
+* "License"); you may not use this file except in compliance
+* with the License.  You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing,
+* software distributed under the License is distributed on an
+* "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+* KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations
+* under the License.
+*/
+
+#include <string.h>
+
+#include "lz4.h"
+
+typedef unsigned char u8;
+typedef unsigned int u32;
+
+enum {
+    MinMatch = 4,
+    LastLiterals = 5,           //The last bytes are always literals
+    MatchFindLimit = 12,        //No match starts in the last bytes
+    HashLog = 12,
+    MaxDistance = 65535,
+    SkipTrigger = 6
+};
+
+static inline u32 read32(const u8* p)
+{
+    u32 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline u32 hash4(u32 v)
+{
+    return (v * 2654435761U) >> (32 - HashLog);
+}
+
+static inline u8* writeLength(u8* op, int len)
+{
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (u8)len;
+    return op;
+}
+
+int lz4_compress_bound(int len)
+{
+    return len + len / 255 + 16;
+}
+
+int lz4_compress(const char* src, int len, char* dst, int capacity)
+{
+    const u8* base = (const u8*)src;
+    const u8* ip = base;
+    const u8* anchor = base;
+    const u8* end = base + len;
+    const u8* mflimit = end - MatchFindLimit;
+    const u8* matchlimit = end - LastLiterals;
+    u8* op = (u8*)dst;
+    u8* oend = op + capacity;
+
+    //Positions are stored plus one, zero is an empty slot
+    int table[1 << HashLog];
+    memset(table, 0, sizeof(table));
+
+    if (len > MatchFindLimit) {
+        int searches = 1 << SkipTrigger;
+        while (ip < mflimit) {
+            u32 seq = read32(ip);
+            u32 h = hash4(seq);
+            int ref = table[h] - 1;
+            table[h] = (int)(ip - base) + 1;
+            if (ref < 0 || (ip - base) - ref > MaxDistance || read32(base + ref) != seq) {
+                //Incompressible data is skipped faster and faster
+                ip += (searches++ >> SkipTrigger);
+                continue;
+            }
+            searches = 1 << SkipTrigger;
+
+            const u8* match = base + ref;
+            while (ip > anchor && match > base && ip[-1] == match[-1]) {
+                --ip;
+                --match;
+            }
+            const u8* p = ip + MinMatch;
+            const u8* m = match + MinMatch;
+            while (p < matchlimit && *p == *m) {
+                ++p;
+                ++m;
+            }
+
+            int literals = (int)(ip - anchor);
+            int matchLen = (int)(p - ip) - MinMatch;
+            if (oend - op < 1 + literals / 255 + 1 + literals + 2 + matchLen / 255 + 1) {
+                return 0;
+            }
+
+            u8* token = op++;
+            if (literals >= 15) {
+                *token = 15 << 4;
+                op = writeLength(op, literals - 15);
+            } else {
+                *token = (u8)(literals << 4);
+            }
+            memcpy(op, anchor, literals);
+            op += literals;
+
+            int offset = (int)(ip - match);
+            *op++ = (u8)(offset & 0xff);
+            *op++ = (u8)(offset >> 8);
+            if (matchLen >= 15) {
+                *token |= 15;
+                op = writeLength(op, matchLen - 15);
+            } else {
+                *token |= (u8)matchLen;
+            }
+
+            ip = p;
+            anchor = ip;
+            if (ip < mflimit) {
+                table[hash4(read32(ip - 2))] = (int)(ip - 2 - base) + 1;
+            }
+        }
+    }
+
+    int literals = (int)(end - anchor);
+    if (oend - op < 1 + literals / 255 + 1 + literals) {
+        return 0;
+    }
+    u8* token = op++;
+    if (literals >= 15) {
+        *token = 15 << 4;
+        op = writeLength(op, literals - 15);
+    } else {
+        *token = (u8)(literals << 4);
+    }
+    memcpy(op, anchor, literals);
+    op += literals;
+    return (int)(op - (u8*)dst);
+}
+
+int lz4_decompress(const char* src, int len, char* dst, int capacity)
+{
+    const u8* ip = (const u8*)src;
+    const u8* iend = ip + len;
+    u8* base = (u8*)dst;
+    u8* op = base;
+    u8* oend = base + capacity;
+
+    while (ip < iend) {
+        int token = *ip++;
+        int literals = token >> 4;
+        if (literals == 15) {
+            int s;
+            do {
+                if (ip >= iend) {
+                    return -1;
+                }
+                s = *ip++;
+                literals += s;
+            } while (s == 255);
+        }
+        if (literals > iend - ip || literals > oend - op) {
+            return -1;
+        }
+        memcpy(op, ip, literals);
+        op += literals;
+        ip += literals;
+
+        //The last sequence has no match
+        if (ip == iend) {
+            break;
+        }
+        if (iend - ip < 2) {
+            return -1;
+        }
+        int offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op - base) {
+            return -1;
+        }
+
+        int matchLen = token & 15;
+        if (matchLen == 15) {
+            int s;
+            do {
+                if (ip >= iend) {
+                    return -1;
+                }
+                s = *ip++;
+                matchLen += s;
+            } while (s == 255);
+        }
+        matchLen += MinMatch;
+        if (matchLen > oend - op) {
+            return -1;
+        }
+
+        //The match may overlap the output
+        const u8* match = op - offset;
+        if (offset >= matchLen) {
+            memcpy(op, match, matchLen);
+            op += matchLen;
+        } else {
+            while (matchLen-- > 0) {
+                *op++ = *match++;
+            }
+        }
+    }
+    return (int)(op - base);
+}
@@ -0,0 +1,35 @@
+﻿/*
+* Licensed to the Apache Software Foundation (ASF) under one
+* or more contributor license agreements.  See the NOTICE file
+* distributed with this work for additional information
+* regarding copyright ownership.  The ASF licenses this file
+* to you under the Apache License, Version 2.0 (the
+* "License"); you may not use this file except in compliance
+* with the License.  You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing,
+* software distributed under the License is distributed on an
+* "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+* KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations
+* under the License.
+*/
+
+#ifndef LZ4_H
+#define LZ4_H
+
+//LZ4 block format, without the frame format
+
+//Largest compressed size of len bytes
+int lz4_compress_bound(int len);
+
+//Return the compressed size, 0 if it doesn't fit in capacity
+int lz4_compress(const char* src, int len, char* dst, int capacity);
+
+//Return the decompressed size, -1 if the block is malformed or
+//doesn't fit in capacity
+int lz4_decompress(const char* src, int len, char* dst, int capacity);
+
+#endif
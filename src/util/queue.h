@@ -50,6 +50,18 @@ public:
         }
     }
 
+    void prepend(const T& object) {
+        Node* node = m_objectPool.alloc();
+        if (node) {
+            node->item = object;
+            node->next = m_entry;
+            m_entry = node;
+            if (m_tail == NULL) {
+                m_tail = node;
+            }
+        }
+    }
+
     T take(const T& defaultVal) {
         Node* node = m_entry;
         if (!node) {
@@ -64,6 +76,30 @@ public:
         return ret;
     }
 
+    T first(const T& defaultVal) const {
+        return m_entry ? m_entry->item : defaultVal;
+    }
+
+    //Remove the first node holding the object, the queue is walked
+    bool remove(const T& object) {
+        Node* prev = NULL;
+        for (Node* node = m_entry; node != NULL; prev = node, node = node->next) {
+            if (node->item == object) {
+                if (prev) {
+                    prev->next = node->next;
+                } else {
+                    m_entry = node->next;
+                }
+                if (m_tail == node) {
+                    m_tail = prev;
+                }
+                m_objectPool.free(node);
+                return true;
+            }
+        }
+        return false;
+    }
+
     void clear(void) {
         for (Node* node = m_entry; node != NULL;) {
             Node* next = node->next;
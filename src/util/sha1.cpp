@@ -0,0 +1,99 @@
+﻿/*
+* Licensed to the Apache Software Foundation (ASF) under one
+* or more contributor license agreements.  See the NOTICE file
+* distributed with this work for additional information
+* regarding copyright ownership.  The ASF licenses this file
+* to you under the Apache License, Version 2.0 (the
+* "License"); you may not use this file except in compliance
+* with the License.  You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing,
+* software distributed under the License is distributed on an
+* "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+* KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations
+* under the License.
+*/
+
+#include "hash.h"
+#include <string.h>
+
+//SHA-1 of FIPS 180-1, redis names the Lua scripts by it
+static unsigned int rol(unsigned int value, int bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+static void sha1_block(unsigned int state[5], const unsigned char block[64])
+{
+    unsigned int w[80];
+    for (int i = 0; i < 16; ++i) {
+        w[i] = ((unsigned int)block[i * 4] << 24) | ((unsigned int)block[i * 4 + 1] << 16) |
+               ((unsigned int)block[i * 4 + 2] << 8) | block[i * 4 + 3];
+    }
+    for (int i = 16; i < 80; ++i) {
+        w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    unsigned int a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    for (int i = 0; i < 80; ++i) {
+        unsigned int f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        unsigned int t = rol(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rol(b, 30);
+        b = a;
+        a = t;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+void sha1_signature(const unsigned char *data, unsigned long length, unsigned char *result)
+{
+    unsigned int state[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    unsigned long pos = 0;
+    for (; pos + 64 <= length; pos += 64) {
+        sha1_block(state, data + pos);
+    }
+
+    //The tail, the 0x80 byte and the bit length, in one or two blocks
+    unsigned char block[128];
+    unsigned long rest = length - pos;
+    memset(block, 0, sizeof(block));
+    memcpy(block, data + pos, rest);
+    block[rest] = 0x80;
+    int blocks = (rest < 56) ? 1 : 2;
+    unsigned long long bits = (unsigned long long)length * 8;
+    for (int i = 0; i < 8; ++i) {
+        block[blocks * 64 - 1 - i] = (unsigned char)(bits >> (i * 8));
+    }
+    for (int i = 0; i < blocks; ++i) {
+        sha1_block(state, block + i * 64);
+    }
+
+    for (int i = 0; i < 5; ++i) {
+        result[i * 4] = (unsigned char)(state[i] >> 24);
+        result[i * 4 + 1] = (unsigned char)(state[i] >> 16);
+        result[i * 4 + 2] = (unsigned char)(state[i] >> 8);
+        result[i * 4 + 3] = (unsigned char)state[i];
+    }
+}
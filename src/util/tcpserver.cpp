@@ -87,7 +87,9 @@ void onWriteClientHandler(socket_t, short, void* arg)
 
 void TcpServer::onAcceptHandler(evutil_socket_t sock, short, void* arg)
 {
+    //Only the family is set for the clients of a unix socket
     sockaddr_in clientAddr;
+    memset(&clientAddr, 0, sizeof(sockaddr_in));
     socketlen_t len = sizeof(sockaddr_in);
     socket_t clisock = accept(sock, (sockaddr*)&clientAddr, &len);
     TcpSocket socket(clisock);
@@ -97,7 +99,9 @@ void TcpServer::onAcceptHandler(evutil_socket_t sock, short, void* arg)
 
     socket.setKeepAlive();
     socket.setNonBlocking();
-    socket.setNoDelay();
+    if (clientAddr.sin_family == AF_INET) {
+        socket.setNoDelay();
+    }
 
     TcpServer* srv = (TcpServer*)arg;
     Context* c = srv->createContextObject();
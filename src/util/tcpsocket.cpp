@@ -25,11 +25,13 @@
 #pragma comment(lib, "advapi32.lib")
 #define SOCK_EAGAIN WSAEWOULDBLOCK
 #define SOCK_EINTR WSAEINTR
+#define SOCK_EINPROGRESS WSAEWOULDBLOCK
 #define SOCK_ERRNO WSAGetLastError()
 #else
 #define closesocket close
 #define SOCK_EAGAIN EAGAIN
 #define SOCK_EINTR EINTR
+#define SOCK_EINPROGRESS EINPROGRESS
 #define SOCK_ERRNO (errno)
 #endif
 
@@ -62,6 +64,7 @@ HostAddress::HostAddress(int port)
     m_addr.sin_family = AF_INET;
     m_addr.sin_port = htons(port);
     m_addr.sin_addr.s_addr = 0;
+    m_path[0] = '\0';
 }
 
 HostAddress::HostAddress(const char *ip, int port)
@@ -69,11 +72,21 @@ HostAddress::HostAddress(const char *ip, int port)
     m_addr.sin_family = AF_INET;
     m_addr.sin_port = htons(port);
     m_addr.sin_addr.s_addr = inet_addr(ip);
+    m_path[0] = '\0';
 }
 
 HostAddress::HostAddress(const sockaddr_in &addr)
 {
     m_addr = addr;
+    m_path[0] = '\0';
+}
+
+HostAddress HostAddress::unixAddress(const char *path)
+{
+    HostAddress addr;
+    strncpy(addr.m_path, path, MaxPathLength);
+    addr.m_path[MaxPathLength] = '\0';
+    return addr;
 }
 
 HostAddress::~HostAddress(void)
@@ -82,6 +95,9 @@ HostAddress::~HostAddress(void)
 
 const char *HostAddress::ip(void) const
 {
+    if (isUnix()) {
+        return m_path;
+    }
     char* s = inet_ntoa(m_addr.sin_addr);
     strcpy(m_ipBuff, s);
     return m_ipBuff;
@@ -110,6 +126,40 @@ TcpSocket TcpSocket::createTcpSocket(void)
     return TcpSocket(sock);
 }
 
+TcpSocket TcpSocket::createUnixSocket(void)
+{
+#ifndef WIN32
+    socket_t sock = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    return TcpSocket(sock);
+#else
+    return TcpSocket();
+#endif
+}
+
+TcpSocket TcpSocket::createSocket(const HostAddress &addr)
+{
+    return addr.isUnix() ? createUnixSocket() : createTcpSocket();
+}
+
+//The sockaddr to connect to, a sockaddr_un for a unix socket path
+static sockaddr* socketAddress(const HostAddress& addr, sockaddr_storage* storage, socketlen_t* len)
+{
+#ifndef WIN32
+    if (addr.isUnix()) {
+        sockaddr_un* un = (sockaddr_un*)storage;
+        memset(un, 0, sizeof(sockaddr_un));
+        un->sun_family = AF_UNIX;
+        strncpy(un->sun_path, addr.path(), sizeof(un->sun_path) - 1);
+        *len = sizeof(sockaddr_un);
+        return (sockaddr*)un;
+    }
+#else
+    (void)storage;
+#endif
+    *len = sizeof(sockaddr_in);
+    return (sockaddr*)addr._sockaddr();
+}
+
 bool TcpSocket::bind(const HostAddress& addr)
 {
     if (::bind(m_socket, (sockaddr*)addr._sockaddr(), sizeof(sockaddr_in)) != 0) {
@@ -249,13 +299,37 @@ int TcpSocket::recvBufferSize(void)
 
 bool TcpSocket::connect(const HostAddress &addr)
 {
-    if (::connect(m_socket, (sockaddr*)addr._sockaddr(), sizeof(sockaddr_in)) != 0) {
+    sockaddr_storage storage;
+    socketlen_t len;
+    sockaddr* sa = socketAddress(addr, &storage, &len);
+    if (::connect(m_socket, sa, len) != 0) {
         return false;
     }
 
     return true;
 }
 
+int TcpSocket::asyncConnect(const HostAddress &addr)
+{
+    sockaddr_storage storage;
+    socketlen_t len;
+    sockaddr* sa = socketAddress(addr, &storage, &len);
+    if (::connect(m_socket, sa, len) == 0) {
+        return 0;
+    }
+    return (SOCK_ERRNO == SOCK_EINPROGRESS) ? IOAgain : IOError;
+}
+
+int TcpSocket::error(void)
+{
+    int err = 0;
+    socketlen_t len = sizeof(err);
+    if (option(SOL_SOCKET, SO_ERROR, (char*)&err, &len) != 0) {
+        return SOCK_ERRNO;
+    }
+    return err;
+}
+
 int TcpSocket::asyncSend(const char *buff, int size, int flag)
 {
     for (;;) {
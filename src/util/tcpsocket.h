@@ -34,6 +34,7 @@ typedef int socketlen_t;
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <netinet/tcp.h>
+#include <sys/un.h>
 typedef int socket_t;
 typedef socklen_t socketlen_t;
 #endif
@@ -43,11 +44,20 @@ typedef socklen_t socketlen_t;
 class HostAddress
 {
 public:
+    enum {
+        MaxPathLength = 103     //Fits the sun_path of every platform
+    };
+
     HostAddress(int port = 0);
     HostAddress(const char* ip, int port);
     HostAddress(const sockaddr_in& addr);
     ~HostAddress(void);
 
+    //A unix domain socket, its ip() is the path and its port() 0
+    static HostAddress unixAddress(const char* path);
+    bool isUnix(void) const { return (m_path[0] != '\0'); }
+    const char* path(void) const { return m_path; }
+
     const char* ip(void) const;
     int port(void) const;
 
@@ -57,6 +67,7 @@ public:
 private:
     mutable char m_ipBuff[32];
     sockaddr_in m_addr;
+    char m_path[MaxPathLength + 1];
 };
 
 class TcpSocket
@@ -71,6 +82,9 @@ public:
     ~TcpSocket(void);
 
     static TcpSocket createTcpSocket(void);
+    static TcpSocket createUnixSocket(void);
+    //The socket matching the family of the address
+    static TcpSocket createSocket(const HostAddress& addr);
 
     socket_t socket(void) const { return m_socket; }
 
@@ -103,6 +117,10 @@ public:
     }
 
     //async
+    //0 when connected, IOAgain until the socket is writable, or IOError
+    int asyncConnect(const HostAddress& addr);
+    //Pending error of the socket, the result of an asyncConnect
+    int error(void);
     int asyncSend(const char* buff, int size, int flag = 0);
     int asyncRecv(char* buff, int size, int flag = 0);
 
@@ -0,0 +1,276 @@
+﻿/*
+* Licensed to the Apache Software Foundation (ASF) under one
+* or more contributor license agreements.  See the NOTICE file
+* distributed with this work for additional information
+* regarding copyright ownership.  The ASF licenses this file
+* to you under the Apache License, Version 2.0 (the
+* "License"); you may not use this file except in compliance
+* with the License.  You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing,
+* software distributed under the License is distributed on an
+* "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+* KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations
+* under the License.
+*/
+
+#include <stdio.h>
+#include <errno.h>
+#include <map>
+
+#include "util/hash.h"
+#include "util/logger.h"
+#include "command.h"
+#include "redisproto.h"
+#include "redisproxy.h"
+#include "redisservantgroup.h"
+#include "hotkeycache.h"
+#include "warmstart.h"
+
+struct WarmStart::Batch
+{
+    WarmStart* owner;
+    std::vector<std::string> keys;
+    std::vector<unsigned int> epochs;
+};
+
+static void putInt(std::string& buf, unsigned int v, int bytes)
+{
+    for (int i = 0; i < bytes; ++i) {
+        buf.push_back((char)((v >> (i * 8)) & 0xff));
+    }
+}
+
+static unsigned int getInt(const char* p, int bytes)
+{
+    unsigned int v = 0;
+    for (int i = 0; i < bytes; ++i) {
+        v |= (unsigned int)(unsigned char)p[i] << (i * 8);
+    }
+    return v;
+}
+
+
+WarmStart::WarmStart(void)
+{
+    m_enabled = false;
+    m_proxy = NULL;
+}
+
+WarmStart::~WarmStart(void)
+{
+}
+
+void WarmStart::start(EventLoop *loop)
+{
+    std::vector<std::string> keys;
+    if (load(keys)) {
+        m_stats.loadedKeys = keys.size();
+        LOG(Logger::Message, "Warm start: prefetch %d keys of %s",
+            (int)keys.size(), m_option.file.c_str());
+        prefetch(keys, loop);
+    }
+
+    m_timer.setTimer(loop, onSnapshotTimer, this);
+    m_timer.active(m_option.interval * 1000);
+}
+
+int WarmStart::snapshot(void)
+{
+    std::vector<std::string> keys = m_proxy->hotKeyCache()->hotKeys(m_option.maxKeys);
+    std::string buf("OCWS", 4);
+    putInt(buf, Version, 1);
+    int countOffset = buf.size();
+    putInt(buf, 0, 4);
+    int count = 0;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (keys[i].size() > MaxKeyLength) {
+            continue;
+        }
+        putInt(buf, keys[i].size(), 2);
+        buf.append(keys[i]);
+        ++count;
+    }
+    if (count == 0) {
+        return 0;
+    }
+    std::string countBytes;
+    putInt(countBytes, count, 4);
+    buf.replace(countOffset, 4, countBytes);
+    putInt(buf, hash_crc32a(buf.data(), buf.size()), 4);
+
+    //Written aside then renamed, a crash never leaves half a file
+    std::string tmpFile = m_option.file + ".tmp";
+    FILE* fp = fopen(tmpFile.c_str(), "wb");
+    if (!fp) {
+        LOG(Logger::Warning, "Warm start: can't write %s: %s", tmpFile.c_str(), strerror(errno));
+        return -1;
+    }
+    bool ok = (fwrite(buf.data(), 1, buf.size(), fp) == buf.size());
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok || rename(tmpFile.c_str(), m_option.file.c_str()) != 0) {
+        LOG(Logger::Warning, "Warm start: can't write %s: %s", m_option.file.c_str(), strerror(errno));
+        remove(tmpFile.c_str());
+        return -1;
+    }
+
+    ++m_stats.snapshots;
+    m_stats.savedKeys = count;
+    return count;
+}
+
+bool WarmStart::load(std::vector<std::string> &keys)
+{
+    FILE* fp = fopen(m_option.file.c_str(), "rb");
+    if (!fp) {
+        return false;
+    }
+    std::string buf;
+    char chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+        buf.append(chunk, n);
+    }
+    fclose(fp);
+
+    const int headerSize = 9;
+    if (buf.size() < headerSize + 4 || buf.compare(0, 4, "OCWS") != 0 ||
+        (unsigned char)buf[4] != Version ||
+        getInt(buf.data() + buf.size() - 4, 4) != hash_crc32a(buf.data(), buf.size() - 4)) {
+        LOG(Logger::Warning, "Warm start: %s is not a valid snapshot", m_option.file.c_str());
+        return false;
+    }
+
+    unsigned int count = getInt(buf.data() + 5, 4);
+    const char* p = buf.data() + headerSize;
+    const char* end = buf.data() + buf.size() - 4;
+    for (unsigned int i = 0; i < count && (int)keys.size() < m_option.maxKeys; ++i) {
+        if (end - p < 2) {
+            break;
+        }
+        int len = getInt(p, 2);
+        p += 2;
+        if (end - p < len) {
+            break;
+        }
+        keys.push_back(std::string(p, len));
+        p += len;
+    }
+    return true;
+}
+
+//One MGET per batch of keys of a group, sent like the requests of the
+//clients but past the cache, so the replies are stored by prefill()
+void WarmStart::prefetch(const std::vector<std::string> &keys, EventLoop *loop)
+{
+    std::map<RedisServantGroup*, std::vector<std::string> > byGroup;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        RedisServantGroup* group = m_proxy->mapToGroup(keys[i].data(), keys[i].size());
+        if (group) {
+            byGroup[group].push_back(keys[i]);
+        }
+    }
+
+    HotKeyCache* cache = m_proxy->hotKeyCache();
+    std::map<RedisServantGroup*, std::vector<std::string> >::iterator it = byGroup.begin();
+    for (; it != byGroup.end(); ++it) {
+        RedisServantGroup* group = it->first;
+        std::vector<std::string>& groupKeys = it->second;
+        for (size_t begin = 0; begin < groupKeys.size(); begin += m_option.batchSize) {
+            size_t end = begin + m_option.batchSize;
+            if (end > groupKeys.size()) {
+                end = groupKeys.size();
+            }
+
+            Batch* batch = new Batch;
+            batch->owner = this;
+            ClientPacket* packet = new ClientPacket;
+            packet->eventLoop = loop;
+            packet->commandType = RedisCommand::MGET;
+            packet->finished_func = onPrefetchFinished;
+            packet->finished_arg = batch;
+            packet->recvBuff.appendFormatString("*%d\r\n$4\r\nMGET\r\n", (int)(end - begin + 1));
+            for (size_t i = begin; i < end; ++i) {
+                const std::string& key = groupKeys[i];
+                packet->recvBuff.appendFormatString("$%d\r\n", (int)key.size());
+                packet->recvBuff.append(key.data(), key.size());
+                packet->recvBuff.append("\r\n", 2);
+                batch->keys.push_back(key);
+                batch->epochs.push_back(cache->epoch(key.data(), key.size()));
+            }
+            packet->continueToParseRecvBuffer();
+            if (group->compressThreshold() > 0) {
+                packet->decompressOffset = 0;
+            }
+            __sync_add_and_fetch(&m_stats.pendingBatches, 1);
+            m_proxy->handleGroupPacket(group, packet);
+        }
+    }
+}
+
+void WarmStart::onPrefetchFinished(ClientPacket *packet, void *arg)
+{
+    Batch* batch = (Batch*)arg;
+    WarmStart* owner = batch->owner;
+    HotKeyCache* cache = owner->m_proxy->hotKeyCache();
+    char* data = packet->sendBuff.data();
+    int size = packet->sendBuff.size();
+    RedisProtoParseResult r;
+    bool ok = (packet->finishedState == ClientPacket::RequestFinished &&
+               RedisProto::parse(data, size, &r) == RedisProto::ProtoOK &&
+               r.type == RedisProtoParseResult::MultiBulk &&
+               r.integer == (int)batch->keys.size());
+
+    int prefetched = 0;
+    int missing = 0;
+    if (ok) {
+        //The elements are walked one by one, they may be more than MaxToken
+        char* p = data;
+        while (*p != '\n') {
+            ++p;
+        }
+        ++p;
+        RedisProtoParseResult elem;
+        for (size_t i = 0; i < batch->keys.size(); ++i) {
+            elem.reset();
+            if (RedisProto::parse(p, data + size - p, &elem) != RedisProto::ProtoOK) {
+                ok = false;
+                break;
+            }
+            const std::string& key = batch->keys[i];
+            if (elem.type == RedisProtoParseResult::Bulk && elem.tokens[0].len >= 0 &&
+                cache->prefill(key.data(), key.size(), p, elem.protoBuffLen, batch->epochs[i])) {
+                ++prefetched;
+            } else {
+                ++missing;
+            }
+            p += elem.protoBuffLen;
+        }
+    }
+    if (!ok) {
+        LOG(Logger::Warning, "Warm start: MGET of %d keys failed: %.*s", (int)batch->keys.size(), size > 64 ? 64 : size, data);
+        __sync_add_and_fetch(&owner->m_stats.failedBatches, 1);
+    }
+    __sync_add_and_fetch(&owner->m_stats.prefetched, prefetched);
+    __sync_add_and_fetch(&owner->m_stats.missing, missing);
+    __sync_sub_and_fetch(&owner->m_stats.pendingBatches, 1);
+    delete batch;
+    delete packet;
+}
+
+void WarmStart::onSnapshotTimer(socket_t, short, void *arg)
+{
+    WarmStart* owner = (WarmStart*)arg;
+    owner->snapshot();
+    owner->m_timer.active(owner->m_option.interval * 1000);
+}
+
+WarmStart::Stats WarmStart::stats(void)
+{
+    Stats s = m_stats;
+    s.pendingBatches = __sync_add_and_fetch(&m_stats.pendingBatches, 0);
+    return s;
+}
@@ -0,0 +1,111 @@
+﻿/*
+* Licensed to the Apache Software Foundation (ASF) under one
+* or more contributor license agreements.  See the NOTICE file
+* distributed with this work for additional information
+* regarding copyright ownership.  The ASF licenses this file
+* to you under the Apache License, Version 2.0 (the
+* "License"); you may not use this file except in compliance
+* with the License.  You may obtain a copy of the License at
+*
+*   http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing,
+* software distributed under the License is distributed on an
+* "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+* KIND, either express or implied.  See the License for the
+* specific language governing permissions and limitations
+* under the License.
+*/
+
+#ifndef WARMSTART_H
+#define WARMSTART_H
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "eventloop.h"
+
+class ClientPacket;
+class RedisProxy;
+
+//The hot keys of the cache are saved to a file from time to time. At
+//startup they are read again with MGET, in the background while the
+//clients are served, and the replies fill the cache.
+//
+//File: "OCWS", version (1 byte), key count (4 bytes), then for each key
+//its length (2 bytes) and its bytes, the hottest first, then the CRC32
+//of all that. Integers are little endian
+class WarmStart
+{
+public:
+    struct Option {
+        Option(void) {
+            interval = 60;
+            maxKeys = 1000;
+            batchSize = 100;
+        }
+
+        std::string file;
+        int interval;           //Seconds between the snapshots
+        int maxKeys;            //Keys in a snapshot at most
+        int batchSize;          //Keys of a MGET
+    };
+
+    struct Stats {
+        Stats(void) { memset(this, 0, sizeof(Stats)); }
+
+        long long snapshots;
+        int savedKeys;          //Keys of the last snapshot
+        int loadedKeys;         //Keys read from the file at startup
+        int prefetched;         //Keys put in the cache
+        int missing;            //Keys without a string value
+        int failedBatches;
+        int pendingBatches;
+    };
+
+    enum {
+        Version = 1,
+        MaxKeyLength = 65535
+    };
+
+    WarmStart(void);
+    ~WarmStart(void);
+
+    void setProxy(RedisProxy* proxy) { m_proxy = proxy; }
+
+    void setOption(const Option& opt) { m_option = opt; }
+    Option option(void) const { return m_option; }
+
+    void setEnabled(bool b) { m_enabled = b; }
+    bool isEnabled(void) const { return m_enabled; }
+
+    //Prefetch the keys of the file and save the snapshots, in loop
+    void start(EventLoop* loop);
+
+    //Number of keys saved, -1 on error. An empty set keeps the old file
+    int snapshot(void);
+
+    Stats stats(void);
+
+private:
+    struct Batch;
+
+    bool load(std::vector<std::string>& keys);
+    void prefetch(const std::vector<std::string>& keys, EventLoop* loop);
+    static void onPrefetchFinished(ClientPacket* packet, void* arg);
+    static void onSnapshotTimer(socket_t, short, void* arg);
+
+private:
+    bool m_enabled;
+    RedisProxy* m_proxy;
+    Option m_option;
+    Event m_timer;
+    Stats m_stats;
+
+private:
+    WarmStart(const WarmStart&);
+    WarmStart& operator =(const WarmStart&);
+};
+
+#endif